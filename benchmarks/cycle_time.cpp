@@ -0,0 +1,78 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+#include "boiler/trace.hpp"
+#include "boiler/watchdog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// How long control_unit::process_messages takes on ordinary cycles: seeded
+// control_unit + simulator pairs run from start up, with a pump failure
+// halfway through so that the degraded routines and the acks are in the
+// mix. Built without exceptions too (see subprojects/libboiler/
+// meson_options.txt), to compare. Run again with tracing on, and with a
+// watchdog heartbeat, for their overhead.
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    auto run(bool traced, boiler::watchdog::heartbeat* beat = nullptr) -> void
+    {
+        constexpr auto runs   = 200;
+        constexpr auto cycles = 300u;
+        const auto constants  = make_constants();
+        boiler::trace::enable(traced);
+
+        auto ns = std::vector<double>{};
+        ns.reserve(runs * cycles);
+        for (auto seed = 0; seed < runs; ++seed) {
+            auto ctrl  = boiler::control_unit{ constants };
+            ctrl.watch(beat);
+            auto plant = boiler::simulator{ constants, static_cast<ta::u64>(seed) };
+            for (auto cycle = 0u; cycle < cycles; ++cycle) {
+                if (cycle == cycles / 2) { plant.inject(boiler::simulator::fault::pump, 1); }
+                auto messages    = plant.get_messages();
+                const auto start = clock::now();
+                const auto out   = ctrl.process_messages(std::move(messages));
+                const auto took  = std::chrono::duration<double, std::nano>(clock::now() - start);
+                plant.process_messages(out);
+                ns.push_back(took.count());
+            }
+        }
+        boiler::trace::enable(false);
+
+        std::sort(ns.begin(), ns.end());
+        auto total = 0.0;
+        for (auto t : ns) { total += t; }
+        std::cout << "process_messages" << (traced ? " (traced)" : "") << (beat ? " (watched)" : "") << ": mean "
+                  << total / static_cast<double>(ns.size()) << "ns, median " << ns[ns.size() / 2]
+                  << "ns, p99 " << ns[ns.size() * 99 / 100] << "ns, max " << ns.back() << "ns\n";
+    }
+}
+
+int main()
+{
+    run(false);
+    run(true);
+
+    // Nothing to monitor it: what the cycle thread pays is the same.
+    auto beat = boiler::watchdog::heartbeat{};
+    run(false, &beat);
+}
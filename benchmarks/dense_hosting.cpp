@@ -0,0 +1,101 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory> // std::allocator, std::construct_at.
+#include <vector>
+
+// Many control units hosted side by side, all of them stepped once per
+// round, the way a gateway for a plant of many boilers would: at 10^5
+// instances nothing stays in the cache from one round to the next, so what
+// a step costs is mostly the cache lines it touches. Also prints where an
+// instance's bytes go (see control_unit::footprint).
+
+namespace {
+    using clock = std::chrono::steady_clock;
+    namespace msg = boiler::messages;
+
+    constexpr auto instances = std::size_t{ 100'000 };
+    constexpr auto rounds    = 5;
+
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    // A unit that went through the handshake, to start every instance from.
+    auto operating(const boiler::constants& c) -> boiler::control_unit::snapshot
+    {
+        auto plant = boiler::simulator{ c, 1 };
+        auto ctrl  = boiler::control_unit{ c };
+        for (auto cycle = 0; cycle < 20; ++cycle) {
+            plant.process_messages(ctrl.process_messages(plant.get_messages()));
+        }
+        return ctrl.save();
+    }
+
+    auto readings(float level) -> std::vector<boiler::control_unit::msg_from_units>
+    {
+        using state = msg::to_program::pump_state::possible_states;
+        using flow  = msg::to_program::pump_control_state::possible_states;
+        auto in     = std::vector<boiler::control_unit::msg_from_units>{
+            msg::to_program::level{ level },
+            msg::to_program::steam{ 4 },
+        };
+        for (auto n = ta::u8{ 0 }; n < 4; ++n) {
+            in.push_back(msg::to_program::pump_state{ n, n == 0 ? state::open : state::closed });
+            in.push_back(msg::to_program::pump_control_state{
+                n, n == 0 ? flow::flowing : flow::not_flowing });
+        }
+        return in;
+    }
+}
+
+int main()
+{
+    const auto constants = make_constants();
+    const auto start     = operating(constants);
+
+    // One block, no gaps but the alignment.
+    auto alloc  = std::allocator<boiler::control_unit>{};
+    auto* units = alloc.allocate(instances);
+    for (auto i = std::size_t{ 0 }; i < instances; ++i) {
+        std::construct_at(units + i, constants);
+        units[i].restore(start);
+    }
+
+    // A few different levels, so that not every instance decides the same.
+    auto inputs = std::vector<std::vector<boiler::control_unit::msg_from_units>>{};
+    for (auto l = 0; l < 8; ++l) { inputs.push_back(readings(static_cast<float>(400 + 25 * l))); }
+
+    auto best = std::chrono::duration<double, std::nano>::max();
+    auto sent = std::size_t{ 0 };
+    for (auto round = 0; round < rounds; ++round) {
+        const auto began = clock::now();
+        for (auto i = std::size_t{ 0 }; i < instances; ++i) {
+            const auto& in = inputs[(i + static_cast<std::size_t>(round)) % inputs.size()];
+            sent += units[i].process_messages(in).size();
+        }
+        best = std::min<std::chrono::duration<double, std::nano>>(best, clock::now() - began);
+    }
+
+    const auto f = units[0].footprint();
+    std::cout << "dense hosting: " << instances << " instances, " << best.count() / instances
+              << "ns per step (best of " << rounds << " rounds), " << sent << " messages sent\n"
+              << "per instance: " << f.size << " bytes, " << f.hot << " hot, " << f.heap
+              << " on the heap\n";
+
+    for (auto i = std::size_t{ 0 }; i < instances; ++i) { std::destroy_at(units + i); }
+    alloc.deallocate(units, instances);
+}
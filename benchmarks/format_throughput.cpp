@@ -0,0 +1,78 @@
+#include "boiler/message_format.hpp"
+#include "boiler/messages.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// Formatting throughput of operator<< (through an ostream that discards its
+// output, so only the formatting is measured) against format_to into a
+// buffer.
+
+namespace {
+    struct null_buffer : std::streambuf
+    {
+        auto overflow(int_type c) -> int_type override { return c; }
+        auto xsputn(const char*, std::streamsize n) -> std::streamsize override { return n; }
+    };
+
+    auto sample_messages()
+    {
+        namespace to_program = boiler::messages::to_program;
+
+        // What a cycle of a 4 pump boiler looks like.
+        auto cycle = std::vector<to_program::any>{};
+        for (auto n = ta::u8{ 0 }; n < 4; ++n) {
+            cycle.push_back(to_program::pump_state{ n, to_program::pump_state::possible_states::open });
+            cycle.push_back(to_program::pump_control_state{
+                n, to_program::pump_control_state::possible_states::flowing });
+        }
+        cycle.push_back(to_program::level{ 512.25f });
+        cycle.push_back(to_program::steam{ 3.14159f });
+        return cycle;
+    }
+}
+
+int main()
+{
+    using clock = std::chrono::steady_clock;
+    constexpr auto rounds = 200'000;
+
+    const auto messages = sample_messages();
+    const auto total    = static_cast<double>(rounds) * static_cast<double>(messages.size());
+
+    auto sink_buffer = null_buffer{};
+    auto sink        = std::ostream{ &sink_buffer };
+
+    const auto stream_start = clock::now();
+    for (auto r = 0; r < rounds; ++r) {
+        for (const auto& msg : messages) {
+            std::visit([&](const auto& m) { sink << m << '\n'; }, msg);
+        }
+    }
+    const auto stream_took = std::chrono::duration<double, std::nano>(clock::now() - stream_start);
+
+    auto buffer        = std::vector<char>(1 << 16);
+    auto bytes         = std::size_t{ 0 };
+    const auto fast_start = clock::now();
+    auto out              = buffer.data();
+    for (auto r = 0; r < rounds; ++r) {
+        for (const auto& msg : messages) {
+            if (buffer.data() + buffer.size() - out < static_cast<long>(boiler::messages::max_formatted_size)) {
+                bytes += static_cast<std::size_t>(out - buffer.data());
+                out = buffer.data();
+            }
+            out    = boiler::messages::format_to(out, buffer.data() + buffer.size(), msg).ptr;
+            *out++ = '\n';
+        }
+    }
+    bytes += static_cast<std::size_t>(out - buffer.data());
+    const auto fast_took = std::chrono::duration<double, std::nano>(clock::now() - fast_start);
+
+    std::cout << "operator<<: " << stream_took.count() / total << "ns/message\n";
+    std::cout << "format_to:  " << fast_took.count() / total << "ns/message (" << bytes
+              << " bytes)\n";
+    std::cout << "speedup:    " << stream_took.count() / fast_took.count() << "x\n";
+}
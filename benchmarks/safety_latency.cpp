@@ -0,0 +1,82 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/safety_signals.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Worst-case latency of the safety fast path: how long from the start of
+// process_messages until a third stop in a row is acted on. Measured on its
+// own (signal_counters::observe on the largest cycle the units can send)
+// and end to end (the whole process_messages of the tripping cycle).
+
+namespace msg = boiler::messages;
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    // Every periodic message for max_pumps pumps, the stop last so that the
+    // whole cycle has to be looked at.
+    auto largest_cycle() -> std::vector<msg::from_units::any>
+    {
+        auto messages = std::vector<msg::from_units::any>{};
+        for (auto n = ta::u8{ 0 }; n < boiler::max_pumps; ++n) {
+            messages.push_back(msg::to_program::pump_state{
+                n, msg::to_program::pump_state::possible_states::open });
+            messages.push_back(msg::to_program::pump_control_state{
+                n, msg::to_program::pump_control_state::possible_states::flowing });
+        }
+        messages.push_back(msg::to_program::level{ 500 });
+        messages.push_back(msg::to_program::steam{ 0 });
+        messages.push_back(msg::to_program::stop{});
+        return messages;
+    }
+
+    auto report(const char* what, std::vector<double>& ns) -> void
+    {
+        std::sort(ns.begin(), ns.end());
+        std::cout << what << ": median " << ns[ns.size() / 2] << "ns, p99 "
+                  << ns[ns.size() * 99 / 100] << "ns, max " << ns.back() << "ns\n";
+    }
+}
+
+int main()
+{
+    constexpr auto rounds = 20'000;
+    const auto cycle      = largest_cycle();
+
+    auto fast_path = std::vector<double>{};
+    fast_path.reserve(rounds);
+    auto signals = boiler::safety::signal_counters{};
+    for (auto i = 0; i < rounds; ++i) {
+        const auto start   = clock::now();
+        const auto tripped = signals.observe(cycle);
+        const auto took    = std::chrono::duration<double, std::nano>(clock::now() - start);
+        if (i >= 2 && !tripped) { return 1; }
+        fast_path.push_back(took.count());
+    }
+
+    auto end_to_end = std::vector<double>{};
+    end_to_end.reserve(rounds / 10);
+    auto constants       = boiler::constants{};
+    constants.pump_count = boiler::max_pumps;
+    for (auto i = 0; i < rounds / 10; ++i) {
+        auto ctrl = boiler::control_unit{ constants };
+        ctrl.process_messages(cycle);
+        ctrl.process_messages(cycle);
+
+        auto messages  = cycle;
+        const auto start = clock::now();
+        const auto out   = ctrl.process_messages(std::move(messages));
+        const auto took  = std::chrono::duration<double, std::nano>(clock::now() - start);
+        // Safety messages go out first.
+        const auto& mode = std::get<msg::to_units::mode>(out.front());
+        if (mode.m != boiler::control_unit::mode::emergency_stop) { return 1; }
+        end_to_end.push_back(took.count());
+    }
+
+    report("signal_counters::observe", fast_path);
+    report("process_messages (tripping cycle)", end_to_end);
+}
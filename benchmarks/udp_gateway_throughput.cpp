@@ -0,0 +1,122 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/udp_gateway.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+// A fleet of boilers behind one gateway, on loopback: every cycle the plant
+// sends each boiler's readings, the gateway hands them to that boiler's
+// control unit and sends its reply back. Reports the round trip of a whole
+// fleet cycle, the part of it spent in the gateway and control units, and
+// the datagram rate, scaled to a thousand boilers; then again in delta mode,
+// where a steady plant only sends what changed.
+
+namespace {
+    auto readings(ta::u8 pumps) -> std::vector<boiler::messages::to_program::any>
+    {
+        namespace to_program = boiler::messages::to_program;
+
+        auto cycle = std::vector<to_program::any>{};
+        for (auto n = ta::u8{ 0 }; n < pumps; ++n) {
+            cycle.push_back(to_program::pump_state{ n, to_program::pump_state::possible_states::closed });
+            cycle.push_back(to_program::pump_control_state{
+                n, to_program::pump_control_state::possible_states::not_flowing });
+        }
+        cycle.push_back(to_program::level{ 500 });
+        cycle.push_back(to_program::steam{ 0 });
+        return cycle;
+    }
+
+    template<typename Endpoint>
+    auto receive_all(Endpoint& e, std::size_t count) -> std::size_t
+    {
+        auto received = std::size_t{ 0 };
+        while (received < count) {
+            const auto n = e.poll(std::chrono::milliseconds{ 100 });
+            if (n == 0) { break; } // Lost on the way.
+            received += n;
+        }
+        return received;
+    }
+
+    auto run(bool delta) -> void
+    {
+        using clock                 = std::chrono::steady_clock;
+        constexpr auto boilers      = std::size_t{ 1000 };
+        constexpr auto cycles       = 200;
+        constexpr auto per_thousand = 1000.0 / static_cast<double>(boilers);
+
+        auto gateway = boiler::net::gateway{ "127.0.0.1", 0, boilers, 256 };
+        auto plant   = boiler::net::loopback_plant{ "127.0.0.1", 0, boilers, 256 };
+        plant.connect("127.0.0.1", gateway.port());
+        if (delta) {
+            gateway.enable_delta();
+            plant.enable_delta();
+        }
+
+        auto c = boiler::constants{};
+        // control_unit can't be moved.
+        auto units = std::deque<boiler::control_unit>{};
+        for (auto b = std::size_t{ 0 }; b < boilers; ++b) { units.emplace_back(c); }
+
+        const auto sent = readings(c.pump_count);
+        auto in         = std::vector<boiler::messages::to_program::any>{};
+        auto out        = std::vector<boiler::messages::to_units::any>{};
+
+        auto round_trips  = std::vector<double>{};
+        auto gateway_side = std::vector<double>{};
+        auto lost         = std::size_t{ 0 };
+        for (auto cycle = ta::u32{ 0 }; cycle < cycles; ++cycle) {
+        const auto start = clock::now();
+        for (auto b = ta::u32{ 0 }; b < boilers; ++b) { plant.send(b, sent); }
+        plant.flush();
+
+        const auto received = receive_all(gateway, boilers);
+        const auto serving  = clock::now();
+        for (auto b = ta::u32{ 0 }; b < boilers; ++b) {
+            gateway.take(b, in);
+            gateway.send(b, units[b].process_messages(in));
+        }
+        gateway.flush();
+        const auto served = clock::now();
+
+        const auto replies = receive_all(plant, received);
+        for (auto b = ta::u32{ 0 }; b < boilers; ++b) { plant.take(b, out); }
+
+        lost += 2 * boilers - received - replies;
+        round_trips.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+        gateway_side.push_back(std::chrono::duration<double, std::micro>(served - serving).count());
+        }
+
+        std::sort(round_trips.begin(), round_trips.end());
+        std::sort(gateway_side.begin(), gateway_side.end());
+        const auto median = [](const std::vector<double>& v) { return v[v.size() / 2]; };
+        const auto p99    = [](const std::vector<double>& v) { return v[v.size() * 99 / 100]; };
+
+        auto total = 0.0;
+        for (auto t : round_trips) { total += t; }
+        const auto datagrams_per_sec = 2.0 * boilers * cycles / (total / 1e6);
+
+        std::cout << (delta ? "delta mode: " : "full mode: ") << boilers << " boilers, " << cycles
+                  << " cycles, " << lost << " datagrams lost\n";
+        std::cout << "bytes per boiler cycle: "
+                  << static_cast<double>(plant.stats().bytes_out) / (boilers * cycles) << " in, "
+                  << static_cast<double>(gateway.stats().bytes_out) / (boilers * cycles) << " out\n";
+        std::cout << "fleet cycle round trip: " << median(round_trips) * per_thousand << "us median, "
+                  << p99(round_trips) * per_thousand << "us p99 per 1000 boilers\n";
+        std::cout << "gateway + control units: " << median(gateway_side) * per_thousand
+                  << "us median, " << p99(gateway_side) * per_thousand << "us p99 per 1000 boilers\n";
+        std::cout << "throughput: " << datagrams_per_sec / 1000.0 << "k datagrams/s ("
+                  << datagrams_per_sec / (2.0 * 1000.0) << " cycles/s of 1000 boilers)\n";
+    }
+}
+
+int main()
+{
+    run(false);
+    run(true);
+}
@@ -1,20 +1,256 @@
 #include <iostream>
+#include <charconv> // std::from_chars.
 #include <chrono>
+#include <csignal>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <string_view>
 #include <thread>
+#include <utility> // std::pair.
 
+#include "boiler/checkpoint.hpp"
 #include "boiler/common.hpp"
+#include "boiler/config.hpp"
 #include "boiler/control_unit.hpp"
 #include "boiler/physical_units.hpp"
+#include "boiler/pipeline.hpp"
+#include "boiler/realtime.hpp"
+#include "boiler/trace.hpp"
+#include "boiler/watchdog.hpp"
 
-int main()
+namespace {
+    volatile std::sig_atomic_t running    = 1;
+    volatile std::sig_atomic_t dump_trace = 0;
+
+    auto usage() -> int
+    {
+        std::cerr << "usage: caldeira [--config FILE [--unit NAME]] [--daemon] [--pipelined]\n"
+                     "                [--cpu N] [--lock-memory] [--fifo PRIORITY] [--trace FILE]\n"
+                     "                [--checkpoint FILE]\n"
+                     "       caldeira --compile-config TEXT_FILE COMPILED_FILE\n";
+        return 2;
+    }
+
+    template<typename T>
+    auto number(std::string_view text) -> std::optional<T>
+    {
+        auto value     = T{};
+        const auto end = text.data() + text.size();
+        const auto [at, error] = std::from_chars(text.data(), end, value);
+        if (error != std::errc{} || at != end) { return std::nullopt; }
+        return value;
+    }
+
+    auto operator<<(std::ostream& os, const boiler::realtime::counters& c) -> std::ostream&
+    {
+        return os << c.minor_faults + c.major_faults << " page faults ("
+                  << c.major_faults << " major), " << c.involuntary_switches
+                  << " preemptions";
+    }
+}
+
+// --config loads the constants from a config in either format (see
+// boiler::config), --unit picks a unit's overrides in it. --daemon only
+// reports overruns, on stderr, and stops on SIGINT/SIGTERM.
+// --compile-config turns a text config into the binary one and exits.
+//
+// --cpu, --lock-memory and --fifo set up the cycle thread (the compute stage
+// with --pipelined) for real-time operation, see boiler::realtime. What the
+// system refuses is reported and the loop runs anyway. Every cycle reports
+// the page faults and preemptions it took; with --daemon only the cycles
+// that took any.
+//
+// --trace records a timeline of the control unit's cycles (see
+// boiler::trace) and writes the latest of it to FILE, as Chrome trace JSON,
+// on SIGUSR1 and when stopping on SIGINT/SIGTERM.
+//
+// --checkpoint keeps the control unit's state in FILE every cycle (see
+// boiler::checkpoint). After a restart, when the first cycle's messages
+// agree with it, the unit carries on in the mode it was in instead of
+// waiting for the initialization handshake again.
+//
+// A watchdog (see boiler::watchdog) stops the plant when a cycle stays in
+// one phase for longer than constants::cycle_time, and says which: the
+// overrun check only runs once a stage returns. Only the control unit's
+// phases are watched with --pipelined, the plant I/O overlaps them.
+int main(int argc, char** argv)
 {
     namespace ch = std::chrono;
-    using namespace std::literals::chrono_literals;
+
+    auto config_path     = std::string_view{};
+    auto unit_name       = std::string_view{};
+    auto daemon          = false;
+    auto pipelined       = false;
+    auto rt              = boiler::realtime::options{};
+    auto trace_path      = std::string_view{};
+    auto checkpoint_path = std::string_view{};
+    for (auto i = 1; i < argc; ++i) {
+        const auto arg       = std::string_view{ argv[i] };
+        const auto has_value = i + 1 < argc;
+        if (arg == "--config" && has_value) {
+            config_path = argv[++i];
+        } else if (arg == "--unit" && has_value) {
+            unit_name = argv[++i];
+        } else if (arg == "--daemon") {
+            daemon = true;
+        } else if (arg == "--pipelined") {
+            pipelined = true;
+        } else if (arg == "--cpu" && has_value) {
+            rt.cpu = number<unsigned>(argv[++i]);
+            if (!rt.cpu || *rt.cpu >= boiler::realtime::max_cpus) { return usage(); }
+        } else if (arg == "--lock-memory") {
+            rt.lock_memory = true;
+        } else if (arg == "--fifo" && has_value) {
+            rt.fifo_priority = number<int>(argv[++i]);
+            if (!rt.fifo_priority) { return usage(); }
+        } else if (arg == "--trace" && has_value) {
+            trace_path = argv[++i];
+        } else if (arg == "--checkpoint" && has_value) {
+            checkpoint_path = argv[++i];
+        } else if (arg == "--compile-config" && i + 2 < argc) {
+            try {
+                boiler::config::compile(boiler::config::read(argv[i + 1]), argv[i + 2]);
+                return 0;
+            } catch (const std::exception& e) {
+                std::cerr << "caldeira: " << e.what() << '\n';
+                return 1;
+            }
+        } else {
+            return usage();
+        }
+    }
+    if (config_path.empty() && !unit_name.empty()) { return usage(); }
+
     auto constants = boiler::constants{};
+    if (!config_path.empty()) {
+        try {
+            constants = boiler::config::load(config_path, unit_name);
+        } catch (const std::exception& e) {
+            std::cerr << "caldeira: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    if (daemon || !trace_path.empty()) {
+        std::signal(SIGINT, [](int) { running = 0; });
+        std::signal(SIGTERM, [](int) { running = 0; });
+    }
+    if (!trace_path.empty()) {
+        std::signal(SIGUSR1, [](int) { dump_trace = 1; });
+        boiler::trace::enable();
+    }
+    // Between cycles, never from the signal handler.
+    const auto write_trace = [&](bool stopping) {
+        if (trace_path.empty() || !(stopping || dump_trace)) { return; }
+        dump_trace = 0;
+        auto out   = std::ofstream{ std::string{ trace_path } };
+        boiler::trace::write_chrome_json(out);
+        if (!out) { std::cerr << "caldeira: can't write the trace to " << trace_path << '\n'; }
+    };
+    // Per-cycle reports are for interactive runs.
+    auto& log = daemon ? std::cerr : std::cout;
+    if (daemon) { std::cout.setstate(std::ios::badbit); }
+
     boiler::physical_units pu;
     boiler::control_unit ctrl{ constants };
 
-    auto max_cycle_time = 5s;
+    // Loaded before the writer takes the file over.
+    auto resume_from = std::optional<boiler::checkpoint::found>{};
+    auto checkpoints = std::optional<boiler::checkpoint::writer>{};
+    if (!checkpoint_path.empty()) {
+        try {
+            resume_from = boiler::checkpoint::load(checkpoint_path, constants);
+            checkpoints.emplace(checkpoint_path, constants);
+        } catch (const std::exception& e) {
+            std::cerr << "caldeira: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    const auto take_checkpoint = [&] {
+        if (checkpoints) { checkpoints->offer(ctrl); }
+    };
+
+    // --pipelined overlaps sending a cycle's outputs with the next cycle,
+    // see boiler::pipelined_executor. Its output thread starts before the
+    // cycle thread is pinned and raised to SCHED_FIFO, it would inherit
+    // both and compete with it for the core.
+    auto executor = std::optional<
+        boiler::pipelined_executor<boiler::physical_units, boiler::control_unit>>{};
+    if (pipelined) { executor.emplace(pu, ctrl); }
+
+    const auto max_cycle_time = constants.cycle_time;
+
+    // The cycle thread is stuck, possibly holding anything: the stop goes
+    // to the plant directly, and through the mailbox for when the unit
+    // comes back. The monitor starts before the cycle thread is pinned and
+    // raised to SCHED_FIFO too: sharing its core at a lower priority, it
+    // would never run while the cycle thread spins.
+    auto heartbeat = boiler::watchdog::heartbeat{};
+    ctrl.watch(&heartbeat);
+    const auto watchdog = boiler::watchdog::monitor{
+        heartbeat, max_cycle_time, [&](const boiler::watchdog::stall& s) {
+            pu.emergency_stop();
+            ctrl.commands().request_emergency_stop();
+            std::cerr << "ERROR_STALL:   cycle stuck in " << s.stuck << " for "
+                      << ch::duration_cast<ch::milliseconds>(s.for_how_long).count()
+                      << "ms; emergency_stop sent to the plant\n";
+        }
+    };
+
+    const auto granted = boiler::realtime::prepare(rt);
+    for (const auto& [what, error] : { std::pair{ "pinning to a core", granted.pinning },
+                                       std::pair{ "locking memory", granted.locking },
+                                       std::pair{ "SCHED_FIFO", granted.scheduling } }) {
+        if (error) { std::cerr << "caldeira: " << what << " refused: " << error.message() << '\n'; }
+    }
+    // A cycle that took any of these may have been delayed by them.
+    auto report_jitter = [&](const boiler::realtime::counters& c) {
+        if (daemon && c.minor_faults + c.major_faults + c.involuntary_switches > 0) {
+            log << "JITTER:        cycle took " << c << '\n';
+        }
+    };
+
+    // The first cycle decides whether the checkpoint is resumed, before
+    // either loop starts: a checkpoint older than a few cycles is of a
+    // plant that has been left alone for too long.
+    if (resume_from) {
+        auto from_pu = pu.get_messages();
+        if (boiler::checkpoint::plausible(
+                *resume_from, constants, from_pu, ch::system_clock::now(),
+                4 * max_cycle_time)) {
+            ctrl.restore(resume_from->state);
+            log << "RESUMED:       from the checkpoint, in "
+                << resume_from->state.mode_of_operation << " mode\n";
+        } else {
+            log << "COLD_START:    the checkpoint doesn't agree with the plant\n";
+        }
+        pu.process_messages(ctrl.process_messages(std::move(from_pu)));
+        take_checkpoint();
+    }
+
+    if (executor) {
+        while (running) {
+            auto start  = ch::steady_clock::now();
+            auto before = boiler::realtime::usage();
+            auto report = executor->step();
+            auto took   = boiler::realtime::usage() - before;
+
+            auto duration = ch::duration_cast<ch::milliseconds>(
+                ch::steady_clock::now() - start);
+            auto slack = max_cycle_time - duration;
+            std::cout << "OK:            cycle took " << duration.count() << "ms; "
+                      << ch::duration_cast<ch::milliseconds>(slack).count()
+                      << "ms of slack ("
+                      << ch::duration_cast<ch::microseconds>(report.recovered()).count()
+                      << "us recovered by pipelining); " << took << '\n';
+            report_jitter(took);
+            write_trace(false);
+            take_checkpoint();
+            std::this_thread::sleep_for(slack);
+        }
+        write_trace(true);
+        return 0;
+    }
 
     auto exchange_messages = [&](const auto& start) {
         auto throw_on_timeout = [&] {
@@ -22,34 +258,42 @@ int main()
             if (now - start >= max_cycle_time) throw now;
         };
 
+        heartbeat.enter(boiler::watchdog::phase::plant_input);
         auto from_pu = pu.get_messages();
         throw_on_timeout();
         auto to_pu = ctrl.process_messages(std::move(from_pu));
         throw_on_timeout();
+        heartbeat.enter(boiler::watchdog::phase::plant_output);
         pu.process_messages(std::move(to_pu));
+        heartbeat.enter(boiler::watchdog::phase::idle);
         throw_on_timeout();
     };
 
-    while (true) {
-        auto start = ch::high_resolution_clock::now();
+    while (running) {
+        auto start  = ch::high_resolution_clock::now();
+        auto before = boiler::realtime::usage();
 
         try {
             exchange_messages(start);
 
             auto end      = ch::high_resolution_clock::now();
+            auto took     = boiler::realtime::usage() - before;
             auto duration = ch::duration_cast<ch::milliseconds>(end - start);
             auto slack    = max_cycle_time - duration;
             std::cout << "OK:            cycle took " << duration.count()
                       << "ms; "
                       << ch::duration_cast<ch::milliseconds>(slack).count()
-                      << "ms of slack\n";
+                      << "ms of slack; " << took << '\n';
+            report_jitter(took);
+            write_trace(false);
+            take_checkpoint();
             std::this_thread::sleep_for(slack);
         } catch (const ch::high_resolution_clock::time_point& end) {
+            heartbeat.enter(boiler::watchdog::phase::idle);
             auto duration = ch::duration_cast<ch::nanoseconds>(end - start);
-            std::cout << "ERROR_OVERRUN: cycle took " << duration.count()
-                      << "ns\n";
+            log << "ERROR_OVERRUN: cycle took " << duration.count() << "ns; "
+                << boiler::realtime::usage() - before << '\n';
         }
     }
+    write_trace(true);
 }
-
-
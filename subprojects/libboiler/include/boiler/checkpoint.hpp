@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // std::size_t, std::byte.
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Warm restarts: the control unit's snapshot (see control_unit::snapshot),
+// kept in a file so that a controller restarted on a running plant carries
+// on in the mode it was in instead of waiting for a steam_boiler_waiting
+// that will never come.
+//
+// A writer takes a snapshot between cycles (a copy, the cycle thread never
+// waits) and a thread of its own puts it in a memory-mapped file, in the
+// older of two checksummed slots: a process killed mid-write leaves the
+// other one intact. The file is in the page cache once written, it
+// survives the process but not the machine.
+//
+// Snapshots name their handlers by id rather than by address, so the file
+// means the same to any process of a build with the same handler ids,
+// wherever its code was loaded.
+//
+// A checkpoint can only be trusted once the plant confirms it: plausible()
+// checks it against the first cycle's messages before it's restored.
+namespace boiler::checkpoint {
+    struct options
+    {
+        // Cycles between checkpoints, see writer::offer().
+        ta::u32 every = 1;
+    };
+
+    struct found
+    {
+        control_unit::snapshot state;
+        // By the system clock, which goes on across restarts.
+        std::chrono::system_clock::time_point taken;
+    };
+
+    // The latest intact checkpoint in `path`, ready to restore in this
+    // process. nullopt when there is none, or it was written with other
+    // constants, or names handlers this build doesn't have (see
+    // control_unit::restorable()).
+    auto load(const std::filesystem::path& path, const boiler::constants& c)
+        -> std::optional<found>;
+
+    // Whether `first`, the messages of the first cycle after a restart,
+    // agree with the checkpoint: the plant didn't restart too (no
+    // steam_boiler_waiting), the unit was past the handshake, the
+    // checkpoint is at most `max_age` old and the level and steam (unless
+    // assumed broken) are within what they can have changed since.
+    auto plausible(
+        const found& f,
+        const boiler::constants& c,
+        const std::vector<control_unit::msg_from_units>& first,
+        std::chrono::system_clock::time_point now,
+        std::chrono::milliseconds max_age) -> bool;
+
+    class writer
+    {
+    public:
+        // Creates `path` or takes it over. Checkpoints of the same
+        // constants carry on where the file's newest one was; the file's
+        // checkpoints are otherwise dropped with the first one written,
+        // so a process that dies before that leaves them for the next
+        // restart. Throws std::system_error when it can't be created,
+        // sized or mapped.
+        writer(const std::filesystem::path& path, const boiler::constants& c, options o = {});
+        // Writes the last snapshot offered, if it wasn't yet.
+        ~writer();
+
+        writer(const writer&) = delete;
+        auto operator=(const writer&) -> writer& = delete;
+
+        // Between cycles, from the thread that calls process_messages.
+        // Every `every` calls, copies the unit's snapshot for the writer's
+        // thread. Returns whether it did: it doesn't wait for the writer,
+        // a snapshot that comes while the previous one is being picked up
+        // is skipped.
+        auto offer(const control_unit& ctrl) -> bool;
+
+        // Checkpoints in the file so far.
+        auto written() const noexcept -> ta::u64 { return writes.load(std::memory_order_relaxed); }
+
+    private:
+        auto write_out() -> void;
+        auto put(const control_unit::snapshot& s, std::chrono::system_clock::time_point taken)
+            -> void;
+
+        options opts;
+        ta::u32 calls = 0;
+        std::byte* data = nullptr;
+        std::size_t bytes = 0;
+        ta::u64 sequence = 0;
+        std::atomic<ta::u64> writes{ 0 };
+        // Until the first put(), for a file of other constants (or not a
+        // checkpoint at all): the constants its header is rewritten with.
+        std::optional<boiler::constants> take_over;
+
+        std::mutex staging_lock;
+        std::condition_variable wake;
+        std::optional<control_unit::snapshot> staged;
+        std::chrono::system_clock::time_point staged_at;
+        bool fresh    = false;
+        bool stopping = false;
+        // Last, so that it starts once everything it reads is built.
+        std::thread thread;
+    };
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef> // std::size_t.
+
+#include "boiler/spsc_queue.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+namespace boiler {
+    // Something an operator (or a watchdog, or an HMI) wants the control unit
+    // to do that doesn't come from the physical units.
+    struct operator_command
+    {
+        enum class kind
+        {
+            open_pump,
+            close_pump,
+        } k;
+        ta::u8 n;
+    };
+
+    // Lets other threads talk to a control_unit without locking it. Commands
+    // are only applied by the cycle thread when it calls drain(), which
+    // control_unit::process_messages does before handling any message, so a
+    // command takes effect at most one cycle after being posted.
+    class command_mailbox
+    {
+    public:
+        static constexpr std::size_t capacity = 64;
+
+        // Wait-free and safe to call from any number of threads at once, and
+        // never fails, even when the command queue is full.
+        auto request_emergency_stop() noexcept -> void;
+
+        // Wait-free, but only one thread may post at a time. Returns false
+        // if the queue is full (the consumer is more than `capacity`
+        // commands behind), in which case the command is dropped.
+        [[nodiscard]] auto post(operator_command cmd) noexcept -> bool;
+
+        // Consumer side, only to be called from the cycle thread.
+        // on_emergency_stop() is called first (if a stop was requested since
+        // the last drain), then on_command(cmd) for each command in the order
+        // they were posted.
+        template<typename OnEmergencyStop, typename OnCommand>
+        auto drain(OnEmergencyStop&& on_emergency_stop, OnCommand&& on_command) -> void;
+
+    private:
+        std::atomic<bool> emergency_stop_requested = false;
+        spsc_queue<operator_command, capacity> commands;
+    };
+}
+
+/// Implementation:
+inline auto boiler::command_mailbox::request_emergency_stop() noexcept -> void
+{
+    emergency_stop_requested.store(true, std::memory_order_release);
+}
+
+inline auto boiler::command_mailbox::post(operator_command cmd) noexcept -> bool
+{
+    return commands.try_push(cmd);
+}
+
+template<typename OnEmergencyStop, typename OnCommand>
+auto boiler::command_mailbox::drain(
+    OnEmergencyStop&& on_emergency_stop,
+    OnCommand&& on_command) -> void
+{
+    // Cheap check first so the common case (nothing requested) doesn't
+    // write to the cache line.
+    if (emergency_stop_requested.load(std::memory_order_relaxed) &&
+        emergency_stop_requested.exchange(false, std::memory_order_acquire)) {
+        on_emergency_stop();
+    }
+
+    // Only drain what was there when we started so a fast producer can't
+    // keep the cycle thread here forever.
+    for (auto pending = commands.size(); pending > 0; --pending) {
+        auto cmd = commands.try_pop();
+        if (!cmd) { break; }
+        on_command(*cmd);
+    }
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef> // std::size_t.
+
+#include "boiler/type_aliases.hpp"
 
 namespace boiler {
+    // Pumps are numbered [0, max_pumps).
+    inline constexpr std::size_t max_pumps = 16;
+
     struct constants
     {
         struct boiler_constants
@@ -20,8 +26,24 @@ namespace boiler {
             float min_gradient;
         } steam;
         float pump_capacity; // in liters/sec.
+        // Where normal_routine stops the boiler (see policy.hpp): below
+        // critical_low * min_limit and above critical_high * max_limit.
+        struct safety_margins
+        {
+            float critical_low  = 1.5f;
+            float critical_high = 0.95f;
+        } margins{};
+        // Pumps are numbered [0, pump_count), pump_count <= max_pumps.
+        ta::u8 pump_count = 4;
         // cycle_time has the precision of a millisecond
         // but it 5s by default.
         std::chrono::milliseconds cycle_time = std::chrono::seconds{ 5 };
+        // What the link to the units can carry per cycle, 0 for no limit
+        // (see outbound::scheduler).
+        struct link_budget
+        {
+            ta::u16 messages = 0;
+            ta::u32 bytes    = 0;
+        } link{};
     };
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef> // std::size_t, std::byte.
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "boiler/common.hpp"
+
+/// Summary:
+// The constants of a fleet of boilers: defaults plus per-unit overrides.
+//
+// The text format is for people to edit:
+//
+//     # Comments run to the end of the line.
+//     [defaults]
+//     boiler.capacity = 1000
+//     steam.max_throughput = 8
+//     cycle_time_ms = 5000
+//
+//     [unit north-7]
+//     pump_count = 2
+//
+// Units get the defaults, wherever the [defaults] section is, with their
+// own keys on top. The keys are the members of boiler::constants (see
+// `keys`), with cycle_time in milliseconds.
+//
+// The binary format is what a daemon loads: compile() resolves every unit
+// into a fixed-size record, sorted by name, so an `image` only has to map
+// the file and binary search it, whatever the size of the fleet. It is
+// meant to be compiled on the machines that use it: the byte order and
+// layout are checked, not converted.
+namespace boiler::config {
+    struct unit
+    {
+        std::string name;
+        boiler::constants constants;
+    };
+
+    struct fleet
+    {
+        boiler::constants defaults{};
+        std::vector<unit> units;
+    };
+
+    inline constexpr std::string_view keys[] = {
+        "boiler.capacity",  "boiler.max_limit",     "boiler.max_normal",  "boiler.min_normal",
+        "boiler.min_limit", "steam.max_throughput", "steam.max_gradient", "steam.min_gradient",
+        "pump_capacity",    "margins.critical_low", "margins.critical_high",
+        "pump_count",       "cycle_time_ms",        "link.messages",      "link.bytes",
+    };
+    // Unit names are stored in fixed-size fields in the binary format.
+    inline constexpr std::size_t max_name_length = 31;
+
+    // Throws std::invalid_argument, naming the line, for syntax errors,
+    // unknown keys, out of range values (pump_count in [1, max_pumps],
+    // cycle_time_ms positive), duplicate or too long unit names and
+    // thresholds out of order (min_limit <= min_normal <= max_normal <=
+    // max_limit <= capacity, with the margins' bounds between min_limit and
+    // min_normal and between max_normal and max_limit).
+    auto parse(std::string_view text) -> fleet;
+
+    // Throws std::system_error when the file can't be written.
+    auto compile(const fleet& f, const std::filesystem::path& to) -> void;
+
+    // A compiled config, mapped read-only.
+    class image
+    {
+    public:
+        // Throws std::system_error when the file can't be mapped and
+        // std::invalid_argument when it isn't a compiled config for this
+        // machine.
+        explicit image(const std::filesystem::path& path);
+        ~image();
+
+        image(const image&) = delete;
+        auto operator=(const image&) -> image& = delete;
+
+        // Records are checked like parse() checks units when they are
+        // read: these throw std::invalid_argument for the ones it would
+        // have refused.
+        auto defaults() const -> boiler::constants;
+        auto size() const -> std::size_t { return count; }
+        // In name order, i < size().
+        auto name(std::size_t i) const -> std::string_view;
+        auto at(std::size_t i) const -> boiler::constants;
+        // O(log size()).
+        auto find(std::string_view unit_name) const -> std::optional<boiler::constants>;
+
+    private:
+        const std::byte* data = nullptr;
+        std::size_t bytes     = 0;
+        std::size_t count     = 0;
+    };
+
+    // Whether `path` starts like a compiled config.
+    auto is_compiled(const std::filesystem::path& path) -> bool;
+
+    // Reads and parses a text config.
+    auto read(const std::filesystem::path& path) -> fleet;
+
+    // The constants of `unit_name` (the defaults when it's empty) from a
+    // config in either format. Throws std::invalid_argument for unknown
+    // units, on top of what parse() and image throw.
+    auto load(const std::filesystem::path& path, std::string_view unit_name = {})
+        -> boiler::constants;
+}
@@ -1,19 +1,25 @@
 #pragma once
 
-#include <functional> // std::function and std::less.
-#include <string>
+#include <cstddef> // std::size_t.
+#include <optional>
 #include <vector>
-#include <map>
-#include <any>
+#include <array>
 
 #include "boiler/common.hpp"
+#include "boiler/command_mailbox.hpp"
+#include "boiler/expectation_pool.hpp"
+#include "boiler/link_monitor.hpp"
 #include "boiler/messages.hpp"
-
-#include "limbo/limbo.hpp" // limbo::type_name
+#include "boiler/message_ids.hpp"
+#include "boiler/outbound_scheduler.hpp"
+#include "boiler/policy.hpp"
+#include "boiler/pump_selection.hpp"
+#include "boiler/safety_signals.hpp"
+#include "boiler/watchdog.hpp"
 
 /// Summary:
 namespace boiler {
-    class control_unit
+    class alignas(64) control_unit
     {
     public:
         using mode           = messages::to_units::mode::possible_modes;
@@ -26,19 +32,76 @@ namespace boiler {
         auto process_messages(std::vector<msg_from_units> messages)
             -> std::vector<msg_to_units>;
 
-        // §1.15 exige que esse modo pode ser "setado" por fora.
-        auto emergency_stop() -> void;
+        // §1.15 exige que o modo emergency_stop possa ser "setado" por fora.
+        // Safe to use from other threads, see command_mailbox.
+        auto commands() noexcept -> command_mailbox& { return mailbox; }
+
+        // Which periodic messages arrived, and how often they go missing.
+        auto link() const noexcept -> const link_monitor& { return link_quality; }
+        // What process_messages held back to fit constants::link, and for
+        // how long.
+        auto outbound() const noexcept -> const outbound::scheduler& { return outbound_queue; }
+
+        // process_messages enters each of its phases on h, and leaves it in
+        // phase::idle; null to stop. The heartbeat belongs to the host, it
+        // isn't part of the snapshot.
+        auto watch(watchdog::heartbeat* h) noexcept -> void { beat = h; }
+
+        struct snapshot;
+        // Only valid between calls to process_messages (never from inside a
+        // handler). Restoring is how a hot standby takes over: restore the
+        // primary's latest snapshot every cycle and, once the primary fails,
+        // start calling process_messages on the standby instead. Both units
+        // must have been built with the same constants.
+        //
+        // Handlers are saved by id (see handler_id), so only the ones of
+        // control_unit itself can be: saving a unit that armed a derived
+        // class' member function is a bug, reported like a full pool.
+        auto save() const -> snapshot;
+        // s must be restorable().
+        auto restore(const snapshot& s) noexcept -> void;
+        // Whether every handler id of s is one of this build and its counts
+        // fit: what a snapshot that comes from outside the process (a file,
+        // a socket) must pass before it's restored.
+        static auto restorable(const snapshot& s) noexcept -> bool;
+
+        // Where the bytes of a unit go, to size a host for many of them.
+        struct memory_footprint
+        {
+            // sizeof(control_unit), the unit is aligned to a cache line.
+            std::size_t size;
+            // From the start of the unit to the end of what every cycle
+            // reads and writes.
+            std::size_t hot;
+            // Owned, outside of the unit.
+            std::size_t heap;
+        };
+        auto footprint() const noexcept -> memory_footprint;
 
     protected:
+        auto emergency_stop() -> void;
+        auto apply_command(operator_command cmd) -> void;
+
         auto init_routine() -> void;
         auto normal_routine() -> void;
         auto degraded_routine() -> void;
         auto rescue_routine() -> void;
         auto emergency_stop_routine() -> void;
         auto run_mode_routine() -> void;
+        // In normal, degraded or rescue mode.
+        auto operational() const -> bool;
 
         auto switch_mode(mode newmode) -> void;
 
+        // Handlers and their continuations are pointers to member functions
+        // instead of closures so that each can be named by an id and saved
+        // and restored with the rest of the state (see handler_id and
+        // snapshot). Derived classes can pass their own member functions
+        // too, static_cast'ed to these types, but a unit that has any of
+        // them armed can't be saved.
+        using deferred_fn = void (control_unit::*)();
+        using receipt_fn  = void (control_unit::*)(const msg_from_units&);
+
         struct msg_handler
         {
             enum class response
@@ -46,38 +109,244 @@ namespace boiler {
                 keep_listening,
                 unlisten
             };
-            std::function<response(void)> on_missing;
-            std::function<response(msg_from_units)> on_present;
+            using missing_fn = response (control_unit::*)();
+            using present_fn = response (control_unit::*)(const msg_from_units&);
+
+            // A null on_missing keeps listening.
+            missing_fn on_missing = nullptr;
+            // A null on_present calls on_receipt (if any) and unlistens,
+            // that's what eventually and until_ack use.
+            present_fn on_present = nullptr;
+            receipt_fn on_receipt = nullptr;
+            // Set by until_ack, sent again every cycle its ack is missing.
+            std::optional<msg_to_units> pending;
         };
 
+        // Enough for a pending failure ack per pump and per pump controller
+        // on top of the readings and the handshake.
+        static constexpr std::size_t max_expectations = 4 * boiler::max_pumps;
+        // Expectations are keyed by (id of the expected message, pump):
+        // every message id gets a flat row of slots, the first for any pump
+        // and then one per pump, so finding the expectations a message can
+        // satisfy is O(1). A pump past max_pumps has no slot (no_slot).
+        static constexpr std::size_t slots_per_message = boiler::max_pumps + 1;
+        static constexpr std::size_t no_slot           = ~std::size_t{ 0 };
+        static constexpr auto slot_of(
+            boiler::messages::msg_id id,
+            std::optional<ta::u8> n) -> std::size_t
+        {
+            if (!n) { return id * slots_per_message; }
+            if (*n >= boiler::max_pumps) { return no_slot; }
+            return id * slots_per_message + *n + 1u;
+        }
+        using expectations_t = expectation_pool<
+            msg_handler,
+            max_expectations,
+            boiler::messages::from_units::count * slots_per_message>;
+        // Lets an expectation be cancelled, see cancel().
+        using expectation_handle = expectations_t::handle;
+
+        // Any number of expectations for the same message can be armed at
+        // once. A message is given to all the always() handlers that match
+        // it, and to the oldest matching eventually() or until_ack(), the
+        // ones for its pump before the ones for any pump. until_ack() waits
+        // for the ack of the same pump (pump_failure_acknowledgement{ 2 }
+        // only acks pump_failure_detection{ 2 }), and doesn't compile for a
+        // message that has no ack. A message about a pump past max_pumps
+        // only matches the expectations for any pump; expecting one, or
+        // its ack, is a bug (std::out_of_range).
         template<typename Msg>
         [[nodiscard]] auto expect();
+        // Only for the messages about pump n.
+        template<typename Msg>
+        [[nodiscard]] auto expect(ta::u8 n);
 
+        // What send() returns, see below.
         template<typename Msg>
-        [[nodiscard]] auto send(Msg&&);
+        class sender;
+        template<typename Msg>
+        [[nodiscard]] auto send(Msg&&) -> sender<Msg>;
 
-        auto run_last(std::function<void(void)> func) -> void;
+        // O(1). Returns false if the expectation was already gone (received,
+        // unlistened or cancelled before).
+        auto cancel(expectation_handle h) -> bool;
+        // Whether anything is expecting Msg, for any pump or for pump n.
+        template<typename Msg>
+        auto expecting() const -> bool;
+        template<typename Msg>
+        auto expecting(ta::u8 n) const -> bool;
 
-        const boiler::constants constants;
+        auto run_last(deferred_fn func) -> void;
 
-        struct physical_units_readings {
-            std::vector<boiler::messages::to_program::pump_state::possible_states> pump_states;
-            std::vector<boiler::messages::to_program::pump_control_state::possible_states> pump_control_states;
+        // What snapshots keep instead of pointers to member functions, which
+        // are addresses in one process and meaningless in any other (another
+        // machine, or this one restarted). Each id indexes a constexpr table
+        // of the handlers (see handlers() in control_unit.cpp); new ones go
+        // last, the ids of checkpoints already written must keep meaning
+        // the same handler.
+        enum class handler_id : ta::u8
+        {
+            none,
+            on_pump_state,
+            on_pump_control_state,
+            on_level,
+            on_steam,
+            on_pump_repaired,
+            on_steam_boiler_waiting,
+            on_physical_units_ready,
+            check_initial_readings,
+            enter_operational_mode,
+            emergency_stop,
+        };
+        static constexpr std::size_t handler_count = 11;
+
+        // An armed expectation as a snapshot keeps it.
+        struct saved_expectation
+        {
+            ta::u16 slot;
+            handler_id on_missing;
+            handler_id on_present;
+            handler_id on_receipt;
+            std::optional<msg_to_units> pending;
+        };
+
+        struct physical_units_readings
+        {
+            std::array<
+                boiler::messages::to_program::pump_state::possible_states,
+                boiler::max_pumps>
+                pump_states;
+            std::array<
+                boiler::messages::to_program::pump_control_state::possible_states,
+                boiler::max_pumps>
+                pump_control_states;
             float level_liters;
             float steam_liters_per_sec;
-        } readings;
+        };
+
+        // What we currently believe to be broken.
+        struct failure_assumptions
+        {
+            bool pump_broken;
+            bool pump_control_broken;
+            bool steam_broken;
+            bool level_broken;
+            // Which pumps, bit n for pump n, when known.
+            boiler::pump_selection::pump_mask broken_pumps;
+            // The pumps opened or closed last cycle, and which of them
+            // were opened: their pump_state must agree this cycle, or the
+            // pump is assumed broken (see check_pump_states()).
+            boiler::pump_selection::pump_mask commanded_pumps;
+            boiler::pump_selection::pump_mask commanded_open;
+        };
+
+        // Keep the readings up to date, armed for the whole lifetime.
+        auto on_pump_state(const msg_from_units&) -> msg_handler::response;
+        auto on_pump_control_state(const msg_from_units&) -> msg_handler::response;
+        auto on_level(const msg_from_units&) -> msg_handler::response;
+        auto on_steam(const msg_from_units&) -> msg_handler::response;
+
+        // A pump that didn't do what it was told last cycle is broken: the
+        // units are told so until they acknowledge, and it's left out of
+        // the selection until they report it repaired.
+        auto check_pump_states() -> void;
+        auto note_pump_commands() -> void;
+        auto on_pump_repaired(const msg_from_units&) -> void;
+
+        // Steps of the initialization handshake (§1.11).
+        auto on_steam_boiler_waiting(const msg_from_units&) -> void;
+        auto check_initial_readings() -> void;
+        auto on_physical_units_ready(const msg_from_units&) -> void;
+        auto enter_operational_mode() -> void;
+
+    private:
+        struct handler_entry;
+        static auto handlers() -> const std::array<handler_entry, handler_count>&;
+        static auto id_of(deferred_fn f) -> handler_id;
+        static auto id_of(receipt_fn f) -> handler_id;
+        static auto id_of(msg_handler::missing_fn f) -> handler_id;
+        static auto id_of(msg_handler::present_fn f) -> handler_id;
+
+        auto arm(std::size_t slot, const msg_handler& handler) -> expectation_handle;
+        template<typename Msg>
+        auto expect_in(std::size_t slot);
+        auto handle_expected(std::vector<msg_from_units>&) -> void;
+        auto enter(watchdog::phase p) noexcept -> void
+        {
+            if (beat != nullptr) { beat->enter(p); }
+        }
+
+        // Every handler defers at most a couple of functions per cycle.
+        static constexpr std::size_t max_run_last = 2 * boiler::messages::from_units::count;
+        static_assert(max_run_last <= 0xff, "run_last_count is a ta::u8");
+        static_assert(max_expectations <= 0xff, "expectation_count is a ta::u8");
+
+        // The data members are laid out by how often a cycle touches them,
+        // for hosting many units side by side (see footprint()). Every
+        // cycle reads and writes the first two cache lines: the mode, the
+        // readings and the assumptions (with the vtable pointer), then the
+        // response and the policy.
+        mode mode_of_operation = mode::initialization;
+        // Whether switch_mode already ran the mode routine this cycle.
+        bool ran_mode_routine = false;
+        ta::u8 run_last_count = 0;
+
+    protected:
+        failure_assumptions assumptions{};
+        physical_units_readings readings{};
 
     private:
         std::vector<msg_to_units> response;
 
-        mode mode_of_operation;
+    protected:
+        const boiler::policy::normal_policy normal_policy;
 
-        // We need to explicitly use std::less to be able to key
-        // the map using string_views.
-        std::map<std::string, msg_handler, std::less<>> expected_handlers;
-        auto handle_expected(std::vector<msg_from_units>&) -> void;
+    private:
+        // Then what a cycle touches a few lines of: the heartbeat (on the
+        // line the expectations start on), the expectations for the
+        // messages that arrived, the link statistics, the outbound queues
+        // and the mailbox.
+        watchdog::heartbeat* beat = nullptr;
+        expectations_t expectations;
+        std::array<deferred_fn, max_run_last> run_last_handlers{};
+        link_monitor link_quality;
+        safety::signal_counters safety_counters;
+        outbound::scheduler outbound_queue;
+        command_mailbox mailbox;
 
-        std::vector<std::function<void(void)>> run_last_handlers;
+    protected:
+        // Last what only some modes or only the start read.
+        const boiler::constants constants;
+        // Only caches what it derives from the healthy pumps, so it isn't
+        // part of the snapshot.
+        boiler::pump_selection::table pump_selector;
+
+    public:
+        // Everything that changes from cycle to cycle, as a trivially
+        // copyable image with no pointers in it: it can be copied with
+        // memcpy, to a file or to another process.
+        struct snapshot
+        {
+            mode mode_of_operation;
+            physical_units_readings readings;
+            failure_assumptions assumptions;
+            link_monitor link_quality;
+            safety::signal_counters safety_counters;
+            outbound::scheduler outbound_queue;
+            std::array<handler_id, max_run_last> run_last_handlers;
+            ta::u8 run_last_count;
+            // The armed expectations (pending acks included), slot by slot
+            // and in the order they were armed within a slot. Only the first
+            // expectation_count are set; they go last so that the rest can be
+            // left out of a copy (see used_bytes()).
+            ta::u8 expectation_count;
+            std::array<saved_expectation, max_expectations> expectations;
+
+            // From the start of the snapshot to the end of its last
+            // expectation. The bytes past them don't matter: copied over
+            // any snapshot, these give back one that restores the same.
+            auto used_bytes() const noexcept -> std::size_t;
+        };
     };
 }
 
@@ -85,94 +354,113 @@ namespace boiler {
 template<typename Msg>
 auto boiler::control_unit::expect()
 {
+    return expect_in<Msg>(slot_of(boiler::messages::id_of<Msg>, std::nullopt));
+}
+
+template<typename Msg>
+auto boiler::control_unit::expect(ta::u8 n)
+{
+    static_assert(
+        limbo::is_detected_v<boiler::messages::detection_exprs::has_n_expr, Msg>,
+        "Only messages with an n are about a pump");
+    return expect_in<Msg>(slot_of(boiler::messages::id_of<Msg>, n));
+}
+
+template<typename Msg>
+auto boiler::control_unit::expect_in(std::size_t slot)
+{
+    static_assert(
+        boiler::messages::from_units::types::contains<boiler::utils::remove_cv_ref_t<Msg>>,
+        "Can only expect messages coming from the units");
+
     struct impl
     {
-        impl(control_unit& ctrl, std::string_view msgname)
+        impl(control_unit& ctrl, std::size_t slot)
             : ctrl{ ctrl }
-            , msgname{ msgname }
+            , slot{ slot }
         {}
 
-        auto eventually(std::function<void(msg_from_units)> on_receipt) &&
+        auto eventually(receipt_fn on_receipt) && -> expectation_handle
         {
-            ctrl.expected_handlers.erase(msgname);
-
-            auto wrapped_handler = msg_handler{
-                .on_missing = []() { return msg_handler::response::keep_listening; },
-                .on_present =
-                    [handler = std::move(on_receipt)](auto msg) {
-                        handler(msg);
-                        return msg_handler::response::unlisten;
-                    }
-            };
-
-            ctrl.expected_handlers.insert(
-                std::make_pair(std::move(msgname), std::move(wrapped_handler)));
+            return ctrl.arm(
+                slot,
+                msg_handler{
+                    .on_receipt = on_receipt,
+                    .pending    = std::nullopt,
+                });
         }
 
-        auto always(msg_handler handler) &&
+        auto always(msg_handler handler) && -> expectation_handle
         {
-            ctrl.expected_handlers.erase(msgname);
-            ctrl.expected_handlers.insert(
-                std::make_pair(std::move(msgname), std::move(handler)));
+            return ctrl.arm(slot, handler);
         }
 
     private:
         control_unit& ctrl;
-        std::string msgname;
+        std::size_t slot;
     };
 
-    return impl{ *this, limbo::type_name<boiler::utils::remove_cv_ref_t<Msg>>() };
+    return impl{ *this, slot };
 }
 
-#include <stdexcept> // std::domain_error.
-
 template<typename Msg>
-auto boiler::control_unit::send(Msg&& msg)
+auto boiler::control_unit::expecting() const -> bool
 {
-    struct impl
-    {
-        using msg_t = boiler::utils::remove_cv_ref_t<Msg>;
-        using ack_t = typename boiler::messages::acknowledgement_of<msg_t>::type;
+    constexpr auto first = slot_of(boiler::messages::id_of<Msg>, std::nullopt);
+    for (auto slot = first; slot < first + slots_per_message; ++slot) {
+        if (!expectations.empty(slot)) { return true; }
+    }
+    return false;
+}
 
-        impl(control_unit& ctrl, Msg&& msg)
-            : ctrl{ ctrl }
-            , msg{ std::forward<Msg>(msg) }
-        {}
+template<typename Msg>
+auto boiler::control_unit::expecting(ta::u8 n) const -> bool
+{
+    const auto slot = slot_of(boiler::messages::id_of<Msg>, n);
+    return slot != no_slot && !expectations.empty(slot);
+}
 
-        auto now() && -> void { ctrl.response.push_back(msg); }
+// A class template rather than a local class so that until_ack() is only
+// instantiated when used: it doesn't compile for messages with no ack.
+template<typename Msg>
+class boiler::control_unit::sender
+{
+public:
+    sender(control_unit& ctrl, Msg&& msg)
+        : ctrl{ ctrl }
+        , msg{ std::forward<Msg>(msg) }
+    {}
 
-        auto until_ack(std::function<void(msg_from_units)> on_ack) && -> void
-        {
-            if constexpr (std::is_same_v<ack_t, limbo::nonesuch>) {
-                throw std::domain_error{
-                    "message doesn't have a corresponding acknowledgement"
-                };
-            } else {
-
-                auto wrapped_handler = msg_handler{
-                    .on_missing =
-                        [msg = std::move(msg), ctrl = ctrl]() {
-                            ctrl.send(msg).now();
-                            return control_unit::msg_handler::response::keep_listening;
-                        },
-                    .on_present =
-                        [handler = std::move(on_ack)](auto m) {
-                            handler(m);
-                            return control_unit::msg_handler::response::unlisten;
-                        }
-                };
-
-                ctrl.send(msg).now();
-                ctrl.expect<ack_t>().always(std::move(wrapped_handler));
-            }
-        }
+    auto now() && -> void { ctrl.response.push_back(msg); }
 
-    private:
-        boiler::control_unit& ctrl;
-        Msg msg;
-    };
+    auto until_ack(receipt_fn on_ack) && -> expectation_handle
+    {
+        static_assert(
+            !std::is_same_v<ack_t, limbo::nonesuch>,
+            "message doesn't have a corresponding acknowledgement");
+        // Armed first: a message for a pump that doesn't exist isn't sent.
+        const auto h = ctrl.arm(
+            slot_of(boiler::messages::id_of<ack_t>, boiler::messages::pump_of(msg)),
+            msg_handler{
+                .on_receipt = on_ack,
+                .pending    = msg_to_units{ msg },
+            });
+        ctrl.response.push_back(msg);
+        return h;
+    }
+
+private:
+    using msg_t = boiler::utils::remove_cv_ref_t<Msg>;
+    using ack_t = typename boiler::messages::acknowledgement_of<msg_t>::type;
+
+    boiler::control_unit& ctrl;
+    Msg msg;
+};
 
-    return impl{
+template<typename Msg>
+auto boiler::control_unit::send(Msg&& msg) -> sender<Msg>
+{
+    return sender<Msg>{
         *this,
         std::forward<Msg>(msg),
     };
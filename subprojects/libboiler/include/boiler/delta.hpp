@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t, std::byte.
+#include <optional>
+#include <tuple> // std::tuple_size.
+#include <vector>
+
+#include "boiler/common.hpp"
+#include "boiler/message_ids.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+#include "boiler/wire.hpp"
+
+/// Summary:
+// Change-only transmission of the periodic messages: the readings the units
+// send every cycle (pump_state and pump_control_state for every pump,
+// level, steam) and the mode the program sends back.
+//
+// Every periodic message has a slot, per type and pump. The encoder leaves
+// out of a cycle the periodic messages whose value the other side already
+// has: the ones that haven't changed since a cycle it acknowledged. A
+// change is sent every cycle until a cycle carrying it is acknowledged, so
+// a lost datagram costs a resend, not a stale value. Until the first
+// acknowledgement, and every keyframe_interval cycles, everything is sent.
+//
+// The decoder puts back what was left out, from the last value received in
+// each slot, so the receiver sees full cycles. A cycle that doesn't arrive
+// at all stays missing, for link_monitor to notice. Keyframes are flagged
+// as such (see wire::keyframe): a slot a keyframe doesn't have is one the
+// sender stopped sending (a pump that went away), both sides forget it
+// instead of filling it in forever.
+namespace boiler::delta {
+    inline constexpr ta::u32 default_keyframe_interval = 64;
+
+    // The periodic messages of each direction.
+    template<typename Any>
+    struct periodic;
+    template<>
+    struct periodic<messages::to_program::any>
+    {
+        using types = limbo::type_list<
+            messages::to_program::pump_state,
+            messages::to_program::pump_control_state,
+            messages::to_program::level,
+            messages::to_program::steam>;
+        using all = messages::to_program::types;
+    };
+    template<>
+    struct periodic<messages::to_units::any>
+    {
+        using types = limbo::type_list<messages::to_units::mode>;
+        using all   = messages::to_units::types;
+    };
+
+    template<typename Any>
+    class encoder
+    {
+    public:
+        explicit encoder(ta::u32 interval = default_keyframe_interval)
+            : keyframe_interval{ interval == 0 ? 1 : interval }
+        {}
+
+        // Removes from `messages` what the other side already has. Cycles
+        // must increase: a cycle that doesn't is left whole and changes
+        // nothing, an acknowledgement of it would otherwise stand for
+        // another datagram too. Returns whether the cycle is a keyframe.
+        auto encode(ta::u32 cycle, std::vector<Any>& messages) -> bool;
+        // The other side received `cycle`.
+        auto acknowledge(ta::u32 cycle) -> void;
+
+        // Periodic messages left out so far.
+        auto suppressed() const -> ta::u64 { return left_out; }
+
+    private:
+        struct slot
+        {
+            std::array<std::byte, 8> bytes;
+            ta::u32 changed_at;
+            bool valid;
+        };
+
+        ta::u32 keyframe_interval;
+        std::optional<ta::u32> encoded;
+        std::optional<ta::u32> acked;
+        ta::u64 left_out = 0;
+        std::array<slot, 2 * max_pumps + 2> slots{};
+    };
+
+    template<typename Any>
+    class decoder
+    {
+    public:
+        // Completes the cycle in messages[first, end) with the periodic
+        // messages left out of it, unless it's a keyframe, which has all of
+        // them. A cycle older than the last one decoded arrived out of
+        // order: it's left as it is and doesn't update anything.
+        auto decode(
+            ta::u32 cycle,
+            std::vector<Any>& messages,
+            std::size_t first = 0,
+            bool keyframe     = false) -> void;
+
+    private:
+        struct slot
+        {
+            Any value;
+            bool valid;
+        };
+
+        std::optional<ta::u32> last_cycle;
+        std::array<slot, 2 * max_pumps + 2> slots{};
+    };
+}
+
+/// Implementation:
+namespace boiler::delta::detail {
+    inline constexpr std::size_t no_slot = ~std::size_t{ 0 };
+
+    // First slot of every message id, no_slot for the ones that aren't
+    // periodic. Messages with an n take max_pumps slots, the others one.
+    template<typename Any>
+    inline constexpr auto first_slots = [] {
+        using all      = typename periodic<Any>::all;
+        auto table     = std::array<std::size_t, all::size>{};
+        auto next_slot = std::size_t{ 0 };
+        for (auto& s : table) { s = no_slot; }
+        [&]<typename... Msgs>(limbo::type_list<Msgs...>) {
+            (
+                [&] {
+                    table[messages::id_of<Msgs>] = next_slot;
+                    next_slot += limbo::is_detected_v<messages::detection_exprs::has_n_expr, Msgs>
+                                     ? max_pumps
+                                     : 1;
+                }(),
+                ...);
+        }(typename periodic<Any>::types{});
+        return table;
+    }();
+
+    template<typename Any>
+    constexpr auto slot_of(const Any& msg) -> std::size_t
+    {
+        const auto first = first_slots<Any>[msg.index()];
+        if (first == no_slot) { return no_slot; }
+        const auto n = messages::pump_of_msg(msg).value_or(0);
+        return n < max_pumps ? first + n : no_slot;
+    }
+}
+
+template<typename Any>
+auto boiler::delta::encoder<Any>::encode(ta::u32 cycle, std::vector<Any>& messages) -> bool
+{
+    if (encoded && cycle <= *encoded) { return false; }
+    encoded = cycle;
+    const auto keyframe = !acked || cycle % keyframe_interval == 0;
+
+    auto present = std::array<bool, std::tuple_size_v<decltype(slots)>>{};
+    auto kept    = std::size_t{ 0 };
+    for (auto& msg : messages) {
+        const auto s = detail::slot_of(msg);
+        if (s != detail::no_slot) {
+            present[s] = true;
+            auto bytes = std::array<std::byte, 8>{};
+            wire::encode(bytes.data(), bytes.data() + bytes.size(), msg);
+
+            auto& current = slots[s];
+            if (!current.valid || bytes != current.bytes) {
+                current = { bytes, cycle, true };
+            } else if (!keyframe && current.changed_at <= *acked) {
+                ++left_out;
+                continue;
+            }
+        }
+        messages[kept++] = msg;
+    }
+    messages.resize(kept);
+
+    // What the decoder forgets on this keyframe is sent again in full when
+    // it comes back.
+    if (keyframe) {
+        for (auto s = std::size_t{ 0 }; s < slots.size(); ++s) {
+            if (!present[s]) { slots[s].valid = false; }
+        }
+    }
+    return keyframe;
+}
+
+template<typename Any>
+auto boiler::delta::encoder<Any>::acknowledge(ta::u32 cycle) -> void
+{
+    if (!acked || cycle > *acked) { acked = cycle; }
+}
+
+template<typename Any>
+auto boiler::delta::decoder<Any>::decode(
+    ta::u32 cycle,
+    std::vector<Any>& messages,
+    std::size_t first,
+    bool keyframe) -> void
+{
+    if (last_cycle && cycle <= *last_cycle) { return; }
+    last_cycle = cycle;
+
+    auto present = std::array<bool, std::tuple_size_v<decltype(slots)>>{};
+    for (auto i = first; i < messages.size(); ++i) {
+        const auto s = detail::slot_of(messages[i]);
+        if (s == detail::no_slot) { continue; }
+        slots[s]   = { messages[i], true };
+        present[s] = true;
+    }
+    for (auto s = std::size_t{ 0 }; s < slots.size(); ++s) {
+        if (!slots[s].valid || present[s]) { continue; }
+        if (keyframe) {
+            slots[s].valid = false;
+        } else {
+            messages.push_back(slots[s].value);
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <bit>     // std::countr_zero.
+#include <cstddef> // std::size_t.
+#include <optional>
+
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+namespace boiler {
+    // Fixed-capacity storage for the expectations of a control_unit. Every
+    // value is filed under a key (the id of the message it expects) and any
+    // number of values can share a key; each key keeps its values in a
+    // doubly linked list, in the order they were inserted.
+    //
+    // Nodes come from a free list inside the pool, so inserting and erasing
+    // never allocate and erasing through a handle is O(1). Handles carry the
+    // generation of the node they point to, which changes every time the
+    // node is freed, so a stale handle (one whose value has been erased, even
+    // if the node has been reused since) is detected instead of erasing
+    // someone else's value.
+    //
+    // The pool is plain data and is trivially copyable when T is.
+    template<typename T, std::size_t Capacity, std::size_t Keys>
+    class expectation_pool
+    {
+    public:
+        using index_t = ta::u16;
+        static_assert(Capacity < 0xffff, "Node indices are ta::u16");
+
+        struct handle
+        {
+            index_t index      = none;
+            ta::u16 generation = 0;
+
+            friend constexpr auto operator==(handle a, handle b) -> bool
+            {
+                return a.index == b.index && a.generation == b.generation;
+            }
+        };
+
+        static constexpr std::size_t capacity = Capacity;
+        static constexpr std::size_t keys     = Keys;
+
+        constexpr expectation_pool();
+
+        // O(1). nullopt when every node is in use.
+        constexpr auto insert(std::size_t key, const T& value) -> std::optional<handle>;
+        // O(1). Returns false for stale handles.
+        constexpr auto erase(handle h) -> bool;
+
+        constexpr auto alive(handle h) const -> bool;
+        // nullptr for stale handles.
+        constexpr auto get(handle h) -> T*;
+
+        constexpr auto empty(std::size_t key) const -> bool { return heads[key] == none; }
+        constexpr auto size() const -> std::size_t { return used; }
+        // The first key from `from` on with values, `Keys` if none. Looks at
+        // a bit per key, so visiting the keys in use doesn't read them all.
+        constexpr auto next_key(std::size_t from) const -> std::size_t;
+
+        // Calls f(handle, T&) for the values filed under `key` that were
+        // inserted before stamp() returned `up_to`, in insertion order. f may
+        // erase values and insert new ones (which it won't be called for).
+        template<typename F>
+        constexpr auto for_each(std::size_t key, ta::u32 up_to, F&& f) -> void;
+
+        // Calls f(key, const T&) for every value, key by key and in
+        // insertion order within a key.
+        template<typename F>
+        constexpr auto for_each_value(F&& f) const -> void;
+
+        // Increases with every insertion.
+        constexpr auto stamp() const -> ta::u32 { return insertions; }
+
+    private:
+        static constexpr index_t none = 0xffff;
+
+        struct node
+        {
+            T value;
+            index_t prev;
+            index_t next;
+            ta::u16 generation;
+            ta::u16 key;
+            ta::u32 inserted; // Value of insertions when inserted.
+            bool live;
+        };
+
+        static constexpr std::size_t words = (Keys + 63) / 64;
+
+        // The bookkeeping first, the nodes (most of the bytes) last.
+        // Free nodes are chained through next.
+        index_t free_head;
+        std::size_t used = 0;
+        ta::u32 insertions = 0;
+        // Bit key % 64 of word key / 64 for every key with values.
+        std::array<ta::u64, words> in_use{};
+        std::array<index_t, Keys> heads;
+        std::array<index_t, Keys> tails;
+        std::array<node, Capacity> nodes{};
+    };
+}
+
+/// Implementation:
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr boiler::expectation_pool<T, Capacity, Keys>::expectation_pool()
+    : free_head{ Capacity == 0 ? none : index_t{ 0 } }
+{
+    heads.fill(none);
+    tails.fill(none);
+    for (auto i = std::size_t{ 0 }; i < Capacity; ++i) {
+        nodes[i].next       = static_cast<index_t>(i + 1 < Capacity ? i + 1 : none);
+        nodes[i].generation = 1;
+    }
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::insert(std::size_t key, const T& value)
+    -> std::optional<handle>
+{
+    if (free_head == none) { return std::nullopt; }
+
+    const auto i = free_head;
+    auto& n      = nodes[i];
+    free_head    = n.next;
+
+    n.value    = value;
+    n.key      = static_cast<ta::u16>(key);
+    n.live     = true;
+    n.inserted = insertions++;
+    n.next     = none;
+    n.prev     = tails[key];
+    if (tails[key] == none) {
+        heads[key] = i;
+        in_use[key / 64] |= ta::u64{ 1 } << (key % 64);
+    } else {
+        nodes[tails[key]].next = i;
+    }
+    tails[key] = i;
+    ++used;
+
+    return handle{ i, n.generation };
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::alive(handle h) const -> bool
+{
+    return h.index < Capacity && nodes[h.index].live && nodes[h.index].generation == h.generation;
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::get(handle h) -> T*
+{
+    return alive(h) ? &nodes[h.index].value : nullptr;
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::erase(handle h) -> bool
+{
+    if (!alive(h)) { return false; }
+
+    auto& n = nodes[h.index];
+    if (n.prev == none) {
+        heads[n.key] = n.next;
+    } else {
+        nodes[n.prev].next = n.next;
+    }
+    if (n.next == none) {
+        tails[n.key] = n.prev;
+    } else {
+        nodes[n.next].prev = n.prev;
+    }
+    if (heads[n.key] == none) { in_use[n.key / 64] &= ~(ta::u64{ 1 } << (n.key % 64)); }
+
+    n.live = false;
+    // Skips 0 so that a default handle is never alive.
+    n.generation = static_cast<ta::u16>(n.generation == 0xffff ? 1 : n.generation + 1);
+    n.next       = free_head;
+    free_head    = h.index;
+    --used;
+    return true;
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::next_key(std::size_t from) const
+    -> std::size_t
+{
+    for (auto w = from / 64; w < words; ++w) {
+        // The bits below `from` in its own word don't count.
+        const auto bits = w == from / 64 ? in_use[w] & (~ta::u64{ 0 } << (from % 64)) : in_use[w];
+        if (bits != 0) {
+            return w * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+        }
+    }
+    return Keys;
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+template<typename F>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::for_each(
+    std::size_t key,
+    ta::u32 up_to,
+    F&& f) -> void
+{
+    if (heads[key] == none) { return; }
+
+    // Collected first so that f can erase anything, the values not visited
+    // yet included. Values are in insertion order, so once one is past the
+    // cutoff so is everything after it.
+    auto pending = std::array<handle, Capacity>{};
+    auto count   = std::size_t{ 0 };
+    for (auto i = heads[key]; i != none && nodes[i].inserted < up_to; i = nodes[i].next) {
+        pending[count++] = handle{ i, nodes[i].generation };
+    }
+
+    for (auto k = std::size_t{ 0 }; k < count; ++k) {
+        if (alive(pending[k])) { f(pending[k], nodes[pending[k].index].value); }
+    }
+}
+
+template<typename T, std::size_t Capacity, std::size_t Keys>
+template<typename F>
+constexpr auto boiler::expectation_pool<T, Capacity, Keys>::for_each_value(F&& f) const -> void
+{
+    for (auto key = next_key(0); key < Keys; key = next_key(key + 1)) {
+        for (auto i = heads[key]; i != none; i = nodes[i].next) { f(key, nodes[i].value); }
+    }
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef> // std::size_t.
+#include <functional>
+#include <memory> // std::unique_ptr.
+#include <vector>
+
+#include <sys/types.h> // pid_t.
+
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Many boilers controlled from worker processes, so that a control unit that
+// crashes only takes down its worker's shard, for a cycle at most.
+//
+// The coordinator forks the workers and owns the fleet's state: which
+// worker runs which boiler, what a cycle of each boiler costs, and the
+// snapshot (see control_unit::snapshot) each boiler had at the end of the
+// last cycle. Every cycle, step() sends each worker the messages of its
+// boilers and gets back, per boiler, what it sent, what changed in its
+// snapshot and how long process_messages took. The boilers of a worker that
+// dies, or misses the deadline and is killed, run the same cycle again from
+// their snapshots, each in a probe of its own (a worker of one boiler), all
+// at once and within one more deadline, so step() still answers for every
+// boiler in at most two deadlines. A boiler whose probe fails too takes
+// down any worker that runs it: it's quarantined (it gets no answer until
+// readmit()). The worker is then replaced by one that runs the rest of its
+// shard. Every `rebalance_interval` cycles boilers move from the busiest
+// workers to the idlest ones by their measured costs.
+//
+// Workers talk to the coordinator over a stream socket, in frames of
+//
+//     u32 size | u8 kind | payload
+//
+// with the messages of a boiler in the wire format (see wire.hpp), so
+// serve() can run on another machine behind a TCP connection; forked
+// workers on Unix domain sockets are the local stand-in. A worker adopts a
+// boiler with the whole of its snapshot, and then answers every cycle with
+// the runs of bytes that changed since the snapshot it sent last, a few
+// dozen for a quiet cycle. Snapshots are images of control_unit::snapshot,
+// with handler ids rather than addresses in them: both ends need the same
+// build of libboiler and the same byte order, not the same load address.
+//
+// step() forks too, to replace a worker: the coordinator's process should
+// be single threaded, or at least not hold locks a worker would need.
+namespace boiler::fleet {
+    using boiler_id = ta::u32;
+
+    // Where a boiler's worker would be once it's quarantined, see owner().
+    inline constexpr std::size_t quarantine = ~std::size_t{ 0 };
+
+    // What a worker runs a boiler on. Units of a derived class must only
+    // arm control_unit's own handlers, or they can't be saved (see
+    // control_unit::save()).
+    using unit_factory =
+        std::function<std::unique_ptr<control_unit>(boiler_id, const boiler::constants&)>;
+
+    struct options
+    {
+        std::size_t workers = 2;
+        // For a worker to answer a cycle, after which it's killed and its
+        // boilers run the cycle again in probes, which have as long.
+        std::chrono::milliseconds deadline = std::chrono::seconds{ 1 };
+        // Cycles between rebalances, 0 for never.
+        ta::u32 rebalance_interval = 16;
+        // Boilers move once the busiest worker is that much over the mean.
+        float imbalance = 0.25f;
+        // A plain control_unit when empty.
+        unit_factory make_unit;
+    };
+
+    struct fleet_stats
+    {
+        ta::u64 cycles;
+        // Workers replaced after dying or missing the deadline.
+        ta::u64 restarts;
+        // Boilers moved to another worker by rebalancing.
+        ta::u64 moved;
+        // Boiler cycles with no answer: the boiler was quarantined.
+        ta::u64 lost;
+        // Boilers found to take down any worker that runs them.
+        ta::u64 quarantined;
+    };
+
+    struct move
+    {
+        boiler_id boiler;
+        std::size_t from;
+        std::size_t to;
+    };
+
+    // Which boilers to move so that no worker's load (the sum of the costs
+    // of its boilers) is over the mean by more than `imbalance`, or as
+    // close to it as moving whole boilers gets. Greedy: moves from the
+    // busiest worker to the idlest the boiler that best evens them out.
+    // Quarantined boilers stay where they are.
+    auto plan_moves(
+        const std::vector<float>& costs,
+        const std::vector<std::size_t>& owners,
+        std::size_t workers,
+        float imbalance) -> std::vector<move>;
+
+    // The worker side, on a connected stream socket: runs the boilers the
+    // coordinator hands over until the socket is closed. Returns 0 then, 2
+    // for a frame it doesn't understand.
+    auto serve(int fd, const boiler::constants& c, const unit_factory& make_unit = {}) -> int;
+
+    class coordinator
+    {
+    public:
+        using inputs  = std::vector<std::vector<messages::to_program::any>>;
+        using outputs = std::vector<std::vector<messages::to_units::any>>;
+
+        // Boilers are numbered [0, boilers) and start spread evenly, all
+        // with the same constants. Throws std::system_error when a worker
+        // can't be started.
+        coordinator(const boiler::constants& c, std::size_t boilers, options o = {});
+        // Closes the sockets, the workers exit, and waits for them: for
+        // the deadline at most, then the ones left (stopped, or stuck in a
+        // cycle) are killed.
+        ~coordinator();
+
+        coordinator(const coordinator&) = delete;
+        auto operator=(const coordinator&) -> coordinator& = delete;
+
+        // One cycle of every boiler: in[b] goes to boiler b, and the result
+        // holds what each boiler sent. Takes up to twice the deadline when a
+        // worker fails. Throws std::invalid_argument when in
+        // doesn't have a vector per boiler, or one is too long for a
+        // datagram.
+        auto step(const inputs& in) -> outputs;
+        // Moves boilers between workers now, see plan_moves.
+        auto rebalance() -> void;
+        // Gives a quarantined boiler to a worker again, from its snapshot
+        // of before the cycle it was quarantined in.
+        auto readmit(boiler_id b) -> void;
+
+        auto boilers() const -> std::size_t { return owners.size(); }
+        auto workers() const -> std::size_t { return pool.size(); }
+        // fleet::quarantine once quarantined.
+        auto owner(boiler_id b) const -> std::size_t { return owners[b]; }
+        auto worker_pid(std::size_t w) const -> pid_t { return pool[w].pid; }
+        // Of a cycle of boiler b in nanoseconds, a moving average.
+        auto cost(boiler_id b) const -> float { return costs[b]; }
+        auto stats() const -> const fleet_stats& { return counters; }
+
+    private:
+        struct worker
+        {
+            pid_t pid = -1;
+            int fd    = -1;
+        };
+
+        // The boilers of worker w.
+        auto shard(std::size_t w) const -> std::vector<boiler_id>;
+        // Forks a worker that adopts `boilers` from their snapshots.
+        auto spawn(const std::vector<boiler_id>& boilers) -> worker;
+        // Kills and waits for a worker.
+        auto reap(worker& w) -> void;
+        auto adopt(const worker& w, boiler_id b) -> bool;
+        // Sends w the part of `in` of `boilers`, false if it can't.
+        auto send_cycle(const worker& w, const std::vector<boiler_id>& boilers, const inputs& in)
+            -> bool;
+        // Commits w's answer, for boilers of pool[owner], to `out`. False if
+        // there is none.
+        auto receive_cycle(
+            const worker& w,
+            std::size_t owner,
+            std::chrono::steady_clock::time_point deadline,
+            outputs& out) -> bool;
+        // Runs the cycle of the boilers of the `failed` workers in probes,
+        // quarantines the ones whose probe fails and replaces the workers.
+        auto recover(const std::vector<std::size_t>& failed, const inputs& in, outputs& out)
+            -> void;
+
+        boiler::constants constants;
+        options opts;
+        std::vector<worker> pool;
+        // Only while recover() runs.
+        std::vector<worker> probes;
+        std::vector<std::size_t> owners;
+        std::vector<float> costs;
+        std::vector<control_unit::snapshot> snapshots;
+        fleet_stats counters{};
+        ta::u32 cycle = 0;
+    };
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t.
+#include <vector>
+
+#include "boiler/common.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+namespace boiler {
+    // Keeps track of which of the messages the units must send every cycle
+    // (§2.1) arrived, to detect transmission failures and to report link
+    // quality.
+    //
+    // observe() is O(messages) and every query is O(1): arrivals go into a
+    // fixed bitmap per message type (one bit per pump), and each expected
+    // (type, pump) slot keeps its last `window` cycles as a bit history, so
+    // the loss counters slide by adding the newest bit and dropping the
+    // oldest. The whole state is plain data.
+    class link_monitor
+    {
+    public:
+        enum class periodic : ta::u8
+        {
+            pump_state,
+            pump_control_state,
+            level,
+            steam,
+        };
+        static constexpr std::size_t periodic_count = 4;
+
+        // Cycles the sliding loss counters cover, one bit of history each.
+        static constexpr std::size_t window = 64;
+
+        struct stats
+        {
+            ta::u64 expected; // Since the start.
+            ta::u64 missing;  // Since the start.
+            // Over the last min(window, cycles observed) cycles.
+            ta::u32 expected_in_window;
+            ta::u32 missing_in_window;
+        };
+
+        // Expects nothing, only there to be assigned to.
+        link_monitor() = default;
+        explicit link_monitor(ta::u8 pump_count);
+
+        // Call once per cycle, with everything the units sent.
+        auto observe(const std::vector<messages::from_units::any>& messages) -> void;
+
+        // About the last observed cycle.
+        auto arrived(periodic type, ta::u8 n = 0) const -> bool;
+        // Every expected message arrived.
+        auto complete() const -> bool { return missing_last_cycle == 0; }
+        // Not a single periodic message arrived.
+        auto silent() const -> bool { return arrived_last_cycle == 0; }
+
+        auto of(periodic type) const -> stats { return counters[index(type)]; }
+        // Fraction of the expected messages of `type` lost in the window.
+        auto loss_rate(periodic type) const -> float;
+        auto cycles() const -> ta::u64 { return observed_cycles; }
+        // Cycles in a row with something missing, 0 if the last one was
+        // complete.
+        auto incomplete_streak() const -> ta::u32 { return incomplete_cycles; }
+
+    private:
+        static constexpr auto index(periodic type) -> std::size_t
+        {
+            return static_cast<std::size_t>(type);
+        }
+        // Slots of a type: one per pump, or just one for level and steam.
+        auto slots_of(periodic type) const -> std::size_t;
+
+        ta::u8 pump_count = 0;
+
+        // This cycle, one bit per pump (bit 0 for level and steam).
+        std::array<ta::u16, periodic_count> arrivals{};
+        // Per slot, bit i set when the message was missing i cycles ago.
+        std::array<std::array<ta::u64, max_pumps>, periodic_count> history{};
+        std::array<stats, periodic_count> counters{};
+
+        ta::u64 observed_cycles   = 0;
+        ta::u32 arrived_last_cycle = 0;
+        ta::u32 missing_last_cycle = 0;
+        ta::u32 incomplete_cycles  = 0;
+    };
+}
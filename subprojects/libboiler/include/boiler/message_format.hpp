@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <charconv> // std::to_chars.
+#include <cstddef>  // std::size_t.
+#include <cstring>  // std::memcpy.
+#include <string_view>
+#include <system_error> // std::errc.
+
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+#include "boiler/utils.hpp"
+
+#include "limbo/limbo.hpp" // limbo::type_name, limbo::is_detected_v.
+
+/// Summary:
+// Renders messages in exactly the same text as their operator<<, but
+// straight into a caller supplied buffer, without iostreams or allocations.
+// Like std::to_chars, on success returns {end of the output, std::errc{}}
+// and on overflow {last, std::errc::value_too_large} with the contents of
+// [first, last) unspecified.
+namespace boiler::messages {
+    template<
+        typename Msg,
+        typename = std::enable_if_t<
+            to_program::types::contains<boiler::utils::remove_cv_ref_t<Msg>> ||
+            to_units::types::contains<boiler::utils::remove_cv_ref_t<Msg>>>>
+    auto format_to(char* first, char* last, const Msg& msg) -> std::to_chars_result;
+
+    auto format_to(char* first, char* last, const to_units::any& msg)
+        -> std::to_chars_result;
+    auto format_to(char* first, char* last, const to_program::any& msg)
+        -> std::to_chars_result;
+
+    // Enough room for any message.
+    inline constexpr std::size_t max_formatted_size = 256;
+
+    // The names operator<< uses for enums, indexed by value.
+    inline constexpr std::string_view mode_names[] = {
+        "initialization", "normal", "degraded", "rescue", "emergency_stop",
+    };
+    inline constexpr std::string_view pump_state_names[]         = { "closed", "open" };
+    inline constexpr std::string_view pump_control_state_names[] = { "not_flowing",
+                                                                     "flowing" };
+}
+
+/// Implementation:
+namespace boiler::messages::detail {
+    // Everything about the text of a message that's known at compile time.
+    template<typename Msg>
+    struct text_layout
+    {
+        static constexpr bool has_n =
+            limbo::is_detected_v<detection_exprs::has_n_expr, Msg>;
+        static constexpr bool has_m =
+            limbo::is_detected_v<detection_exprs::has_m_expr, Msg>;
+        static constexpr bool has_state =
+            limbo::is_detected_v<detection_exprs::has_state_expr, Msg>;
+        static constexpr bool has_liters =
+            limbo::is_detected_v<detection_exprs::has_liters_expr, Msg>;
+        static constexpr bool has_liters_per_sec =
+            limbo::is_detected_v<detection_exprs::has_liters_per_sec_expr, Msg>;
+
+        // "<name>{", copied in one go.
+        static constexpr auto prefix = [] {
+            constexpr auto name = limbo::type_name<Msg>();
+            auto result         = std::array<char, name.size() + 1>{};
+            for (auto i = std::size_t{ 0 }; i < name.size(); ++i) { result[i] = name[i]; }
+            result[name.size()] = '{';
+            return result;
+        }();
+    };
+
+    // Appends to [first, last), returns nullptr on overflow.
+    inline auto append(char* first, char* last, std::string_view text) -> char*
+    {
+        if (first == nullptr || static_cast<std::size_t>(last - first) < text.size()) {
+            return nullptr;
+        }
+        std::memcpy(first, text.data(), text.size());
+        return first + text.size();
+    }
+
+    template<typename Number>
+    auto append_number(char* first, char* last, Number value) -> char*
+    {
+        if (first == nullptr) { return nullptr; }
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<Number>) {
+            // Same as an ostream with its default flags and precision.
+            result = std::to_chars(first, last, value, std::chars_format::general, 6);
+        } else {
+            result = std::to_chars(first, last, value);
+        }
+        return result.ec == std::errc{} ? result.ptr : nullptr;
+    }
+
+    template<typename Enum, std::size_t N>
+    auto append_enum(char* first, char* last, Enum value, const std::string_view (&names)[N])
+        -> char*
+    {
+        return append(first, last, names[static_cast<std::size_t>(value)]);
+    }
+}
+
+template<typename Msg, typename>
+auto boiler::messages::format_to(char* first, char* last, const Msg& msg)
+    -> std::to_chars_result
+{
+    using layout = detail::text_layout<boiler::utils::remove_cv_ref_t<Msg>>;
+
+    auto out = detail::append(
+        first, last, std::string_view{ layout::prefix.data(), layout::prefix.size() });
+
+    // Members are printed in a fixed order, separated by ", ".
+    [[maybe_unused]] auto separate = false;
+    [[maybe_unused]] const auto member = [&](std::string_view label) {
+        if (separate) { out = detail::append(out, last, ", "); }
+        separate = true;
+        out      = detail::append(out, last, label);
+    };
+
+    if constexpr (layout::has_n) {
+        member("n: ");
+        out = detail::append_number(out, last, ta::u16{ msg.n });
+    }
+    if constexpr (layout::has_m) {
+        member("m: ");
+        out = detail::append_enum(out, last, msg.m, mode_names);
+    }
+    if constexpr (layout::has_state) {
+        member("state: ");
+        using state_t = boiler::utils::remove_cv_ref_t<decltype(msg.state)>;
+        if constexpr (std::is_same_v<state_t, to_program::pump_state::possible_states>) {
+            out = detail::append_enum(out, last, msg.state, pump_state_names);
+        } else {
+            out = detail::append_enum(out, last, msg.state, pump_control_state_names);
+        }
+    }
+    if constexpr (layout::has_liters) {
+        member("liters: ");
+        out = detail::append_number(out, last, msg.liters);
+    }
+    if constexpr (layout::has_liters_per_sec) {
+        member("liters_per_sec: ");
+        out = detail::append_number(out, last, msg.liters_per_sec);
+    }
+
+    out = detail::append(out, last, "}");
+
+    if (out == nullptr) { return { last, std::errc::value_too_large }; }
+    return { out, std::errc{} };
+}
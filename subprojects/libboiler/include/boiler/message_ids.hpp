@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+#include "boiler/utils.hpp"
+
+#include "limbo/limbo.hpp" // limbo::type_name.
+
+/// Summary:
+// Compile-time ids for every message. A message's id is its position in
+// the type list of its direction (to_units::types or to_program::types),
+// which is also the index of its alternative in the matching ::any
+// variant, so getting the id of a runtime message is just ::index().
+// Ids from to_units and to_program overlap, the direction is always known
+// from context (which list/variant you're looking at).
+//
+// Since they only depend on the order of the type lists the ids are the same
+// on every compiler, so they are safe to use in logs and on the wire. New
+// messages must be appended to the end of their list to keep that property.
+namespace boiler::messages {
+    using msg_id = ta::u8;
+
+    // Exposes the type list a message belongs to as ::types.
+    template<typename Msg>
+    struct direction_of;
+
+    // Usage: id_of<to_program::level>.
+    template<typename Msg>
+    inline constexpr msg_id id_of = static_cast<msg_id>(
+        direction_of<utils::remove_cv_ref_t<Msg>>::types::template index_of<
+            utils::remove_cv_ref_t<Msg>>);
+
+    constexpr auto id_of_msg(const to_units::any& msg) -> msg_id;
+    constexpr auto id_of_msg(const to_program::any& msg) -> msg_id;
+
+    // Unqualified names ("level", not "boiler::messages::to_program::level"),
+    // which unlike limbo::type_name are the same on every compiler. The
+    // to_units::names and to_program::names tables are indexed by id and
+    // name_of<Msg> is the compile-time version.
+    constexpr auto name_of_msg(const to_units::any& msg) -> std::string_view;
+    constexpr auto name_of_msg(const to_program::any& msg) -> std::string_view;
+
+    // The pump (or pump controller) a message is about, nullopt for the
+    // messages without an n.
+    template<typename Msg>
+    constexpr auto pump_of(const Msg& msg) -> std::optional<ta::u8>;
+    constexpr auto pump_of_msg(const to_units::any& msg) -> std::optional<ta::u8>;
+    constexpr auto pump_of_msg(const to_program::any& msg) -> std::optional<ta::u8>;
+}
+
+/// Implementation:
+namespace boiler::messages {
+    namespace detail {
+        template<typename... Types>
+        struct list_of
+        {
+            using types = limbo::type_list<Types...>;
+        };
+
+        constexpr auto unqualified(std::string_view name) -> std::string_view
+        {
+            const auto last_colon = name.rfind(':');
+            if (last_colon != std::string_view::npos) {
+                name.remove_prefix(last_colon + 1);
+            }
+            return name;
+        }
+
+        template<typename... Types>
+        struct names_table
+        {
+            static constexpr std::array<std::string_view, sizeof...(Types)> value = {
+                unqualified(limbo::type_name<Types>())...
+            };
+        };
+    }
+
+    template<typename Msg>
+    struct direction_of
+        : std::conditional_t<
+              to_units::types::contains<Msg>,
+              to_units::types::recover_to<detail::list_of>,
+              to_program::types::recover_to<detail::list_of>>
+    {
+        static_assert(
+            to_units::types::contains<Msg> || to_program::types::contains<Msg>,
+            "Not a message type");
+    };
+
+    template<typename Msg>
+    inline constexpr std::string_view name_of =
+        detail::unqualified(limbo::type_name<utils::remove_cv_ref_t<Msg>>());
+
+    constexpr auto id_of_msg(const to_units::any& msg) -> msg_id
+    {
+        return static_cast<msg_id>(msg.index());
+    }
+    constexpr auto id_of_msg(const to_program::any& msg) -> msg_id
+    {
+        return static_cast<msg_id>(msg.index());
+    }
+}
+
+namespace boiler::messages::to_units {
+    inline constexpr auto count = types::size;
+    inline constexpr std::array<std::string_view, count> names =
+        types::recover_to<messages::detail::names_table>::value;
+    static_assert(count <= 256, "Ids must fit in a msg_id");
+}
+
+namespace boiler::messages::to_program {
+    inline constexpr auto count = types::size;
+    inline constexpr std::array<std::string_view, count> names =
+        types::recover_to<messages::detail::names_table>::value;
+    static_assert(count <= 256, "Ids must fit in a msg_id");
+}
+
+namespace boiler::messages {
+    constexpr auto name_of_msg(const to_units::any& msg) -> std::string_view
+    {
+        return to_units::names[msg.index()];
+    }
+    constexpr auto name_of_msg(const to_program::any& msg) -> std::string_view
+    {
+        return to_program::names[msg.index()];
+    }
+
+    template<typename Msg>
+    constexpr auto pump_of([[maybe_unused]] const Msg& msg) -> std::optional<ta::u8>
+    {
+        if constexpr (limbo::is_detected_v<detection_exprs::has_n_expr, Msg>) {
+            return msg.n;
+        } else {
+            return std::nullopt;
+        }
+    }
+    constexpr auto pump_of_msg(const to_units::any& msg) -> std::optional<ta::u8>
+    {
+        return std::visit([](const auto& m) { return pump_of(m); }, msg);
+    }
+    constexpr auto pump_of_msg(const to_program::any& msg) -> std::optional<ta::u8>
+    {
+        return std::visit([](const auto& m) { return pump_of(m); }, msg);
+    }
+
+    static_assert(id_of<to_units::mode> == 0, "Ids are positions in the type list");
+    static_assert(id_of<to_program::stop> == 0, "Ids are positions in the type list");
+    static_assert(name_of<to_program::level> == "level");
+}
@@ -282,7 +282,7 @@ namespace boiler::messages {
         };
 
         // Actual printing starts here.
-        os << limbo::type_name<MsgType>() << '{';
+        os << limbo::type_name<boiler::utils::remove_cv_ref_t<MsgType>>() << '{';
 
         if constexpr (has_member[(u32)members::n]) {
             os << "n: " << u16{ msg.n };
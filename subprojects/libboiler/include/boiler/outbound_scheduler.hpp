@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t.
+#include <type_traits>
+#include <utility> // std::index_sequence.
+#include <vector>
+
+#include "boiler/common.hpp"
+#include "boiler/message_ids.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Decides what control_unit actually sends each cycle when the link to the
+// units can only take so much (constants::link).
+//
+// Every message belongs to a priority class derived from its type. Each
+// cycle the messages are sent class by class, most important first and in
+// the order they were produced within a class, until the budget runs out.
+// Whatever doesn't fit is carried over to the next cycle. Except for
+// actuation, where the order of the commands matters, a message that is
+// already waiting for the same type and pump is replaced by the newer one
+// and keeps its place, so retransmissions and mode updates don't pile up.
+// A pump command is only dropped when it repeats the last one waiting for
+// its pump.
+// Safety messages are always sent, whatever the budget.
+namespace boiler::outbound {
+    enum class priority : ta::u8
+    {
+        safety,        // mode, which carries emergency_stop.
+        actuation,     // valve, open_pump, close_pump.
+        acks,          // Everything sent until acknowledged, and the acks.
+        informational, // Anything else.
+    };
+    inline constexpr std::size_t priority_count = 4;
+
+    template<typename Msg>
+    inline constexpr priority priority_of = [] {
+        namespace to_units = boiler::messages::to_units;
+        using msg_t        = boiler::utils::remove_cv_ref_t<Msg>;
+
+        if constexpr (std::is_same_v<msg_t, to_units::mode>) {
+            return priority::safety;
+        } else if constexpr (
+            std::is_same_v<msg_t, to_units::valve> || std::is_same_v<msg_t, to_units::open_pump> ||
+            std::is_same_v<msg_t, to_units::close_pump>) {
+            return priority::actuation;
+        } else if constexpr (
+            !std::is_same_v<
+                typename boiler::messages::acknowledgement_of<msg_t>::type,
+                limbo::nonesuch> ||
+            std::is_same_v<msg_t, to_units::pump_repaired_acknowledgement> ||
+            std::is_same_v<msg_t, to_units::pump_control_repaired_acknowledgement> ||
+            std::is_same_v<msg_t, to_units::level_repaired_acknowledgement> ||
+            std::is_same_v<msg_t, to_units::steam_repaired_acknowledgement>) {
+            return priority::acks;
+        } else {
+            return priority::informational;
+        }
+    }();
+
+    // What a message takes on the link: its id and its payload.
+    template<typename Msg>
+    inline constexpr std::size_t size_of =
+        1 + (std::is_empty_v<boiler::utils::remove_cv_ref_t<Msg>>
+                 ? 0
+                 : sizeof(boiler::utils::remove_cv_ref_t<Msg>));
+
+    // Both indexed by id.
+    inline constexpr auto priorities = []<typename... Types>(limbo::type_list<Types...>) {
+        return std::array<priority, sizeof...(Types)>{ priority_of<Types>... };
+    }(boiler::messages::to_units::types{});
+    inline constexpr auto sizes = []<typename... Types>(limbo::type_list<Types...>) {
+        return std::array<std::size_t, sizeof...(Types)>{ size_of<Types>... };
+    }(boiler::messages::to_units::types{});
+
+    struct class_stats
+    {
+        ta::u64 sent;
+        // Messages that had to wait at least a cycle, counted once.
+        ta::u64 deferred;
+        // Messages replaced by a newer one for the same type and pump, and
+        // pump commands dropped as repeats.
+        ta::u64 coalesced;
+        // Messages that found their class' queue full.
+        ta::u64 dropped;
+        // In cycles, over the messages sent.
+        ta::u64 total_delay;
+        ta::u64 max_delay;
+    };
+
+    class scheduler
+    {
+    public:
+        using msg_to_units = boiler::messages::to_units::any;
+
+        // Messages each class can have waiting.
+        static constexpr std::size_t queue_capacity = 64;
+
+        scheduler() = default;
+        explicit scheduler(boiler::constants::link_budget budget);
+
+        // Queues this cycle's messages (in the order they were produced)
+        // and replaces `out` with what goes on the link this cycle.
+        auto schedule(std::vector<msg_to_units>& out) -> void;
+
+        auto stats(priority p) const -> const class_stats&
+        {
+            return class_stats_of[static_cast<std::size_t>(p)];
+        }
+        // Messages carried over to the next cycle.
+        auto backlog() const -> std::size_t;
+
+    private:
+        struct entry
+        {
+            msg_to_units msg;
+            ta::u64 queued_at; // Cycle.
+            bool deferred;
+        };
+        // Where a class' ring buffer of entries starts, oldest first.
+        struct position
+        {
+            std::size_t first = 0;
+            std::size_t count = 0;
+        };
+
+        auto at(std::size_t p, std::size_t i) -> entry&
+        {
+            return entries[p][(positions[p].first + i) % queue_capacity];
+        }
+        auto enqueue(const msg_to_units& msg) -> void;
+
+        // What every cycle reads comes first and fits in two cache lines,
+        // so that a cycle with nothing waiting doesn't touch the entries.
+        boiler::constants::link_budget budget{};
+        ta::u64 cycle = 0;
+        std::array<position, priority_count> positions{};
+        std::array<std::array<entry, queue_capacity>, priority_count> entries{};
+        std::array<class_stats, priority_count> class_stats_of{};
+    };
+}
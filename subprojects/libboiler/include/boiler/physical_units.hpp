@@ -14,6 +14,11 @@ namespace boiler {
             -> void
         {}
 
+        // Sends mode{ emergency_stop } on its own. Safe to call from another
+        // thread while get_messages() or process_messages() are in progress
+        // (the watchdog does, when a cycle is stuck in them or between).
+        auto emergency_stop() noexcept -> void {}
+
         const int update_speed = 100; // in ms.
     };
 }
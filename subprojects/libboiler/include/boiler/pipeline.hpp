@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef> // std::size_t.
+#include <optional>
+#include <thread>
+#include <utility> // std::move, std::declval.
+
+#include "boiler/spsc_queue.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+namespace boiler {
+    // Runs the control loop in two stages on two threads:
+    //
+    //     caller thread: pu.get_messages(), ctrl.process_messages() for cycle k
+    //     output thread: pu.process_messages()                      for cycle k - 1
+    //
+    // joined by a bounded lock-free queue, so the time spent transmitting a
+    // cycle's outputs overlaps with the next cycle instead of adding to it.
+    //
+    // The inputs are read when step() is called, never ahead: a loop that
+    // sleeps between cycles decides on readings as fresh as the sequential
+    // loop's. Every stage handles the cycles in order, so given the same
+    // inputs the controller produces the same outputs as the sequential
+    // loop. The price is latency on the way out: the outputs of cycle k may
+    // still be in transmission while the inputs of cycle k + 1 are read.
+    //
+    // PhysicalUnits::get_messages and PhysicalUnits::process_messages are
+    // called concurrently (each always from the same thread), so the plant
+    // must allow that.
+    template<typename PhysicalUnits, typename Controller>
+    class pipelined_executor
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        struct cycle_report
+        {
+            ta::u64 cycle;
+            // Time spent in each stage for this cycle.
+            clock::duration input;
+            clock::duration compute;
+            clock::duration output; // Of the previous cycle.
+            // Time the caller thread spent waiting for room for its outputs.
+            clock::duration stalled;
+
+            // How long the sequential loop would have taken minus how long
+            // this cycle actually took on the caller thread.
+            auto recovered() const -> clock::duration { return output - stalled; }
+        };
+
+        pipelined_executor(PhysicalUnits& units, Controller& controller);
+        ~pipelined_executor();
+
+        pipelined_executor(const pipelined_executor&) = delete;
+        auto operator=(const pipelined_executor&) -> pipelined_executor& = delete;
+
+        // Reads the next cycle's inputs, runs the control stage on them and
+        // hands the outputs to the output thread. Blocks while two cycles
+        // of outputs are still being transmitted.
+        auto step() -> cycle_report;
+
+    private:
+        using inputs_t  = decltype(std::declval<PhysicalUnits&>().get_messages());
+        using outputs_t = decltype(std::declval<Controller&>().process_messages(
+            std::declval<inputs_t>()));
+
+        // A spsc_queue plus what's needed to sleep while it's full or empty.
+        template<typename T, std::size_t Capacity>
+        class channel
+        {
+        public:
+            // Both return false/nullopt only once the channel is closed.
+            auto push(T value) -> bool;
+            auto pop() -> std::optional<T>;
+            auto close() -> void;
+
+        private:
+            spsc_queue<T, Capacity> queue;
+            // Bumped on every push/pop/close, waited on with atomic::wait.
+            std::atomic<ta::u32> pushes = 0;
+            std::atomic<ta::u32> pops   = 0;
+            std::atomic<bool> closed    = false;
+        };
+
+        auto output_loop() -> void;
+
+        PhysicalUnits& pu;
+        Controller& ctrl;
+
+        ta::u64 cycle = 0;
+
+        // At most two cycles of output still being transmitted.
+        channel<outputs_t, 2> outputs;
+        std::atomic<clock::rep> last_output_took = 0;
+
+        std::thread output_thread;
+    };
+}
+
+/// Implementation:
+template<typename PhysicalUnits, typename Controller>
+template<typename T, std::size_t Capacity>
+auto boiler::pipelined_executor<PhysicalUnits, Controller>::channel<T, Capacity>::push(
+    T value) -> bool
+{
+    while (true) {
+        const auto seen = pops.load(std::memory_order_acquire);
+        if (closed.load(std::memory_order_acquire)) { return false; }
+        if (queue.try_push(std::move(value))) { break; }
+        pops.wait(seen, std::memory_order_acquire);
+    }
+    pushes.fetch_add(1, std::memory_order_release);
+    pushes.notify_one();
+    return true;
+}
+
+template<typename PhysicalUnits, typename Controller>
+template<typename T, std::size_t Capacity>
+auto boiler::pipelined_executor<PhysicalUnits, Controller>::channel<T, Capacity>::pop()
+    -> std::optional<T>
+{
+    while (true) {
+        const auto seen = pushes.load(std::memory_order_acquire);
+        if (auto value = queue.try_pop()) {
+            pops.fetch_add(1, std::memory_order_release);
+            pops.notify_one();
+            return value;
+        }
+        if (closed.load(std::memory_order_acquire)) { return std::nullopt; }
+        pushes.wait(seen, std::memory_order_acquire);
+    }
+}
+
+template<typename PhysicalUnits, typename Controller>
+template<typename T, std::size_t Capacity>
+auto boiler::pipelined_executor<PhysicalUnits, Controller>::channel<T, Capacity>::close()
+    -> void
+{
+    closed.store(true, std::memory_order_release);
+    pushes.fetch_add(1, std::memory_order_release);
+    pops.fetch_add(1, std::memory_order_release);
+    pushes.notify_all();
+    pops.notify_all();
+}
+
+template<typename PhysicalUnits, typename Controller>
+boiler::pipelined_executor<PhysicalUnits, Controller>::pipelined_executor(
+    PhysicalUnits& units,
+    Controller& controller)
+    : pu{ units }
+    , ctrl{ controller }
+    , output_thread{ [this] { output_loop(); } }
+{}
+
+template<typename PhysicalUnits, typename Controller>
+boiler::pipelined_executor<PhysicalUnits, Controller>::~pipelined_executor()
+{
+    // Outputs already handed over are still transmitted before joining.
+    outputs.close();
+    output_thread.join();
+}
+
+template<typename PhysicalUnits, typename Controller>
+auto boiler::pipelined_executor<PhysicalUnits, Controller>::step() -> cycle_report
+{
+    auto report = cycle_report{};
+    report.cycle = cycle++;
+
+    const auto start     = clock::now();
+    auto messages        = pu.get_messages();
+    const auto got_input = clock::now();
+    auto out             = ctrl.process_messages(std::move(messages));
+    const auto computed  = clock::now();
+    // Only closed by the destructor, so it always takes them.
+    outputs.push(std::move(out));
+
+    report.input   = got_input - start;
+    report.compute = computed - got_input;
+    report.stalled = clock::now() - computed;
+    report.output =
+        clock::duration{ last_output_took.load(std::memory_order_relaxed) };
+    return report;
+}
+
+template<typename PhysicalUnits, typename Controller>
+auto boiler::pipelined_executor<PhysicalUnits, Controller>::output_loop() -> void
+{
+    while (auto messages = outputs.pop()) {
+        const auto start = clock::now();
+        pu.process_messages(std::move(*messages));
+        last_output_took.store((clock::now() - start).count(), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t.
+
+#include "boiler/common.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// The decisions control_unit::normal_routine takes every cycle, as a
+// decision table indexed by level band and by whether anything is believed
+// to be broken. Everything is constexpr: with constants known at compile
+// time the whole policy can be checked with static_assert(verify(c)), and
+// at runtime a decision is a handful of comparisons summed into an index
+// plus one table lookup, without branches.
+namespace boiler::policy {
+    enum class action : ta::u8
+    {
+        none,
+        open_pump,
+        close_pump,
+        emergency_stop,
+        switch_to_degraded,
+        switch_to_rescue,
+        // Only while building a table, verify() rejects tables containing it.
+        undecided,
+    };
+
+    // Ordered from the lowest level to the highest.
+    enum class level_band : ta::u8
+    {
+        implausible_low,  // Below 0, the level unit can't be trusted.
+        critical_low,     // Below margins.critical_low * min_limit.
+        low,              // Below min_normal.
+        normal,           // In [min_normal, max_normal].
+        high,             // Above max_normal.
+        critical_high,    // Above margins.critical_high * max_limit.
+        implausible_high, // Above capacity, the level unit can't be trusted.
+    };
+    inline constexpr std::size_t band_count = 7;
+
+    // Lower bounds of every band but the first. A level belongs to the
+    // highest band whose bound it reaches (the bounds of high and above are
+    // exclusive, the others inclusive).
+    struct thresholds
+    {
+        float critical_low;
+        float low;
+        float normal;
+        float high;
+        float critical_high;
+        float implausible_high;
+    };
+
+    // [band][anything_broken]
+    using decision_table = std::array<std::array<action, 2>, band_count>;
+
+    constexpr auto thresholds_for(const boiler::constants& c) -> thresholds;
+
+    // The table normal_routine uses.
+    constexpr auto normal_table() -> decision_table;
+
+    // The band computation is only branch-free when the thresholds are
+    // ordered, which is true for any sane constants.
+    constexpr auto is_ordered(const thresholds& t) -> bool;
+
+    // Branch-free, only valid when is_ordered(t). NaNs are implausible_low.
+    constexpr auto band_of(const thresholds& t, float level) -> level_band;
+    // Works for any thresholds, this is the if-chain normal_routine used to
+    // have and what band_of must agree with, NaNs included.
+    constexpr auto band_of_checked(const thresholds& t, float level) -> level_band;
+
+    // Checks, for the given constants, that:
+    //   - the thresholds are ordered (so band_of can be used);
+    //   - every entry of the table has been decided on;
+    //   - anything implausible goes to rescue, anything critical stops;
+    //   - below min_normal no decision leaves all pumps closed and above
+    //     max_normal no decision opens a pump.
+    constexpr auto verify(const boiler::constants& c) -> bool;
+
+    // What normal_routine does, compiled once per set of constants.
+    class normal_policy
+    {
+    public:
+        constexpr normal_policy(const boiler::constants& c);
+
+        constexpr auto decide(float level, bool anything_broken) const -> action;
+
+    private:
+        thresholds limits;
+        decision_table table;
+        bool ordered;
+    };
+}
+
+/// Implementation:
+constexpr auto boiler::policy::thresholds_for(const boiler::constants& c) -> thresholds
+{
+    return thresholds{
+        .critical_low     = 0,
+        .low              = c.margins.critical_low * c.boiler.min_limit,
+        .normal           = c.boiler.min_normal,
+        .high             = c.boiler.max_normal,
+        .critical_high    = c.margins.critical_high * c.boiler.max_limit,
+        .implausible_high = c.boiler.capacity,
+    };
+}
+
+constexpr auto boiler::policy::normal_table() -> decision_table
+{
+    auto table = decision_table{};
+    for (auto& row : table) {
+        row[0] = action::undecided;
+        // Anything broken takes precedence over the level...
+        row[1] = action::switch_to_degraded;
+    }
+    // ...unless the level itself can't be trusted.
+    table[static_cast<std::size_t>(level_band::implausible_low)]  = { action::switch_to_rescue,
+                                                                     action::switch_to_rescue };
+    table[static_cast<std::size_t>(level_band::implausible_high)] = { action::switch_to_rescue,
+                                                                      action::switch_to_rescue };
+
+    table[static_cast<std::size_t>(level_band::critical_low)][0]  = action::emergency_stop;
+    table[static_cast<std::size_t>(level_band::low)][0]           = action::open_pump;
+    table[static_cast<std::size_t>(level_band::normal)][0]        = action::none;
+    table[static_cast<std::size_t>(level_band::high)][0]          = action::close_pump;
+    table[static_cast<std::size_t>(level_band::critical_high)][0] = action::emergency_stop;
+    return table;
+}
+
+constexpr auto boiler::policy::is_ordered(const thresholds& t) -> bool
+{
+    return t.critical_low <= t.low && t.low <= t.normal && t.normal <= t.high &&
+           t.high <= t.critical_high && t.critical_high <= t.implausible_high;
+}
+
+constexpr auto boiler::policy::band_of(const thresholds& t, float level) -> level_band
+{
+    const auto index = static_cast<int>(level >= t.critical_low) +
+                       static_cast<int>(level >= t.low) +
+                       static_cast<int>(level >= t.normal) +
+                       static_cast<int>(level > t.high) +
+                       static_cast<int>(level > t.critical_high) +
+                       static_cast<int>(level > t.implausible_high);
+    return static_cast<level_band>(index);
+}
+
+constexpr auto boiler::policy::band_of_checked(const thresholds& t, float level)
+    -> level_band
+{
+    // A NaN fails every comparison, like in band_of() (std::isnan isn't
+    // constexpr).
+    if (level != level) { return level_band::implausible_low; }
+    if (level > t.implausible_high) { return level_band::implausible_high; }
+    if (level < t.critical_low) { return level_band::implausible_low; }
+    if (level > t.critical_high) { return level_band::critical_high; }
+    if (level < t.low) { return level_band::critical_low; }
+    if (level < t.normal) { return level_band::low; }
+    if (level > t.high) { return level_band::high; }
+    return level_band::normal;
+}
+
+constexpr auto boiler::policy::verify(const boiler::constants& c) -> bool
+{
+    const auto t     = thresholds_for(c);
+    const auto table = normal_table();
+
+    if (!is_ordered(t)) { return false; }
+
+    for (const auto& row : table) {
+        for (auto decision : row) {
+            if (decision == action::undecided) {
+                return false;
+            }
+        }
+    }
+
+    const auto at = [&](level_band band, bool broken) {
+        return table[static_cast<std::size_t>(band)][broken ? 1 : 0];
+    };
+    for (auto broken : { false, true }) {
+        if (at(level_band::implausible_low, broken) != action::switch_to_rescue ||
+            at(level_band::implausible_high, broken) != action::switch_to_rescue) {
+            return false;
+        }
+    }
+    if (at(level_band::critical_low, false) != action::emergency_stop ||
+        at(level_band::critical_high, false) != action::emergency_stop) {
+        return false;
+    }
+    // Below min_normal, with nothing broken, a pump must be opened (or the
+    // boiler stopped) and above max_normal no pump may be opened.
+    for (auto band : { level_band::critical_low, level_band::low }) {
+        const auto decision = at(band, false);
+        if (decision != action::open_pump && decision != action::emergency_stop) {
+            return false;
+        }
+    }
+    for (auto band : { level_band::high, level_band::critical_high }) {
+        if (at(band, false) == action::open_pump) { return false; }
+    }
+    // Anything beyond the limits must be in a band that stops the boiler.
+    if (c.boiler.min_limit > t.low || c.boiler.max_limit < t.critical_high) {
+        return false;
+    }
+
+    return true;
+}
+
+constexpr boiler::policy::normal_policy::normal_policy(const boiler::constants& c)
+    : limits{ thresholds_for(c) }
+    , table{ normal_table() }
+    , ordered{ is_ordered(limits) }
+{}
+
+constexpr auto boiler::policy::normal_policy::decide(float level, bool anything_broken) const
+    -> action
+{
+    // Misordered constants fall back to the if-chain.
+    const auto band = ordered ? band_of(limits, level) : band_of_checked(limits, level);
+    return table[static_cast<std::size_t>(band)][anything_broken ? 1 : 0];
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t.
+#include <optional>
+
+#include "boiler/common.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Which pumps degraded_routine opens: the set that keeps the level predicted
+// for the end of the cycle inside [min_normal, max_normal] (or as close to
+// it as the healthy pumps allow), whatever the steam does within its
+// gradients.
+//
+// All pumps have the same capacity, so the best set of healthy pumps only
+// depends on how many of them there are: the best count for n healthy pumps
+// is the best count for max_pumps clamped to n (the cost is convex in the
+// count). The constructor decides the best count for every level band and
+// steam band once, evaluating every count side by side (a loop over
+// max_pumps + 1 lanes, which the compiler vectorizes). When the healthy
+// pumps change, after a failure or a repair, select() only recomputes which
+// pumps make up the first k healthy ones. A lookup is two band indices and
+// two loads.
+namespace boiler::pump_selection {
+    // Bit n for pump n.
+    using pump_mask = ta::u16;
+    static_assert(sizeof(pump_mask) * 8 >= boiler::max_pumps);
+
+    inline constexpr std::size_t level_bands = 64; // Over [0, capacity].
+    inline constexpr std::size_t steam_bands = 16; // Over [0, max_throughput].
+
+    class table
+    {
+    public:
+        explicit table(const boiler::constants& c);
+
+        // The pumps to open among `healthy`. No steam for a steam reading
+        // that can't be trusted: the whole steam range is assumed then.
+        auto select(pump_mask healthy, float level, std::optional<float> steam) -> pump_mask;
+
+        // How many pumps select() opens with at least that many healthy.
+        auto best_count(float level, std::optional<float> steam) const -> std::size_t;
+
+    private:
+        static auto band(float value, float scale, std::size_t bands) -> std::size_t;
+
+        // [level band][steam band], the last steam band for no steam.
+        std::array<std::array<ta::u8, steam_bands + 1>, level_bands> counts{};
+        float level_scale;
+        float steam_scale;
+
+        // By count, the first pumps of `cached`.
+        pump_mask cached = 0;
+        std::array<pump_mask, boiler::max_pumps + 1> first{};
+    };
+}
+
+/// Implementation:
+inline auto boiler::pump_selection::table::band(float value, float scale, std::size_t bands)
+    -> std::size_t
+{
+    // NaNs and negative values go to the first band.
+    const auto b = value * scale;
+    if (!(b > 0)) { return 0; }
+    return b >= static_cast<float>(bands) ? bands - 1 : static_cast<std::size_t>(b);
+}
+
+inline auto boiler::pump_selection::table::best_count(float level, std::optional<float> steam) const
+    -> std::size_t
+{
+    const auto s = steam ? band(*steam, steam_scale, steam_bands) : steam_bands;
+    return counts[band(level, level_scale, level_bands)][s];
+}
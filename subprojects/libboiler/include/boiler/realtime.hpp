@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef> // std::size_t.
+#include <optional>
+#include <system_error>
+
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Keeps the cycle thread from being descheduled or page faulting mid-cycle.
+//
+// prepare() pins the calling thread to a core, locks every page the process
+// has and will have into memory (after faulting in a stack and a heap
+// reserve, so the first cycles don't pay for them either) and asks for
+// SCHED_FIFO. Each of those can be refused (no CAP_SYS_NICE, RLIMIT_MEMLOCK,
+// a core outside the cpuset...): the thread then runs with whatever was
+// granted and the result says what wasn't.
+//
+// usage() reads the calling thread's page fault and context switch counters,
+// the difference over a cycle shows whether it ran undisturbed.
+namespace boiler::realtime {
+    // Cores a thread can be pinned to are below it (CPU_SETSIZE).
+    inline constexpr unsigned max_cpus = 1024;
+
+    struct options
+    {
+        // Core to pin the thread to, none to leave it to the scheduler.
+        // Refused with EINVAL from max_cpus on.
+        std::optional<unsigned> cpu{};
+        bool lock_memory = false;
+        // SCHED_FIFO priority, 1 to 99, none to keep SCHED_OTHER.
+        std::optional<int> fifo_priority{};
+        // Faulted in before locking.
+        std::size_t stack_bytes = 256 << 10;
+        std::size_t heap_bytes  = 8 << 20;
+    };
+
+    // Default constructed codes for what was granted or not asked for.
+    struct outcome
+    {
+        std::error_code pinning;
+        std::error_code locking;
+        std::error_code scheduling;
+
+        auto all_granted() const -> bool { return !pinning && !locking && !scheduling; }
+    };
+
+    // Applies to the calling thread (and memory locking to the process).
+    // Threads it starts afterwards inherit the core and the policy: start
+    // the ones that mustn't compete with it first. Never throws for a
+    // refusal, see outcome.
+    auto prepare(const options& o) -> outcome;
+
+    struct counters
+    {
+        ta::i64 minor_faults;
+        ta::i64 major_faults;
+        ta::i64 voluntary_switches;
+        ta::i64 involuntary_switches;
+
+        friend auto operator-(const counters& a, const counters& b) -> counters
+        {
+            return { a.minor_faults - b.minor_faults,
+                     a.major_faults - b.major_faults,
+                     a.voluntary_switches - b.voluntary_switches,
+                     a.involuntary_switches - b.involuntary_switches };
+        }
+    };
+
+    // The calling thread's, since it started.
+    auto usage() -> counters;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>  // std::size_t.
+#include <iterator> // std::size.
+#include <vector>
+
+#include "boiler/message_ids.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Messages from the units that must stop the boiler without going through
+// the general expected handlers: control_unit checks them first thing every
+// cycle, before anything else gets a chance to look at the messages.
+//
+// Each signal has a rule saying how many cycles in a row it has to be
+// received to trip. Messages are classified by id through a table, and each
+// rule keeps a counter of consecutive cycles, so a cycle costs one table
+// lookup per message plus one increment or reset per rule.
+namespace boiler::safety {
+    struct rule
+    {
+        messages::msg_id id;
+        ta::u8 cycles_in_a_row;
+    };
+
+    // §2.3: stop received 3 times in a row means emergency_stop.
+    inline constexpr rule rules[] = {
+        { messages::id_of<messages::to_program::stop>, 3 },
+    };
+    inline constexpr std::size_t rule_count = std::size(rules);
+
+    class signal_counters
+    {
+    public:
+        // Returns whether any rule tripped this cycle.
+        auto observe(const std::vector<messages::from_units::any>& messages) -> bool;
+
+        constexpr auto consecutive(std::size_t rule_index) const -> ta::u8
+        {
+            return counters[rule_index];
+        }
+
+    private:
+        std::array<ta::u8, rule_count> counters{};
+    };
+}
+
+/// Implementation:
+namespace boiler::safety::detail {
+    inline constexpr auto no_rule = static_cast<ta::u8>(rule_count);
+
+    // Rule index of every message id, no_rule for most of them.
+    inline constexpr auto rule_of = [] {
+        auto table = std::array<ta::u8, messages::from_units::count>{};
+        for (auto& r : table) { r = no_rule; }
+        for (auto i = std::size_t{ 0 }; i < rule_count; ++i) {
+            table[rules[i].id] = static_cast<ta::u8>(i);
+        }
+        return table;
+    }();
+
+    static_assert(rule_count < 8, "Rules seen in a cycle are a ta::u8 bitmask");
+}
+
+inline auto boiler::safety::signal_counters::observe(
+    const std::vector<messages::from_units::any>& messages) -> bool
+{
+    auto seen = ta::u8{ 0 };
+    for (const auto& msg : messages) {
+        const auto r = detail::rule_of[msg.index()];
+        if (r != detail::no_rule) { seen = static_cast<ta::u8>(seen | (1u << r)); }
+    }
+
+    auto tripped = false;
+    for (auto i = std::size_t{ 0 }; i < rule_count; ++i) {
+        auto& counter = counters[i];
+        if ((static_cast<unsigned>(seen) >> i) & 1u) {
+            // Saturates, a signal that keeps coming keeps tripping.
+            if (counter < rules[i].cycles_in_a_row) { ++counter; }
+            tripped = tripped || counter >= rules[i].cycles_in_a_row;
+        } else {
+            counter = 0;
+        }
+    }
+    return tripped;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "boiler/common.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+namespace boiler {
+    // A simulated steam boiler that can stand in for physical_units. Every
+    // call to process_messages advances the plant by one cycle_time. The
+    // simulation only depends on the constants, the seed and the messages it
+    // receives, so runs are reproducible.
+    //
+    // Faults can be injected to exercise the failure handling of the
+    // control unit, see inject(), and repaired. Pump failure detections
+    // are acknowledged.
+    class simulator
+    {
+    public:
+        using mode = messages::to_units::mode::possible_modes;
+
+        // The failure classes from the spec.
+        enum class fault : ta::u8
+        {
+            none,
+            pump,         // A pump gets stuck and ignores open/close.
+            pump_control, // A pump controller reports the wrong flow.
+            level,        // The level unit reports garbage.
+            steam,        // The steam unit reports garbage.
+            transmission, // Whole cycles of messages are lost.
+            stop,         // The operator presses stop for a few cycles.
+        };
+        static constexpr auto fault_count = 7;
+
+        struct initial_state
+        {
+            float level_liters;
+            // Steam output the boiler ramps up to once running.
+            float target_steam_liters_per_sec;
+        };
+
+        simulator(boiler::constants c, ta::u64 seed);
+        simulator(boiler::constants c, ta::u64 seed, initial_state initial);
+
+        // Takes effect from the next cycle on. `target` selects the pump
+        // for pump and pump_control faults, it's ignored otherwise.
+        auto inject(fault f, ta::u8 target = 0) -> void;
+        // Clears the fault from the next cycle on, a broken pump is
+        // reported repaired then.
+        auto repair() -> void;
+
+        auto get_messages() -> std::vector<messages::to_program::any>;
+        auto process_messages(const std::vector<messages::to_units::any>& messages)
+            -> void;
+
+        /// Ground truth, regardless of faults.
+        auto level() const -> float { return water_liters; }
+        auto steam() const -> float { return steam_liters_per_sec; }
+        auto cycle() const -> ta::u64 { return cycles; }
+        // Last mode the control unit announced, if any.
+        auto controller_mode() const -> std::optional<mode> { return announced_mode; }
+        auto active_fault() const -> fault { return current_fault; }
+        // Open/close commands that actually changed a pump.
+        auto pump_switches() const -> ta::u64 { return switches; }
+
+    private:
+        auto random_unit() -> float; // In [0, 1).
+        auto step_physics() -> void;
+
+        const boiler::constants constants;
+        ta::u64 rng_state;
+
+        float water_liters;
+        float steam_liters_per_sec = 0;
+        float target_steam;
+
+        std::array<bool, max_pumps> pump_open{};
+        bool valve_open = false;
+        bool running    = false; // After physical_units_ready.
+        bool waiting_sent = false;
+        bool program_ready_received = false;
+
+        fault current_fault = fault::none;
+        ta::u8 fault_target = 0;
+        ta::u64 fault_cycle = 0;
+        float stuck_reading = 0;
+        // Bit n for pump n: failure detections to acknowledge and repairs
+        // to report, on the next cycle.
+        ta::u32 failures_to_ack = 0;
+        ta::u32 pumps_repaired  = 0;
+
+        ta::u64 cycles   = 0;
+        ta::u64 switches = 0;
+        std::optional<mode> announced_mode;
+    };
+}
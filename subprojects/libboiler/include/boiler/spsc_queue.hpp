@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef> // std::size_t.
+#include <optional>
+#include <type_traits>
+#include <utility> // std::move, std::forward.
+
+/// Summary:
+namespace boiler {
+    // Bounded wait-free queue for exactly one producer thread and one consumer
+    // thread. Holds at most Capacity elements, pushing to a full queue fails
+    // instead of blocking so the producer never waits on the consumer.
+    template<typename T, std::size_t Capacity>
+    class spsc_queue
+    {
+    public:
+        static_assert(Capacity > 0);
+
+        // Producer side. value is left untouched if the queue is full.
+        template<typename U>
+        [[nodiscard]] auto try_push(U&& value) noexcept(
+            std::is_nothrow_assignable_v<T&, U&&>) -> bool;
+
+        // Consumer side.
+        [[nodiscard]] auto try_pop() noexcept(std::is_nothrow_move_constructible_v<T>)
+            -> std::optional<T>;
+
+        // Approximate when called concurrently with try_push/try_pop.
+        auto size() const noexcept -> std::size_t;
+        auto empty() const noexcept -> bool { return size() == 0; }
+
+    private:
+        // One spare slot to tell a full queue from an empty one.
+        static constexpr std::size_t slots = Capacity + 1;
+
+        static constexpr auto next(std::size_t i) noexcept -> std::size_t
+        {
+            return i + 1 == slots ? 0 : i + 1;
+        }
+
+        // head and tail live in different cache lines so the producer and the
+        // consumer don't keep invalidating each other's line.
+        alignas(64) std::atomic<std::size_t> head = 0; // Next slot to pop.
+        alignas(64) std::atomic<std::size_t> tail = 0; // Next slot to push.
+        alignas(64) std::array<T, slots> buffer{};
+    };
+}
+
+/// Implementation:
+template<typename T, std::size_t Capacity>
+template<typename U>
+auto boiler::spsc_queue<T, Capacity>::try_push(U&& value) noexcept(
+    std::is_nothrow_assignable_v<T&, U&&>) -> bool
+{
+    const auto current = tail.load(std::memory_order_relaxed);
+    const auto after   = next(current);
+    if (after == head.load(std::memory_order_acquire)) { return false; }
+
+    buffer[current] = std::forward<U>(value);
+    tail.store(after, std::memory_order_release);
+    return true;
+}
+
+template<typename T, std::size_t Capacity>
+auto boiler::spsc_queue<T, Capacity>::try_pop() noexcept(
+    std::is_nothrow_move_constructible_v<T>) -> std::optional<T>
+{
+    const auto current = head.load(std::memory_order_relaxed);
+    if (current == tail.load(std::memory_order_acquire)) { return std::nullopt; }
+
+    auto value = std::optional<T>{ std::move(buffer[current]) };
+    head.store(next(current), std::memory_order_release);
+    return value;
+}
+
+template<typename T, std::size_t Capacity>
+auto boiler::spsc_queue<T, Capacity>::size() const noexcept -> std::size_t
+{
+    const auto h = head.load(std::memory_order_acquire);
+    const auto t = tail.load(std::memory_order_acquire);
+    return t >= h ? t - h : slots - h + t;
+}
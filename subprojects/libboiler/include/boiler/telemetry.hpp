@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef> // std::size_t, std::byte.
+#include <filesystem>
+#include <vector>
+
+#include "boiler/control_unit.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// History of what the control unit saw, one sample per cycle, kept for
+// post-incident analysis.
+//
+// Samples are buffered into blocks of block_samples. A full block is
+// compressed column by column, Gorilla style (delta-of-delta timestamps,
+// XOR'ed floats, 1 bit for an unchanged pump mask or mode), and appended
+// to a memory-mapped segment file; segments are never modified once a block
+// is written, new segments are started as they fill up. A steady plant
+// costs a few bytes per sample, around 75KiB per boiler-day at the default
+// 5s cycle (under 30MiB per boiler-year).
+//
+// Every block header keeps the time range and min/max/sum of the float
+// columns, so range scans skip whole blocks by time and downsampling only
+// decodes blocks that straddle a window.
+namespace boiler::telemetry {
+    using mode = messages::to_units::mode::possible_modes;
+
+    struct sample
+    {
+        ta::i64 time_ms;
+        float level_liters;
+        float steam_liters_per_sec;
+        // Bit n is set when pump n is open.
+        ta::u16 pumps_open;
+        mode m;
+    };
+
+    auto sample_of(const control_unit::snapshot& s, ta::i64 time_ms) -> sample;
+
+    struct column_summary
+    {
+        float min;
+        float max;
+        float avg;
+    };
+
+    // One downsampling window, [start_ms, start_ms + window_ms).
+    struct window_summary
+    {
+        ta::i64 start_ms;
+        ta::u32 count;
+        column_summary level_liters;
+        column_summary steam_liters_per_sec;
+    };
+
+    inline constexpr std::size_t block_samples = 1024;
+
+    class store
+    {
+    public:
+        static constexpr std::size_t default_segment_bytes = 4 << 20;
+
+        // Segments live in `directory` (created if needed) and the ones
+        // already there are reopened read-only, new samples always go to a
+        // new segment, numbered after the highest one there. The oldest
+        // segments can be deleted between runs to make room. Throws std::system_error when the files can't be
+        // created or mapped and std::invalid_argument when segment_bytes
+        // can't hold a block.
+        explicit store(
+            std::filesystem::path directory,
+            std::size_t segment_bytes = default_segment_bytes);
+        ~store();
+
+        store(const store&) = delete;
+        auto operator=(const store&) -> store& = delete;
+
+        // Samples must come in strictly increasing time order, throws
+        // std::invalid_argument otherwise.
+        auto append(const sample& s) -> void;
+        // Writes out the samples still buffered, as a shorter block.
+        auto flush() -> void;
+
+        // Appends the samples with time in [from_ms, to_ms) to `out`, in
+        // time order.
+        auto scan(ta::i64 from_ms, ta::i64 to_ms, std::vector<sample>& out) const -> void;
+        // Windows of window_ms starting at from_ms, empty windows are left
+        // out.
+        auto downsample(ta::i64 from_ms, ta::i64 to_ms, ta::i64 window_ms) const
+            -> std::vector<window_summary>;
+
+        auto size() const -> std::size_t;
+        // Compressed bytes in segments, headers included.
+        auto bytes_used() const -> std::size_t;
+
+    private:
+        struct segment;
+        struct block_ref
+        {
+            const std::byte* header;
+            ta::i64 first_ms;
+            ta::i64 last_ms;
+        };
+
+        auto open_segment() -> void;
+        auto seal_block() -> void;
+        auto blocks_from(ta::i64 from_ms) const -> std::vector<block_ref>::const_iterator;
+
+        std::filesystem::path directory;
+        std::size_t segment_bytes;
+
+        std::vector<segment> segments;
+        std::size_t next_segment = 0;
+        // Every block of every segment, in time order.
+        std::vector<block_ref> blocks;
+
+        std::vector<sample> open_block;
+        std::size_t samples = 0;
+        ta::i64 last_time_ms;
+        bool any_sample = false;
+    };
+}
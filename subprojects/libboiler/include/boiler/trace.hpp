@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef> // std::size_t.
+#include <ostream>
+
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// An opt-in timeline of what the control unit does within a cycle, to see
+// why a cycle was slow: process_messages and each of its phases, every
+// handler that fires (with the type of its message), every run_last
+// function and every mode switch.
+//
+// Off by default, a probe then costs a relaxed load and a branch. Once
+// enabled, every thread records into a ring of its own, without locks or
+// allocations after its first event: the last `ring_capacity` events of
+// each thread are kept, older ones are overwritten. write_chrome_json()
+// dumps them in the Chrome trace event format, which chrome://tracing and
+// Perfetto load; it can run while other threads keep recording.
+namespace boiler::trace {
+    enum class point : ta::u8
+    {
+        process_messages,
+        // Phases of process_messages.
+        safety_signals,
+        mailbox,
+        link_monitor,
+        handle_expected,
+        run_last,
+        mode_routine,
+        schedule,
+        // Within handle_expected, arg is the message id.
+        on_present,
+        on_receipt,
+        on_missing,
+        // Within run_last, arg is the function's position in the cycle.
+        run_last_call,
+        // arg is the new mode.
+        switch_mode,
+    };
+    inline constexpr std::size_t point_count = 13;
+
+    // Events kept per thread.
+    inline constexpr std::size_t ring_capacity = std::size_t{ 1 } << 16;
+
+    auto enable(bool on = true) -> void;
+    auto enabled() -> bool;
+
+    auto begin(point p, ta::u32 arg = 0) -> void;
+    auto end(point p, ta::u32 arg = 0) -> void;
+
+    // begin() on construction and end() on destruction, if tracing was
+    // enabled on construction.
+    class scope
+    {
+    public:
+        explicit scope(point p, ta::u32 arg = 0);
+        ~scope();
+
+        scope(const scope&) = delete;
+        auto operator=(const scope&) -> scope& = delete;
+
+    private:
+        point traced;
+        ta::u32 argument;
+        bool active;
+    };
+
+    // Every thread's events, as {"traceEvents": [...]}.
+    auto write_chrome_json(std::ostream& os) -> void;
+    // Forgets the events recorded so far.
+    auto clear() -> void;
+}
+
+/// Implementation:
+namespace boiler::trace::detail {
+    inline std::atomic<bool> on{ false };
+
+    auto record(point p, char phase, ta::u32 arg) -> void;
+}
+
+inline auto boiler::trace::enabled() -> bool { return detail::on.load(std::memory_order_relaxed); }
+
+inline auto boiler::trace::begin(point p, ta::u32 arg) -> void
+{
+    if (enabled()) { detail::record(p, 'B', arg); }
+}
+
+inline auto boiler::trace::end(point p, ta::u32 arg) -> void
+{
+    if (enabled()) { detail::record(p, 'E', arg); }
+}
+
+inline boiler::trace::scope::scope(point p, ta::u32 arg)
+    : traced{ p }
+    , argument{ arg }
+    , active{ enabled() }
+{
+    if (active) { detail::record(traced, 'B', argument); }
+}
+
+inline boiler::trace::scope::~scope()
+{
+    if (active) { detail::record(traced, 'E', argument); }
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef> // std::size_t, std::byte.
+#include <vector>
+
+#include <netinet/in.h> // sockaddr_in.
+#include <sys/socket.h> // mmsghdr.
+#include <sys/uio.h>    // iovec.
+
+#include "boiler/delta.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+#include "boiler/wire.hpp"
+
+/// Summary:
+// Plant I/O over UDP, for many boilers through one socket.
+//
+// An endpoint receives datagrams in the wire format (see wire.hpp) and
+// files their messages under the boiler id of their header; it sends one
+// datagram per boiler per cycle to the address that boiler last sent from
+// (or the one given to connect()). Datagrams are moved with recvmmsg and
+// sendmmsg, a batch at a time, through buffers allocated once in the
+// constructor: sends are staged with send() and go out on flush(), or when
+// the batch is full. Everything but send_now() is for one thread, the cycle
+// thread.
+//
+// With enable_delta() on both sides, the periodic messages are only sent
+// when they change (see delta.hpp): every datagram acknowledges the last
+// cycle received from the other side, and take() returns full cycles.
+//
+// gateway is the program's side and loopback_plant a stand-in for the
+// units' side, for tests and benchmarks. gateway_units puts one boiler of a
+// gateway behind the physical_units interface.
+namespace boiler::net {
+    struct endpoint_stats
+    {
+        ta::u64 datagrams_in;
+        ta::u64 datagrams_out;
+        ta::u64 bytes_in;
+        ta::u64 bytes_out;
+        // Periodic messages left out by delta mode.
+        ta::u64 suppressed;
+        // Datagrams that didn't decode, and the ones for boilers past the
+        // endpoint's count, dropped.
+        ta::u64 malformed;
+        ta::u64 unknown_boiler;
+        // Sends to boilers with no known address yet or with too much to
+        // fit a datagram, and datagrams the kernel refused.
+        ta::u64 unroutable;
+        ta::u64 send_failures;
+    };
+
+    // In: the messages received, Out: the messages sent.
+    template<typename In, typename Out>
+    class endpoint
+    {
+    public:
+        static constexpr std::size_t default_batch = 64;
+
+        // Binds to ip:port, port 0 for any. Boilers are numbered
+        // [0, boilers). Throws std::system_error when the socket can't be
+        // set up and std::invalid_argument for an invalid ip.
+        endpoint(const char* ip, ta::u16 port, std::size_t boilers, std::size_t batch = default_batch);
+        ~endpoint();
+
+        endpoint(const endpoint&) = delete;
+        auto operator=(const endpoint&) -> endpoint& = delete;
+
+        auto port() const -> ta::u16;
+        auto boilers() const -> std::size_t { return inboxes.size(); }
+
+        // Sends to every boiler go to ip:port until it's heard from.
+        auto connect(const char* ip, ta::u16 port) -> void;
+        // Change-only transmission of the periodic messages, the other
+        // side must enable it too. Before the first send.
+        auto enable_delta(ta::u32 keyframe_interval = delta::default_keyframe_interval) -> void;
+
+        // Waits up to `timeout` for a datagram, then receives everything
+        // that's queued. Returns the number of datagrams received.
+        auto poll(std::chrono::milliseconds timeout) -> std::size_t;
+
+        // Moves the messages received for `boiler` since the last take to
+        // `out` (cleared first), in the order they arrived.
+        auto take(ta::u32 boiler, std::vector<In>& out) -> void;
+        // The cycle of the last datagram from `boiler`.
+        auto last_cycle(ta::u32 boiler) const -> ta::u32 { return cycles[boiler]; }
+
+        // Stages a datagram, the boiler's next cycle: the endpoint numbers
+        // the cycles it sends to each boiler itself (see wire.hpp), whatever
+        // the other side's are. False when it can't be routed or encoded.
+        auto send(ta::u32 boiler, const std::vector<Out>& messages) -> bool;
+        // Sends the staged datagrams.
+        auto flush() -> void;
+        // From any thread, the cycle thread busy in any of the above
+        // included: sends a datagram of `messages` to `boiler` right away,
+        // with a sendto of its own, nothing staged and no delta. It's of
+        // cycle 0 and acknowledges nothing, so a side that decodes deltas
+        // takes it for an old cycle and keeps its messages as they are.
+        // False when the boiler has no known address yet or the datagram
+        // can't be encoded or sent; not in stats().
+        auto send_now(ta::u32 boiler, const std::vector<Out>& messages) const -> bool;
+
+        auto stats() const -> const endpoint_stats& { return counters; }
+
+    private:
+        struct batch_buffers
+        {
+            explicit batch_buffers(std::size_t batch);
+            // Points the headers at the buffers again.
+            auto reset(std::size_t i) -> void;
+
+            std::vector<std::byte> bytes;
+            std::vector<iovec> iov;
+            std::vector<sockaddr_in> addresses;
+            std::vector<mmsghdr> headers;
+        };
+
+        int fd = -1;
+        batch_buffers incoming;
+        batch_buffers outgoing;
+        std::size_t staged = 0;
+
+        std::vector<std::vector<In>> inboxes;
+        std::vector<sockaddr_in> peers;
+        // peers for send_now(), which can't read them while they change:
+        // port << 32 | address, with bit 48 set once known.
+        std::vector<std::atomic<ta::u64>> published_peers;
+        std::vector<ta::u32> cycles;
+        // 1 + the last cycle received from each boiler, 0 for none.
+        std::vector<ta::u32> acks;
+        // The last cycle sent to each boiler, 0 for none.
+        std::vector<ta::u32> sent_cycles;
+        endpoint_stats counters{};
+
+        std::vector<delta::encoder<Out>> encoders;
+        std::vector<delta::decoder<In>> decoders;
+        std::vector<Out> delta_scratch;
+    };
+
+    using gateway        = endpoint<messages::to_program::any, messages::to_units::any>;
+    using loopback_plant = endpoint<messages::to_units::any, messages::to_program::any>;
+
+    // Who sends what gateway_units::process_messages() stages.
+    enum class flushing
+    {
+        // It does, a datagram per sendmmsg: for a gateway of one boiler.
+        per_boiler,
+        // The caller, with gateway::flush() once every boiler of the
+        // gateway has had its cycle: a batch per sendmmsg.
+        by_caller,
+    };
+
+    // One boiler of a gateway, as physical_units.
+    class gateway_units
+    {
+    public:
+        gateway_units(gateway& through, ta::u32 id, flushing f = flushing::per_boiler)
+            : g{ through }
+            , boiler{ id }
+            , flushes{ f }
+        {}
+
+        // Whatever has arrived for this boiler, without waiting.
+        auto get_messages() -> std::vector<messages::to_program::any>;
+        // The boiler's next cycle, sent as `flushing` says.
+        auto process_messages(const std::vector<messages::to_units::any>& messages) -> void;
+        // Sends mode{ emergency_stop } on its own, right away (see
+        // endpoint::send_now()). Safe to call from another thread while
+        // the cycle thread is stuck anywhere, in the gateway too (the
+        // watchdog does).
+        auto emergency_stop() -> void;
+
+    private:
+        gateway& g;
+        ta::u32 boiler;
+        flushing flushes;
+    };
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // std::size_t.
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include "boiler/type_aliases.hpp"
+
+/// Summary:
+// Notices a cycle that stopped making progress, which the overrun check of
+// the loop can't: it only runs once a stage returns, and a stuck stage (a
+// run_last function that never returns, a plant read that blocks) never
+// does.
+//
+// The cycle thread says which phase it is in on a heartbeat, the control
+// unit for the phases of process_messages (see control_unit::watch()) and
+// the loop for the plant I/O around it. Entering a phase is a relaxed store
+// of one word, a few nanoseconds: the monitor only needs to see the word
+// change eventually, not in order with anything else.
+//
+// A monitor is a thread of its own that samples the heartbeat every
+// `poll`. When the word hasn't changed for longer than `max_stuck` outside of
+// phase::idle, it calls on_stall() once with the phase the cycle is stuck
+// in, from the monitor's thread: on_stall() must not wait for the cycle
+// thread, which is the one that's stuck.
+namespace boiler::watchdog {
+    enum class phase : ta::u8
+    {
+        // Between cycles, the loop sleeps here: not watched.
+        idle,
+        // physical_units::get_messages().
+        plant_input,
+        // Phases of control_unit::process_messages().
+        safety_signals,
+        mailbox,
+        link_monitor,
+        handle_expected,
+        run_last,
+        mode_routine,
+        schedule,
+        // physical_units::process_messages().
+        plant_output,
+    };
+    inline constexpr std::size_t phase_count = 10;
+
+    auto operator<<(std::ostream& os, phase p) -> std::ostream&;
+
+    class heartbeat
+    {
+    public:
+        // From the cycle thread only.
+        auto enter(phase p) noexcept -> void;
+
+        // From any thread. Changes every time a phase is entered, even the
+        // same one again.
+        auto word() const noexcept -> ta::u64 { return beat.load(std::memory_order_relaxed); }
+        static auto phase_of(ta::u64 word) noexcept -> phase { return static_cast<phase>(word & 0xff); }
+
+    private:
+        std::atomic<ta::u64> beat{ 0 };
+        // Only the cycle thread writes, so it keeps its count to itself
+        // instead of reading the atomic back.
+        ta::u64 beats = 0;
+    };
+
+    struct stall
+    {
+        phase stuck;
+        // Since the monitor first saw the cycle in that phase, so up to a
+        // period short.
+        std::chrono::nanoseconds for_how_long;
+    };
+
+    class monitor
+    {
+    public:
+        using on_stall_fn = std::function<void(const stall&)>;
+
+        // Starts watching. `poll` defaults to a quarter of `max_stuck`, so a
+        // stall is noticed within 1.25 * max_stuck.
+        monitor(
+            const heartbeat& h,
+            std::chrono::nanoseconds max_stuck,
+            on_stall_fn callback,
+            std::chrono::nanoseconds poll = std::chrono::nanoseconds::zero());
+        // Stops watching and joins the thread.
+        ~monitor();
+
+        monitor(const monitor&) = delete;
+        auto operator=(const monitor&) -> monitor& = delete;
+
+        // Reported so far, once per stall.
+        auto stalls() const noexcept -> ta::u64 { return reported.load(std::memory_order_relaxed); }
+
+    private:
+        auto watch() -> void;
+
+        const heartbeat& watched;
+        const std::chrono::nanoseconds limit;
+        const std::chrono::nanoseconds period;
+        on_stall_fn on_stall;
+        std::atomic<ta::u64> reported{ 0 };
+
+        std::mutex stop_lock;
+        std::condition_variable stop_requested;
+        bool stopping = false;
+        // Last, so that it starts once everything it reads is built.
+        std::thread thread;
+    };
+}
+
+/// Implementation:
+inline auto boiler::watchdog::heartbeat::enter(phase p) noexcept -> void
+{
+    ++beats;
+    beat.store(beats << 8 | static_cast<ta::u64>(p), std::memory_order_relaxed);
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <array>
+#include <bit>     // std::bit_cast.
+#include <cstddef> // std::size_t, std::byte.
+#include <type_traits>
+#include <vector>
+
+#include "boiler/message_ids.hpp"
+#include "boiler/messages.hpp"
+#include "boiler/type_aliases.hpp"
+#include "boiler/utils.hpp"
+
+#include "limbo/limbo.hpp" // limbo::is_detected_v.
+
+/// Summary:
+// The binary layout of messages between the program and the units.
+//
+// A message is its id (see message_ids.hpp) followed by its members in a
+// fixed order: n, m, state, liters, liters_per_sec. Pump numbers, modes and
+// states take a byte each, floats 4 bytes of IEEE 754; everything
+// little-endian whatever the host.
+//
+// A datagram carries the messages of one boiler for one cycle:
+//
+//     u32 boiler | u32 cycle | u32 acked | u8 count | u8 flags | count messages
+//
+// where acked is 1 + the last cycle received from the other side for that
+// boiler, 0 when nothing has been, and flags says whether the cycle is a
+// keyframe (see delta.hpp). Each side numbers the cycles it sends to a
+// boiler on its own, from 1 and each higher than the last: what the other
+// side acknowledges is one datagram. Cycle 0 is out of band.
+//
+// The encoders return the end of what they wrote and the decoders the end
+// of what they read, nullptr when the buffer is too small or (decoding) the
+// bytes aren't a valid message.
+namespace boiler::wire {
+    struct header
+    {
+        ta::u32 boiler;
+        ta::u32 cycle;
+        ta::u32 acked;
+        ta::u8 count;
+        ta::u8 flags;
+    };
+    inline constexpr std::size_t header_size = 14;
+
+    // header::flags.
+    inline constexpr ta::u8 keyframe = 0x01;
+
+    // Fits a UDP payload in an Ethernet frame.
+    inline constexpr std::size_t max_datagram = 1472;
+
+    template<typename Msg>
+    inline constexpr std::size_t size_of = [] {
+        namespace exprs = boiler::messages::detection_exprs;
+        using msg_t     = boiler::utils::remove_cv_ref_t<Msg>;
+        return 1 + limbo::is_detected_v<exprs::has_n_expr, msg_t> +
+               limbo::is_detected_v<exprs::has_m_expr, msg_t> +
+               limbo::is_detected_v<exprs::has_state_expr, msg_t> +
+               4 * limbo::is_detected_v<exprs::has_liters_expr, msg_t> +
+               4 * limbo::is_detected_v<exprs::has_liters_per_sec_expr, msg_t>;
+    }();
+
+    auto encode(std::byte* first, std::byte* last, const messages::to_units::any& msg)
+        -> std::byte*;
+    auto encode(std::byte* first, std::byte* last, const messages::to_program::any& msg)
+        -> std::byte*;
+    auto decode(const std::byte* first, const std::byte* last, messages::to_units::any& msg)
+        -> const std::byte*;
+    auto decode(const std::byte* first, const std::byte* last, messages::to_program::any& msg)
+        -> const std::byte*;
+
+    // A whole datagram, header.count is set from messages. Encoding fails
+    // past 255 messages.
+    template<typename Any>
+    auto encode_datagram(
+        std::byte* first,
+        std::byte* last,
+        header h,
+        const std::vector<Any>& messages) -> std::byte*;
+    // Appends the messages to `out`, which is left as it was on failure.
+    template<typename Any>
+    auto decode_datagram(
+        const std::byte* first,
+        const std::byte* last,
+        header& h,
+        std::vector<Any>& out) -> const std::byte*;
+}
+
+/// Implementation:
+namespace boiler::wire::detail {
+    inline auto put(std::byte* at, ta::u32 v) -> void
+    {
+        for (auto i = 0; i < 4; ++i) { at[i] = static_cast<std::byte>(v >> (8 * i)); }
+    }
+    inline auto get(const std::byte* at) -> ta::u32
+    {
+        auto v = ta::u32{ 0 };
+        for (auto i = 0; i < 4; ++i) { v |= std::to_integer<ta::u32>(at[i]) << (8 * i); }
+        return v;
+    }
+
+    template<typename Msg>
+    auto encode_one(std::byte* first, std::byte* last, const Msg& msg) -> std::byte*
+    {
+        namespace exprs = boiler::messages::detection_exprs;
+        if (last - first < static_cast<std::ptrdiff_t>(size_of<Msg>)) { return nullptr; }
+
+        *first++ = static_cast<std::byte>(boiler::messages::id_of<Msg>);
+        if constexpr (limbo::is_detected_v<exprs::has_n_expr, Msg>) {
+            *first++ = static_cast<std::byte>(msg.n);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_m_expr, Msg>) {
+            *first++ = static_cast<std::byte>(msg.m);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_state_expr, Msg>) {
+            *first++ = static_cast<std::byte>(msg.state);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_liters_expr, Msg>) {
+            put(first, std::bit_cast<ta::u32>(msg.liters));
+            first += 4;
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_liters_per_sec_expr, Msg>) {
+            put(first, std::bit_cast<ta::u32>(msg.liters_per_sec));
+            first += 4;
+        }
+        return first;
+    }
+
+    // first is past the id.
+    template<typename Msg, typename Any>
+    auto decode_one(const std::byte* first, const std::byte* last, Any& out) -> const std::byte*
+    {
+        namespace exprs = boiler::messages::detection_exprs;
+        if (last - first < static_cast<std::ptrdiff_t>(size_of<Msg> - 1)) { return nullptr; }
+
+        auto msg = Msg{};
+        if constexpr (limbo::is_detected_v<exprs::has_n_expr, Msg>) {
+            msg.n = std::to_integer<ta::u8>(*first++);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_m_expr, Msg>) {
+            const auto m = std::to_integer<ta::u8>(*first++);
+            if (m > static_cast<ta::u8>(decltype(msg.m)::emergency_stop)) { return nullptr; }
+            msg.m = static_cast<decltype(msg.m)>(m);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_state_expr, Msg>) {
+            const auto state = std::to_integer<ta::u8>(*first++);
+            if (state > 1) { return nullptr; }
+            msg.state = static_cast<decltype(msg.state)>(state == 1);
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_liters_expr, Msg>) {
+            msg.liters = std::bit_cast<float>(get(first));
+            first += 4;
+        }
+        if constexpr (limbo::is_detected_v<exprs::has_liters_per_sec_expr, Msg>) {
+            msg.liters_per_sec = std::bit_cast<float>(get(first));
+            first += 4;
+        }
+        out = msg;
+        return first;
+    }
+
+    template<typename Any>
+    using decoder = auto (*)(const std::byte*, const std::byte*, Any&) -> const std::byte*;
+
+    // Indexed by id.
+    template<typename Any, typename Types>
+    inline constexpr auto decoders = []<typename... Msgs>(limbo::type_list<Msgs...>) {
+        return std::array<decoder<Any>, sizeof...(Msgs)>{ &decode_one<Msgs, Any>... };
+    }(Types{});
+
+    template<typename Any, typename Types>
+    auto decode_any(const std::byte* first, const std::byte* last, Any& msg) -> const std::byte*
+    {
+        if (first == last) { return nullptr; }
+        const auto id = std::to_integer<std::size_t>(*first);
+        if (id >= Types::size) { return nullptr; }
+        return decoders<Any, Types>[id](first + 1, last, msg);
+    }
+}
+
+inline auto boiler::wire::encode(
+    std::byte* first,
+    std::byte* last,
+    const messages::to_units::any& msg) -> std::byte*
+{
+    return std::visit([&](const auto& m) { return detail::encode_one(first, last, m); }, msg);
+}
+
+inline auto boiler::wire::encode(
+    std::byte* first,
+    std::byte* last,
+    const messages::to_program::any& msg) -> std::byte*
+{
+    return std::visit([&](const auto& m) { return detail::encode_one(first, last, m); }, msg);
+}
+
+inline auto boiler::wire::decode(
+    const std::byte* first,
+    const std::byte* last,
+    messages::to_units::any& msg) -> const std::byte*
+{
+    return detail::decode_any<messages::to_units::any, messages::to_units::types>(
+        first, last, msg);
+}
+
+inline auto boiler::wire::decode(
+    const std::byte* first,
+    const std::byte* last,
+    messages::to_program::any& msg) -> const std::byte*
+{
+    return detail::decode_any<messages::to_program::any, messages::to_program::types>(
+        first, last, msg);
+}
+
+template<typename Any>
+auto boiler::wire::encode_datagram(
+    std::byte* first,
+    std::byte* last,
+    header h,
+    const std::vector<Any>& messages) -> std::byte*
+{
+    if (messages.size() > 255 || last - first < static_cast<std::ptrdiff_t>(header_size)) {
+        return nullptr;
+    }
+    detail::put(first, h.boiler);
+    detail::put(first + 4, h.cycle);
+    detail::put(first + 8, h.acked);
+    first[12] = static_cast<std::byte>(messages.size());
+    first[13] = static_cast<std::byte>(h.flags);
+    first += header_size;
+
+    for (const auto& msg : messages) {
+        first = encode(first, last, msg);
+        if (first == nullptr) { return nullptr; }
+    }
+    return first;
+}
+
+template<typename Any>
+auto boiler::wire::decode_datagram(
+    const std::byte* first,
+    const std::byte* last,
+    header& h,
+    std::vector<Any>& out) -> const std::byte*
+{
+    if (last - first < static_cast<std::ptrdiff_t>(header_size)) { return nullptr; }
+    h.boiler = detail::get(first);
+    h.cycle  = detail::get(first + 4);
+    h.acked  = detail::get(first + 8);
+    h.count  = std::to_integer<ta::u8>(first[12]);
+    h.flags  = std::to_integer<ta::u8>(first[13]);
+    first += header_size;
+
+    const auto size = out.size();
+    for (auto i = 0u; i < h.count; ++i) {
+        auto msg = Any{};
+        first    = decode(first, last, msg);
+        if (first == nullptr) {
+            out.resize(size);
+            return nullptr;
+        }
+        out.push_back(msg);
+    }
+    return first;
+}
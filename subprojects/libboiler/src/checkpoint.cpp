@@ -0,0 +1,289 @@
+#include "boiler/checkpoint.hpp"
+
+#include <algorithm> // std::max.
+#include <cerrno>
+#include <cmath>   // std::abs.
+#include <cstring> // std::memcpy, std::memcmp.
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>    // open, posix_fallocate.
+#include <sys/mman.h> // mmap, munmap.
+#include <unistd.h>   // close, ftruncate.
+
+namespace {
+    namespace checkpoint = boiler::checkpoint;
+    using snapshot       = boiler::control_unit::snapshot;
+    using clock          = std::chrono::system_clock;
+
+    constexpr char magic[8] = { 'b', 'o', 'i', 'l', 'c', 'k', 'p', '2' };
+    constexpr ta::u32 byte_order = 0x01020304;
+
+    struct file_header
+    {
+        char magic[8];
+        ta::u32 byte_order;
+        ta::u32 snapshot_bytes;
+        boiler::constants constants;
+    };
+
+    // The slot's checksum covers its sequence, time and snapshot: a slot
+    // that was being written when the process died doesn't match it.
+    struct slot_header
+    {
+        // 0 for an empty slot.
+        ta::u64 sequence;
+        ta::i64 taken_ms;
+        ta::u64 checksum;
+    };
+
+    constexpr auto round_up(std::size_t n) -> std::size_t { return (n + 63) / 64 * 64; }
+    constexpr std::size_t header_bytes = round_up(sizeof(file_header));
+    constexpr std::size_t slot_bytes   = round_up(sizeof(slot_header) + sizeof(snapshot));
+    constexpr std::size_t file_bytes   = header_bytes + 2 * slot_bytes;
+
+    auto fail(const std::string& what) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    // FNV-1a.
+    constexpr ta::u64 fnv_basis = 0xcbf29ce484222325;
+    auto mix(ta::u64 h, const void* data, std::size_t size) -> ta::u64
+    {
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (auto i = std::size_t{ 0 }; i < size; ++i) {
+            h = (h ^ p[i]) * 0x100000001b3;
+        }
+        return h;
+    }
+
+    auto checksum(const slot_header& h, const std::byte* image) -> ta::u64
+    {
+        auto sum = mix(fnv_basis, &h.sequence, sizeof(h.sequence));
+        sum      = mix(sum, &h.taken_ms, sizeof(h.taken_ms));
+        return mix(sum, image, sizeof(snapshot));
+    }
+
+    auto same(const boiler::constants& a, const boiler::constants& b) -> bool
+    {
+        return a.boiler.capacity == b.boiler.capacity && a.boiler.max_limit == b.boiler.max_limit &&
+               a.boiler.max_normal == b.boiler.max_normal &&
+               a.boiler.min_normal == b.boiler.min_normal &&
+               a.boiler.min_limit == b.boiler.min_limit &&
+               a.steam.max_throughput == b.steam.max_throughput &&
+               a.steam.max_gradient == b.steam.max_gradient &&
+               a.steam.min_gradient == b.steam.min_gradient && a.pump_capacity == b.pump_capacity &&
+               a.margins.critical_low == b.margins.critical_low &&
+               a.margins.critical_high == b.margins.critical_high && a.pump_count == b.pump_count &&
+               a.cycle_time == b.cycle_time && a.link.messages == b.link.messages &&
+               a.link.bytes == b.link.bytes;
+    }
+
+    auto header_of(const boiler::constants& c) -> file_header
+    {
+        auto h = file_header{};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.byte_order     = byte_order;
+        h.snapshot_bytes = sizeof(snapshot);
+        h.constants      = c;
+        return h;
+    }
+
+    // Whether the file starting at `file` is of this build and constants.
+    auto ours(const std::byte* file, const boiler::constants& c) -> bool
+    {
+        auto h = file_header{};
+        std::memcpy(&h, file, sizeof(h));
+        return std::memcmp(h.magic, magic, sizeof(magic)) == 0 && h.byte_order == byte_order &&
+               h.snapshot_bytes == sizeof(snapshot) && same(h.constants, c);
+    }
+
+    // The slot of the file's newest intact snapshot and its header,
+    // nullptr if there's none.
+    auto newest_slot(const std::byte* file, slot_header& newest) -> const std::byte*
+    {
+        const auto* latest = static_cast<const std::byte*>(nullptr);
+        newest             = slot_header{};
+        for (auto slot = std::size_t{ 0 }; slot < 2; ++slot) {
+            const auto* at = file + header_bytes + slot * slot_bytes;
+            auto sh        = slot_header{};
+            std::memcpy(&sh, at, sizeof(sh));
+            if (sh.sequence > newest.sequence && sh.checksum == checksum(sh, at + sizeof(sh))) {
+                newest = sh;
+                latest = at;
+            }
+        }
+        return latest;
+    }
+}
+
+auto boiler::checkpoint::load(const std::filesystem::path& path, const boiler::constants& c)
+    -> std::optional<found>
+{
+    auto in   = std::ifstream{ path, std::ios::binary };
+    auto file = std::vector<char>(file_bytes);
+    if (!in.read(file.data(), static_cast<std::streamsize>(file.size())) || in.peek() != EOF) {
+        return std::nullopt;
+    }
+
+    const auto* bytes = reinterpret_cast<const std::byte*>(file.data());
+    if (!ours(bytes, c)) { return std::nullopt; }
+    auto newest        = slot_header{};
+    const auto* latest = newest_slot(bytes, newest);
+    if (latest == nullptr) { return std::nullopt; }
+
+    // Any snapshot of these constants, for memcpy to overwrite.
+    auto f = found{ control_unit{ c }.save(),
+                    clock::time_point{ std::chrono::milliseconds{ newest.taken_ms } } };
+    std::memcpy(&f.state, latest + sizeof(slot_header), sizeof(snapshot));
+    if (!control_unit::restorable(f.state)) { return std::nullopt; }
+    return f;
+}
+
+auto boiler::checkpoint::plausible(
+    const found& f,
+    const boiler::constants& c,
+    const std::vector<control_unit::msg_from_units>& first,
+    std::chrono::system_clock::time_point now,
+    std::chrono::milliseconds max_age) -> bool
+{
+    namespace to_program = boiler::messages::to_program;
+
+    const auto& s = f.state;
+    if (s.mode_of_operation == control_unit::mode::initialization) { return false; }
+    const auto age = now - f.taken;
+    if (age < age.zero() || age > max_age) { return false; }
+
+    auto level = std::optional<float>{};
+    auto steam = std::optional<float>{};
+    for (const auto& m : first) {
+        if (std::holds_alternative<to_program::steam_boiler_waiting>(m)) { return false; }
+        if (const auto* l = std::get_if<to_program::level>(&m)) { level = l->liters; }
+        if (const auto* st = std::get_if<to_program::steam>(&m)) { steam = st->liters_per_sec; }
+    }
+
+    // The plant has had the checkpoint's age, and the cycle its readings
+    // were taken in, to change.
+    const auto dt = std::chrono::duration<float>(age + c.cycle_time).count();
+    if (!s.assumptions.level_broken) {
+        const auto fastest =
+            static_cast<float>(c.pump_count) * c.pump_capacity + c.steam.max_throughput;
+        if (!level || std::abs(*level - s.readings.level_liters) > fastest * dt) { return false; }
+    }
+    if (!s.assumptions.steam_broken) {
+        const auto fastest = std::max(c.steam.max_gradient, c.steam.min_gradient);
+        if (!steam || std::abs(*steam - s.readings.steam_liters_per_sec) > fastest * dt) {
+            return false;
+        }
+    }
+    return true;
+}
+
+boiler::checkpoint::writer::writer(
+    const std::filesystem::path& path,
+    const boiler::constants& c,
+    options o)
+    : opts{ o }
+    , bytes{ file_bytes }
+{
+    const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { fail("can't open " + path.string()); }
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        ::close(fd);
+        fail("can't size " + path.string());
+    }
+    // Allocated now, so that writing through the mapping can't run out of
+    // disk (which would be a SIGBUS).
+    if (const auto error = ::posix_fallocate(fd, 0, static_cast<off_t>(bytes)); error != 0) {
+        ::close(fd);
+        errno = error;
+        fail("can't allocate " + path.string());
+    }
+    auto* mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping outlives the descriptor.
+    ::close(fd);
+    if (mapped == MAP_FAILED) { fail("can't map " + path.string()); }
+    data = static_cast<std::byte*>(mapped);
+
+    // Checkpoints of these constants carry on from the newest one, so the
+    // first put() goes in the older slot. Any other file is only taken
+    // over by the first put(): until then, a restart still finds the
+    // last process' checkpoint.
+    if (ours(data, c)) {
+        auto newest = slot_header{};
+        newest_slot(data, newest);
+        sequence = newest.sequence;
+    } else {
+        take_over = c;
+    }
+
+    thread = std::thread{ [this] { write_out(); } };
+}
+
+boiler::checkpoint::writer::~writer()
+{
+    {
+        const auto lock = std::lock_guard{ staging_lock };
+        stopping        = true;
+    }
+    wake.notify_one();
+    thread.join();
+    ::munmap(data, bytes);
+}
+
+auto boiler::checkpoint::writer::offer(const control_unit& ctrl) -> bool
+{
+    if (++calls < opts.every) { return false; }
+    auto lock = std::unique_lock{ staging_lock, std::try_to_lock };
+    if (!lock.owns_lock()) { return false; }
+    calls     = 0;
+    staged    = ctrl.save();
+    staged_at = clock::now();
+    fresh     = true;
+    lock.unlock();
+    wake.notify_one();
+    return true;
+}
+
+auto boiler::checkpoint::writer::write_out() -> void
+{
+    auto lock = std::unique_lock{ staging_lock };
+    while (true) {
+        wake.wait(lock, [this] { return fresh || stopping; });
+        if (!fresh) { return; }
+        const auto s     = *staged;
+        const auto taken = staged_at;
+        fresh            = false;
+        lock.unlock();
+        put(s, taken);
+        lock.lock();
+    }
+}
+
+auto boiler::checkpoint::writer::put(const snapshot& s, clock::time_point taken) -> void
+{
+    if (take_over) {
+        // The slots go first: a header of other constants over the last
+        // one's snapshots would pass them for snapshots of these.
+        const auto empty = slot_header{};
+        std::memcpy(data + header_bytes, &empty, sizeof(empty));
+        std::memcpy(data + header_bytes + slot_bytes, &empty, sizeof(empty));
+        const auto h = header_of(*take_over);
+        std::memcpy(data, &h, sizeof(h));
+        take_over.reset();
+    }
+
+    ++sequence;
+    auto* slot = data + header_bytes + sequence % 2 * slot_bytes;
+    std::memcpy(slot + sizeof(slot_header), &s, sizeof(s));
+
+    auto h     = slot_header{};
+    h.sequence = sequence;
+    h.taken_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(taken.time_since_epoch()).count();
+    h.checksum = checksum(h, slot + sizeof(slot_header));
+    std::memcpy(slot, &h, sizeof(h));
+    writes.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,445 @@
+#include "boiler/config.hpp"
+
+#include <algorithm> // std::sort, std::adjacent_find, std::lower_bound.
+#include <cerrno>
+#include <charconv> // std::from_chars.
+#include <cstring>  // std::memcpy, std::memcmp, strnlen.
+#include <fstream>
+#include <iterator> // std::size.
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility> // std::pair.
+
+#include <fcntl.h>    // open.
+#include <sys/mman.h> // mmap, munmap.
+#include <unistd.h>   // close.
+
+namespace {
+    namespace config = boiler::config;
+
+    constexpr char magic[8] = { 'b', 'o', 'i', 'l', 'c', 'f', 'g', '1' };
+    constexpr ta::u32 byte_order = 0x01020304;
+
+    struct record
+    {
+        char name[config::max_name_length + 1];
+        ta::i64 cycle_time_ms;
+        float capacity;
+        float max_limit;
+        float max_normal;
+        float min_normal;
+        float min_limit;
+        float max_throughput;
+        float max_gradient;
+        float min_gradient;
+        float pump_capacity;
+        float critical_low;
+        float critical_high;
+        ta::u32 link_bytes;
+        ta::u16 link_messages;
+        ta::u8 pump_count;
+        ta::u8 reserved[5];
+    };
+    static_assert(sizeof(record) == 96, "The layout is part of the file format");
+
+    struct header
+    {
+        char magic[8];
+        ta::u32 byte_order;
+        ta::u32 record_bytes;
+        ta::u64 count;
+        record defaults;
+    };
+    static_assert(sizeof(header) % alignof(record) == 0);
+
+    auto fail(const std::string& what) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    auto syntax_error(std::size_t line, const std::string& what) -> void
+    {
+        throw std::invalid_argument{ "line " + std::to_string(line) + ": " + what };
+    }
+
+    auto trim(std::string_view s) -> std::string_view
+    {
+        const auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+        while (!s.empty() && blank(s.front())) { s.remove_prefix(1); }
+        while (!s.empty() && blank(s.back())) { s.remove_suffix(1); }
+        return s;
+    }
+
+    template<typename T>
+    auto number(std::string_view text, std::size_t line) -> T
+    {
+        auto value     = T{};
+        const auto end = text.data() + text.size();
+        const auto [at, error] = std::from_chars(text.data(), end, value);
+        if (error != std::errc{} || at != end) {
+            syntax_error(line, "'" + std::string{ text } + "' isn't a valid value");
+        }
+        return value;
+    }
+
+    template<typename T>
+    auto bounded(std::string_view text, std::size_t line, ta::u64 max) -> T
+    {
+        const auto value = number<ta::u64>(text, line);
+        if (value > max) {
+            syntax_error(line, std::string{ text } + " is above " + std::to_string(max));
+        }
+        return static_cast<T>(value);
+    }
+
+    auto set(boiler::constants& c, std::string_view key, std::string_view value, std::size_t line)
+        -> void
+    {
+        // Same order as config::keys.
+        float* const floats[] = {
+            &c.boiler.capacity,       &c.boiler.max_limit,    &c.boiler.max_normal,
+            &c.boiler.min_normal,     &c.boiler.min_limit,    &c.steam.max_throughput,
+            &c.steam.max_gradient,    &c.steam.min_gradient,  &c.pump_capacity,
+            &c.margins.critical_low,  &c.margins.critical_high,
+        };
+        for (auto i = std::size_t{ 0 }; i < std::size(floats); ++i) {
+            if (key == config::keys[i]) {
+                *floats[i] = number<float>(value, line);
+                return;
+            }
+        }
+
+        if (key == "pump_count") {
+            c.pump_count = bounded<ta::u8>(value, line, boiler::max_pumps);
+        } else if (key == "cycle_time_ms") {
+            c.cycle_time = std::chrono::milliseconds{ bounded<ta::i64>(
+                value, line, std::numeric_limits<ta::i64>::max()) };
+        } else if (key == "link.messages") {
+            c.link.messages = bounded<ta::u16>(value, line, std::numeric_limits<ta::u16>::max());
+        } else if (key == "link.bytes") {
+            c.link.bytes = bounded<ta::u32>(value, line, std::numeric_limits<ta::u32>::max());
+        } else {
+            syntax_error(line, "unknown key '" + std::string{ key } + "'");
+        }
+    }
+
+    // What's wrong with `c`, nullptr when nothing is. Both formats go
+    // through it: a compiled record may have been written by anything.
+    auto problem(const boiler::constants& c) -> const char*
+    {
+        if (c.pump_count == 0 || c.pump_count > boiler::max_pumps) {
+            return "pump_count must be between 1 and max_pumps";
+        }
+        // The watchdog polls a fraction of it, a cycle of nothing would be
+        // a busy loop.
+        if (c.cycle_time <= std::chrono::milliseconds::zero()) {
+            return "cycle_time_ms must be positive";
+        }
+        const auto& b = c.boiler;
+        if (!(b.min_limit <= b.min_normal && b.min_normal <= b.max_normal &&
+              b.max_normal <= b.max_limit && b.max_limit <= b.capacity)) {
+            return "boiler thresholds are out of order";
+        }
+        const auto& m = c.margins;
+        if (!(b.min_limit <= m.critical_low * b.min_limit &&
+              m.critical_low * b.min_limit <= b.min_normal &&
+              b.max_normal <= m.critical_high * b.max_limit &&
+              m.critical_high * b.max_limit <= b.max_limit)) {
+            return "margins put the critical levels out of order";
+        }
+        return nullptr;
+    }
+
+    auto check(const boiler::constants& c, std::size_t line) -> void
+    {
+        if (const auto* why = problem(c)) { syntax_error(line, why); }
+    }
+
+    auto to_record(std::string_view name, const boiler::constants& c) -> record
+    {
+        auto r = record{};
+        name.copy(r.name, config::max_name_length);
+        r.cycle_time_ms  = c.cycle_time.count();
+        r.capacity       = c.boiler.capacity;
+        r.max_limit      = c.boiler.max_limit;
+        r.max_normal     = c.boiler.max_normal;
+        r.min_normal     = c.boiler.min_normal;
+        r.min_limit      = c.boiler.min_limit;
+        r.max_throughput = c.steam.max_throughput;
+        r.max_gradient   = c.steam.max_gradient;
+        r.min_gradient   = c.steam.min_gradient;
+        r.pump_capacity  = c.pump_capacity;
+        r.critical_low   = c.margins.critical_low;
+        r.critical_high  = c.margins.critical_high;
+        r.link_bytes     = c.link.bytes;
+        r.link_messages  = c.link.messages;
+        r.pump_count     = c.pump_count;
+        return r;
+    }
+
+    auto from_record(const record& r) -> boiler::constants
+    {
+        auto c           = boiler::constants{};
+        c.boiler         = { r.capacity, r.max_limit, r.max_normal, r.min_normal, r.min_limit };
+        c.steam          = { r.max_throughput, r.max_gradient, r.min_gradient };
+        c.pump_capacity  = r.pump_capacity;
+        c.margins        = { r.critical_low, r.critical_high };
+        c.pump_count     = r.pump_count;
+        c.cycle_time     = std::chrono::milliseconds{ r.cycle_time_ms };
+        c.link.messages  = r.link_messages;
+        c.link.bytes     = r.link_bytes;
+        return c;
+    }
+
+    auto record_name(const record& r) -> std::string_view
+    {
+        return { r.name, ::strnlen(r.name, sizeof(r.name)) };
+    }
+
+    // from_record(), refusing what parse() would have.
+    auto checked(const record& r) -> boiler::constants
+    {
+        const auto c = from_record(r);
+        if (const auto* why = problem(c)) {
+            const auto name = record_name(r);
+            throw std::invalid_argument{
+                (name.empty() ? std::string{ "defaults" } : "unit '" + std::string{ name } + "'") +
+                ": " + why
+            };
+        }
+        return c;
+    }
+}
+
+auto boiler::config::parse(std::string_view text) -> fleet
+{
+    struct assignment
+    {
+        std::string_view key;
+        std::string_view value;
+        std::size_t line;
+    };
+    struct section
+    {
+        std::size_t line;
+        std::vector<assignment> assignments;
+    };
+
+    auto defaults = section{};
+    // Applied once the defaults are all known.
+    auto units = std::vector<std::pair<std::string, section>>{};
+    auto* current = &defaults;
+
+    auto line = std::size_t{ 0 };
+    while (!text.empty()) {
+        ++line;
+        const auto eol = text.find('\n');
+        auto l         = text.substr(0, eol);
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+        l = trim(l.substr(0, l.find('#')));
+        if (l.empty()) { continue; }
+
+        if (l.front() == '[') {
+            if (l.back() != ']') { syntax_error(line, "unterminated section"); }
+            const auto name = trim(l.substr(1, l.size() - 2));
+            if (name == "defaults") {
+                current = &defaults;
+            } else if (name.substr(0, 5) == "unit " || name.substr(0, 5) == "unit\t") {
+                const auto unit_name = trim(name.substr(5));
+                if (unit_name.empty()) { syntax_error(line, "unit without a name"); }
+                if (unit_name.size() > max_name_length) {
+                    syntax_error(
+                        line, "unit names are at most " + std::to_string(max_name_length) +
+                                  " characters");
+                }
+                units.push_back({ std::string{ unit_name }, section{ line, {} } });
+                current = &units.back().second;
+            } else {
+                syntax_error(line, "unknown section '" + std::string{ name } + "'");
+            }
+            continue;
+        }
+
+        const auto equals = l.find('=');
+        if (equals == std::string_view::npos) { syntax_error(line, "expected key = value"); }
+        current->assignments.push_back({ trim(l.substr(0, equals)), trim(l.substr(equals + 1)), line });
+    }
+
+    auto f = fleet{};
+    for (const auto& a : defaults.assignments) { set(f.defaults, a.key, a.value, a.line); }
+    check(f.defaults, defaults.line);
+
+    f.units.reserve(units.size());
+    for (auto& [name, s] : units) {
+        auto c = f.defaults;
+        for (const auto& a : s.assignments) { set(c, a.key, a.value, a.line); }
+        check(c, s.line);
+        f.units.push_back({ std::move(name), c });
+    }
+
+    std::sort(f.units.begin(), f.units.end(), [](const unit& a, const unit& b) {
+        return a.name < b.name;
+    });
+    const auto duplicate = std::adjacent_find(
+        f.units.begin(), f.units.end(), [](const unit& a, const unit& b) {
+            return a.name == b.name;
+        });
+    if (duplicate != f.units.end()) {
+        throw std::invalid_argument{ "unit '" + duplicate->name + "' is defined twice" };
+    }
+    return f;
+}
+
+auto boiler::config::read(const std::filesystem::path& path) -> fleet
+{
+    auto in = std::ifstream{ path, std::ios::binary };
+    if (!in) { fail("can't open " + path.string()); }
+    const auto text = std::string{ std::istreambuf_iterator<char>{ in }, {} };
+    return parse(text);
+}
+
+auto boiler::config::compile(const fleet& f, const std::filesystem::path& to) -> void
+{
+    auto h = header{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.byte_order   = byte_order;
+    h.record_bytes = sizeof(record);
+    h.count        = f.units.size();
+    h.defaults     = to_record({}, f.defaults);
+
+    auto records = std::vector<record>{};
+    records.reserve(f.units.size());
+    for (const auto& u : f.units) { records.push_back(to_record(u.name, u.constants)); }
+    std::sort(records.begin(), records.end(), [](const record& a, const record& b) {
+        return record_name(a) < record_name(b);
+    });
+
+    // Written aside and renamed, daemons that have the old file mapped keep
+    // seeing it whole.
+    auto tmp = to;
+    tmp += ".tmp";
+    {
+        auto out = std::ofstream{ tmp, std::ios::binary | std::ios::trunc };
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(
+            reinterpret_cast<const char*>(records.data()),
+            static_cast<std::streamsize>(records.size() * sizeof(record)));
+        out.close();
+        if (!out) { fail("can't write " + tmp.string()); }
+    }
+    std::filesystem::rename(tmp, to);
+}
+
+auto boiler::config::is_compiled(const std::filesystem::path& path) -> bool
+{
+    auto in = std::ifstream{ path, std::ios::binary };
+    char start[sizeof(magic)] = {};
+    in.read(start, sizeof(start));
+    return in && std::memcmp(start, magic, sizeof(magic)) == 0;
+}
+
+boiler::config::image::image(const std::filesystem::path& path)
+{
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { fail("can't open " + path.string()); }
+    bytes = std::filesystem::file_size(path);
+    if (bytes < sizeof(header)) {
+        ::close(fd);
+        throw std::invalid_argument{ path.string() + " is too short for a compiled config" };
+    }
+    auto* mapped = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping outlives the descriptor.
+    ::close(fd);
+    if (mapped == MAP_FAILED) { fail("can't map " + path.string()); }
+    data = static_cast<const std::byte*>(mapped);
+
+    auto h = header{};
+    std::memcpy(&h, data, sizeof(h));
+    const auto invalid = [&](const char* why) {
+        ::munmap(const_cast<std::byte*>(data), bytes);
+        throw std::invalid_argument{ path.string() + ": " + why };
+    };
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0) { invalid("not a compiled config"); }
+    if (h.byte_order != byte_order || h.record_bytes != sizeof(record)) {
+        invalid("compiled for another kind of machine");
+    }
+    if (h.count > (bytes - sizeof(header)) / sizeof(record) ||
+        bytes != sizeof(header) + h.count * sizeof(record)) {
+        invalid("truncated");
+    }
+    count = h.count;
+}
+
+boiler::config::image::~image() { ::munmap(const_cast<std::byte*>(data), bytes); }
+
+namespace {
+    auto record_at(const std::byte* data, std::size_t i) -> record
+    {
+        auto r = record{};
+        std::memcpy(&r, data + sizeof(header) + i * sizeof(record), sizeof(r));
+        return r;
+    }
+}
+
+auto boiler::config::image::defaults() const -> boiler::constants
+{
+    auto h = header{};
+    std::memcpy(&h, data, sizeof(h));
+    return checked(h.defaults);
+}
+
+auto boiler::config::image::name(std::size_t i) const -> std::string_view
+{
+    const auto* at = reinterpret_cast<const char*>(data + sizeof(header) + i * sizeof(record));
+    return { at, ::strnlen(at, max_name_length + 1) };
+}
+
+auto boiler::config::image::at(std::size_t i) const -> boiler::constants
+{
+    return checked(record_at(data, i));
+}
+
+auto boiler::config::image::find(std::string_view unit_name) const
+    -> std::optional<boiler::constants>
+{
+    auto first = std::size_t{ 0 };
+    auto last  = count;
+    while (first < last) {
+        const auto middle = first + (last - first) / 2;
+        if (name(middle) < unit_name) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if (first == count || name(first) != unit_name) { return std::nullopt; }
+    return at(first);
+}
+
+auto boiler::config::load(const std::filesystem::path& path, std::string_view unit_name)
+    -> boiler::constants
+{
+    const auto unknown = [&] {
+        return std::invalid_argument{ "no unit '" + std::string{ unit_name } + "' in " +
+                                      path.string() };
+    };
+
+    if (is_compiled(path)) {
+        const auto compiled = image{ path };
+        if (unit_name.empty()) { return compiled.defaults(); }
+        if (auto c = compiled.find(unit_name)) { return *c; }
+        throw unknown();
+    }
+
+    const auto f = read(path);
+    if (unit_name.empty()) { return f.defaults; }
+    const auto it = std::lower_bound(
+        f.units.begin(), f.units.end(), unit_name, [](const unit& u, std::string_view n) {
+            return u.name < n;
+        });
+    if (it == f.units.end() || it->name != unit_name) { throw unknown(); }
+    return it->constants;
+}
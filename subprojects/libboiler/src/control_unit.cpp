@@ -1,105 +1,550 @@
 #include "boiler/control_unit.hpp"
+#include "boiler/trace.hpp"
+
+#include <algorithm>   // std::remove_if.
+#include <array>
+#include <cstdio>      // std::fprintf.
+#include <cstdlib>     // std::abort.
+#include <stdexcept>   // std::length_error, std::logic_error, std::out_of_range.
+#include <type_traits> // std::is_trivially_copyable.
+#include <utility>     // std::exchange.
+
+namespace {
+    // Bugs in the routines (running out of a fixed capacity, saving a
+    // handler that has no id, expecting a pump that can't exist): thrown
+    // when built with exceptions, fatal when built without (see
+    // meson_options.txt).
+    template<typename Error>
+    [[noreturn]] auto bug(const char* what) -> void
+    {
+#if defined(__cpp_exceptions)
+        throw Error{ what };
+#else
+        std::fprintf(stderr, "libboiler: %s\n", what);
+        std::abort();
+#endif
+    }
+
+    [[noreturn]] auto capacity_exceeded(const char* what) -> void
+    {
+        bug<std::length_error>(what);
+    }
+}
+
+// Only one of the pointers is set, the one of the handler's type.
+struct boiler::control_unit::handler_entry
+{
+    deferred_fn deferred            = nullptr;
+    receipt_fn receipt              = nullptr;
+    msg_handler::missing_fn missing = nullptr;
+    msg_handler::present_fn present = nullptr;
+};
+
+auto boiler::control_unit::handlers() -> const std::array<handler_entry, handler_count>&
+{
+    // In the order of handler_id.
+    static constexpr auto table = std::array<handler_entry, handler_count>{ {
+        {},
+        { .present = &control_unit::on_pump_state },
+        { .present = &control_unit::on_pump_control_state },
+        { .present = &control_unit::on_level },
+        { .present = &control_unit::on_steam },
+        { .receipt = &control_unit::on_pump_repaired },
+        { .receipt = &control_unit::on_steam_boiler_waiting },
+        { .receipt = &control_unit::on_physical_units_ready },
+        { .deferred = &control_unit::check_initial_readings },
+        { .deferred = &control_unit::enter_operational_mode },
+        { .deferred = &control_unit::emergency_stop },
+    } };
+    return table;
+}
+
+namespace {
+    template<typename Table, typename Field, typename Fn>
+    auto find_handler(const Table& table, Field field, Fn f) -> std::size_t
+    {
+        if (f == nullptr) { return 0; }
+        for (auto i = std::size_t{ 1 }; i < table.size(); ++i) {
+            if (table[i].*field == f) { return i; }
+        }
+        bug<std::logic_error>("only control_unit's own handlers can be saved");
+    }
+}
+
+auto boiler::control_unit::id_of(deferred_fn f) -> handler_id
+{
+    return static_cast<handler_id>(find_handler(handlers(), &handler_entry::deferred, f));
+}
+
+auto boiler::control_unit::id_of(receipt_fn f) -> handler_id
+{
+    return static_cast<handler_id>(find_handler(handlers(), &handler_entry::receipt, f));
+}
+
+auto boiler::control_unit::id_of(msg_handler::missing_fn f) -> handler_id
+{
+    return static_cast<handler_id>(find_handler(handlers(), &handler_entry::missing, f));
+}
 
-#include <string_view>
+auto boiler::control_unit::id_of(msg_handler::present_fn f) -> handler_id
+{
+    return static_cast<handler_id>(find_handler(handlers(), &handler_entry::present, f));
+}
 
-boiler::control_unit::control_unit(boiler::constants c) : constants{c}
+boiler::control_unit::control_unit(boiler::constants c)
+    : normal_policy{ c }
+    , link_quality{ c.pump_count }
+    , outbound_queue{ c.link }
+    , constants{ c }
+    , pump_selector{ c }
 {
+    namespace to_program = boiler::messages::to_program;
+
+    const auto reading = [](msg_handler::present_fn on_present) {
+        return msg_handler{
+            .on_missing = nullptr,
+            .on_present = on_present,
+            .on_receipt = nullptr,
+            .pending    = std::nullopt,
+        };
+    };
+    expect<to_program::pump_state>().always(reading(&control_unit::on_pump_state));
+    expect<to_program::pump_control_state>().always(
+        reading(&control_unit::on_pump_control_state));
+    expect<to_program::level>().always(reading(&control_unit::on_level));
+    expect<to_program::steam>().always(reading(&control_unit::on_steam));
+
     switch_mode(mode::initialization);
 }
 
 auto boiler::control_unit::process_messages(std::vector<msg_from_units> messages)
     -> std::vector<msg_to_units>
 {
+    const auto traced = trace::scope{ trace::point::process_messages };
     response.clear();
 
-    handle_expected(messages);
+    // Safety signals go first, nothing else gets to see the messages before.
+    {
+        const auto phase = trace::scope{ trace::point::safety_signals };
+        enter(watchdog::phase::safety_signals);
+        if (safety_counters.observe(messages)) { emergency_stop(); }
+    }
 
-    for (auto& deferred : run_last_handlers) { deferred(); }
-    run_last_handlers.clear();
+    {
+        const auto phase = trace::scope{ trace::point::mailbox };
+        enter(watchdog::phase::mailbox);
+        mailbox.drain([&] { emergency_stop(); }, [&](auto cmd) { apply_command(cmd); });
+    }
+
+    {
+        const auto phase = trace::scope{ trace::point::link_monitor };
+        enter(watchdog::phase::link_monitor);
+        link_quality.observe(messages);
+    }
+    const auto units_were_up = operational();
+
+    {
+        const auto phase = trace::scope{ trace::point::handle_expected };
+        enter(watchdog::phase::handle_expected);
+        handle_expected(messages);
+        check_pump_states();
+    }
+
+    // Deferred functions may defer more functions, those run too.
+    {
+        const auto phase = trace::scope{ trace::point::run_last };
+        enter(watchdog::phase::run_last);
+        for (auto i = std::size_t{ 0 }; i < run_last_count; ++i) {
+            const auto call = trace::scope{ trace::point::run_last_call, static_cast<ta::u32>(i) };
+            (this->*run_last_handlers[i])();
+        }
+        run_last_count = 0;
+    }
+
+    // A transmission failure puts the program into emergency_stop (§1.11).
+    // Checked last so that no handler can leave emergency_stop afterwards,
+    // and only if the units were already up when the cycle started since
+    // they don't have to send everything while initializing.
+    if (units_were_up && !link_quality.complete()) { emergency_stop(); }
+
+    enter(watchdog::phase::mode_routine);
+    if (!ran_mode_routine) { run_mode_routine(); }
+    ran_mode_routine = false;
 
     send(boiler::messages::to_units::mode{ mode_of_operation }).now();
 
+    {
+        const auto phase = trace::scope{ trace::point::schedule };
+        enter(watchdog::phase::schedule);
+        outbound_queue.schedule(response);
+        note_pump_commands();
+    }
+    enter(watchdog::phase::idle);
     return response;
 }
 
-auto boiler::control_unit::emergency_stop() -> void { switch_mode(mode::emergency_stop); }
+auto boiler::control_unit::save() const -> snapshot
+{
+    auto s = snapshot{
+        .mode_of_operation = mode_of_operation,
+        .readings          = readings,
+        .assumptions       = assumptions,
+        .link_quality      = link_quality,
+        .safety_counters   = safety_counters,
+        .outbound_queue    = outbound_queue,
+        .run_last_handlers = {},
+        .run_last_count    = run_last_count,
+        .expectation_count = 0,
+        .expectations      = {},
+    };
+    for (auto i = std::size_t{ 0 }; i < run_last_count; ++i) {
+        s.run_last_handlers[i] = id_of(run_last_handlers[i]);
+    }
+    expectations.for_each_value([&](std::size_t slot, const msg_handler& handler) {
+        s.expectations[s.expectation_count++] = saved_expectation{
+            .slot       = static_cast<ta::u16>(slot),
+            .on_missing = id_of(handler.on_missing),
+            .on_present = id_of(handler.on_present),
+            .on_receipt = id_of(handler.on_receipt),
+            .pending    = handler.pending,
+        };
+    });
+    return s;
+}
 
-auto boiler::control_unit::init_routine() -> void {
-    expect<boiler::messages::to_program::steam_boiler_waiting>().eventually([&](auto msg){
-        // Run last since we don't know if the messages have been handled yet.
-        if(mode_of_operation != mode::initialization) {
-            run_last([&]{
-                // Transmission error (was not expecting this message).
-                emergency_stop();
+auto boiler::control_unit::restore(const snapshot& s) noexcept -> void
+{
+    const auto& table = handlers();
+
+    mode_of_operation = s.mode_of_operation;
+    readings          = s.readings;
+    assumptions       = s.assumptions;
+    link_quality      = s.link_quality;
+    safety_counters   = s.safety_counters;
+    outbound_queue    = s.outbound_queue;
+    for (auto i = std::size_t{ 0 }; i < s.run_last_count; ++i) {
+        run_last_handlers[i] = table[static_cast<std::size_t>(s.run_last_handlers[i])].deferred;
+    }
+    run_last_count = s.run_last_count;
+
+    // Armed again in the order they were saved in, which keeps the order
+    // within every slot.
+    expectations = expectations_t{};
+    for (auto i = std::size_t{ 0 }; i < s.expectation_count; ++i) {
+        const auto& saved = s.expectations[i];
+        expectations.insert(
+            saved.slot,
+            msg_handler{
+                .on_missing = table[static_cast<std::size_t>(saved.on_missing)].missing,
+                .on_present = table[static_cast<std::size_t>(saved.on_present)].present,
+                .on_receipt = table[static_cast<std::size_t>(saved.on_receipt)].receipt,
+                .pending    = saved.pending,
             });
-        } else {
-            run_last([&]{
-                // Check stuff.
-                if (readings.steam_liters_per_sec != 0) {
-                    emergency_stop();
-                    return;
-                }
+    }
+    // As it is between cycles. A unit that has just been built ran its
+    // init routine already and would skip the next mode routine.
+    ran_mode_routine = false;
+}
 
-                if (readings.level_liters > constants.boiler.capacity || readings.level_liters < 0) {
-                    emergency_stop();
-                    return;
-                }
-                
-                if (readings.level_liters > constants.boiler.max_normal) {
-                    send(boiler::messages::to_units::valve{}).now();
-                } else if (readings.level_liters < constants.boiler.min_normal) {
-                    send(boiler::messages::to_units::open_pump{1}).now();
-                } else {
-                    send(boiler::messages::to_units::close_pump{1}).now();
-
-                    send(boiler::messages::to_units::program_ready{}).until_ack([](auto ack){
-                        run_last([&]{
-                            if (assumptions.pump_broken ||
-                                assumptions.pump_control_broken ||
-                                assumptions.steam_broken ||
-                                assumptions.level_broken)
-                            {
-                                switch_mode(mode::degraded);
-                            } else {
-                                switch_mode(mode::normal);
-                            }
-                        });
-                    });
-                }
-            });
+auto boiler::control_unit::restorable(const snapshot& s) noexcept -> bool
+{
+    const auto& table = handlers();
+    // none, or a handler of that type.
+    const auto names = [&](handler_id id, auto field) {
+        const auto i = static_cast<std::size_t>(id);
+        return i == 0 || (i < handler_count && table[i].*field != nullptr);
+    };
+
+    if (s.run_last_count > max_run_last || s.expectation_count > max_expectations) {
+        return false;
+    }
+    for (auto i = std::size_t{ 0 }; i < s.run_last_count; ++i) {
+        if (!names(s.run_last_handlers[i], &handler_entry::deferred)) { return false; }
+    }
+    for (auto i = std::size_t{ 0 }; i < s.expectation_count; ++i) {
+        const auto& saved = s.expectations[i];
+        if (saved.slot >= expectations_t::keys ||
+            !names(saved.on_missing, &handler_entry::missing) ||
+            !names(saved.on_present, &handler_entry::present) ||
+            !names(saved.on_receipt, &handler_entry::receipt)) {
+            return false;
         }
-    });
+    }
+    return true;
 }
 
-auto boiler::control_unit::normal_routine() -> void {
+auto boiler::control_unit::snapshot::used_bytes() const noexcept -> std::size_t
+{
+    const auto* start = reinterpret_cast<const char*>(this);
+    const auto* end   = reinterpret_cast<const char*>(expectations.data() + expectation_count);
+    return static_cast<std::size_t>(end - start);
+}
 
-    if (readings.level_liters > constants.boiler.capacity || readings.level_liters < 0) {
-        switch_mode(mode::rescue);
-    } else if (assumptions.pump_broken ||
-        assumptions.pump_control_broken ||
-        assumptions.steam_broken ||
-        assumptions.level_broken) {
+auto boiler::control_unit::footprint() const noexcept -> memory_footprint
+{
+    const auto* start   = reinterpret_cast<const char*>(this);
+    const auto* hot_end  = reinterpret_cast<const char*>(&normal_policy + 1);
+    return memory_footprint{
+        .size = sizeof(*this),
+        .hot  = static_cast<std::size_t>(hot_end - start),
+        .heap = response.capacity() * sizeof(msg_to_units),
+    };
+}
 
-        switch_mode(mode::degraded);
-    } else if (readings.level_liters > 0.95 * constants.boiler.max_limit || readings.level_liters < 1.5 * constants.boiler.min_limt) {
+static_assert(
+    std::is_trivially_copyable_v<boiler::control_unit::snapshot>,
+    "Snapshots must be copyable with memcpy");
+
+auto boiler::control_unit::emergency_stop() -> void { switch_mode(mode::emergency_stop); }
+
+auto boiler::control_unit::apply_command(operator_command cmd) -> void
+{
+    switch (cmd.k) {
+        case operator_command::kind::open_pump: {
+            send(boiler::messages::to_units::open_pump{ cmd.n }).now();
+        } break;
+        case operator_command::kind::close_pump: {
+            send(boiler::messages::to_units::close_pump{ cmd.n }).now();
+        } break;
+    }
+}
+
+auto boiler::control_unit::on_pump_state(const msg_from_units& msg)
+    -> msg_handler::response
+{
+    const auto& state = std::get<boiler::messages::to_program::pump_state>(msg);
+    if (state.n < readings.pump_states.size()) {
+        readings.pump_states[state.n] = state.state;
+    }
+    return msg_handler::response::keep_listening;
+}
+
+auto boiler::control_unit::on_pump_control_state(const msg_from_units& msg)
+    -> msg_handler::response
+{
+    const auto& state = std::get<boiler::messages::to_program::pump_control_state>(msg);
+    if (state.n < readings.pump_control_states.size()) {
+        readings.pump_control_states[state.n] = state.state;
+    }
+    return msg_handler::response::keep_listening;
+}
+
+auto boiler::control_unit::on_level(const msg_from_units& msg) -> msg_handler::response
+{
+    readings.level_liters = std::get<boiler::messages::to_program::level>(msg).liters;
+    return msg_handler::response::keep_listening;
+}
+
+auto boiler::control_unit::on_steam(const msg_from_units& msg) -> msg_handler::response
+{
+    readings.steam_liters_per_sec =
+        std::get<boiler::messages::to_program::steam>(msg).liters_per_sec;
+    return msg_handler::response::keep_listening;
+}
+
+auto boiler::control_unit::check_pump_states() -> void
+{
+    using boiler::messages::to_program::pump_state;
+    const auto commanded = std::exchange(assumptions.commanded_pumps, 0);
+    if (mode_of_operation == mode::emergency_stop) { return; }
+
+    for (auto n = ta::u8{ 0 }; n < constants.pump_count; ++n) {
+        const auto bit = static_cast<boiler::pump_selection::pump_mask>(1u << n);
+        if (!(commanded & bit) || (assumptions.broken_pumps & bit)) { continue; }
+        const auto opened = readings.pump_states[n] == pump_state::possible_states::open;
+        if (opened == ((assumptions.commanded_open & bit) != 0)) { continue; }
+
+        assumptions.pump_broken  = true;
+        assumptions.broken_pumps = static_cast<boiler::pump_selection::pump_mask>(
+            assumptions.broken_pumps | bit);
+        send(boiler::messages::to_units::pump_failure_detection{ n }).until_ack(nullptr);
+        if (!expecting<boiler::messages::to_program::pump_repaired>(n)) {
+            expect<boiler::messages::to_program::pump_repaired>(n).eventually(
+                &control_unit::on_pump_repaired);
+        }
+    }
+}
+
+auto boiler::control_unit::note_pump_commands() -> void
+{
+    // What went out this cycle, not what the outbound queue held back.
+    for (const auto& msg : response) {
+        auto n    = ta::u8{ 0 };
+        auto open = false;
+        if (const auto* o = std::get_if<boiler::messages::to_units::open_pump>(&msg)) {
+            n    = o->n;
+            open = true;
+        } else if (const auto* c = std::get_if<boiler::messages::to_units::close_pump>(&msg)) {
+            n = c->n;
+        } else {
+            continue;
+        }
+        if (n >= constants.pump_count) { continue; }
+
+        const auto bit              = static_cast<boiler::pump_selection::pump_mask>(1u << n);
+        assumptions.commanded_pumps = static_cast<boiler::pump_selection::pump_mask>(
+            assumptions.commanded_pumps | bit);
+        assumptions.commanded_open  = static_cast<boiler::pump_selection::pump_mask>(
+            open ? assumptions.commanded_open | bit : assumptions.commanded_open & ~bit);
+    }
+}
+
+auto boiler::control_unit::on_pump_repaired(const msg_from_units& msg) -> void
+{
+    const auto n = std::get<boiler::messages::to_program::pump_repaired>(msg).n;
+    send(boiler::messages::to_units::pump_repaired_acknowledgement{ n }).now();
+
+    assumptions.broken_pumps = static_cast<boiler::pump_selection::pump_mask>(
+        assumptions.broken_pumps & ~(1u << n));
+    assumptions.pump_broken  = assumptions.broken_pumps != 0;
+    // Back to normal once nothing else is broken either.
+    if (mode_of_operation == mode::degraded) { run_last(&control_unit::enter_operational_mode); }
+}
+
+auto boiler::control_unit::init_routine() -> void
+{
+    if (!expecting<boiler::messages::to_program::steam_boiler_waiting>()) {
+        expect<boiler::messages::to_program::steam_boiler_waiting>().eventually(
+            &control_unit::on_steam_boiler_waiting);
+    }
+}
+
+auto boiler::control_unit::on_steam_boiler_waiting(const msg_from_units&) -> void
+{
+    // Run last since we don't know if the messages have been handled yet.
+    if (mode_of_operation != mode::initialization) {
+        // Transmission error (was not expecting this message).
+        run_last(&control_unit::emergency_stop);
+    } else {
+        run_last(&control_unit::check_initial_readings);
+    }
+}
+
+auto boiler::control_unit::check_initial_readings() -> void
+{
+    if (readings.steam_liters_per_sec != 0) {
         emergency_stop();
+        return;
+    }
+
+    if (readings.level_liters > constants.boiler.capacity || readings.level_liters < 0) {
+        emergency_stop();
+        return;
+    }
 
+    // Pumps are numbered from 0 (see constants::pump_count): the first
+    // one is there whatever the plant.
+    if (readings.level_liters > constants.boiler.max_normal) {
+        send(boiler::messages::to_units::valve{}).now();
     } else if (readings.level_liters < constants.boiler.min_normal) {
-        send(boiler::messages::to_units::open_pump{1}).now();
+        send(boiler::messages::to_units::open_pump{ 0 }).now();
+    } else {
+        send(boiler::messages::to_units::close_pump{ 0 }).now();
+
+        // Already being sent every cycle if we got here before.
+        if (!expecting<boiler::messages::to_program::physical_units_ready>()) {
+            send(boiler::messages::to_units::program_ready{}).until_ack(
+                &control_unit::on_physical_units_ready);
+        }
+    }
+}
 
-    } else if (readings.level_liters > constants.boiler.max_normal) {
-        send(boiler::messages::to_units::close_pump{1}).now();
+auto boiler::control_unit::on_physical_units_ready(const msg_from_units&) -> void
+{
+    run_last(&control_unit::enter_operational_mode);
+}
+
+auto boiler::control_unit::enter_operational_mode() -> void
+{
+    if (assumptions.pump_broken ||
+        assumptions.pump_control_broken ||
+        assumptions.steam_broken ||
+        assumptions.level_broken)
+    {
+        switch_mode(mode::degraded);
+    } else {
+        switch_mode(mode::normal);
     }
 }
 
-auto boiler::control_unit::degraded_routine() -> void {}
+auto boiler::control_unit::normal_routine() -> void
+{
+    using boiler::policy::action;
+
+    const auto anything_broken = assumptions.pump_broken ||
+                                 assumptions.pump_control_broken ||
+                                 assumptions.steam_broken ||
+                                 assumptions.level_broken;
+
+    switch (normal_policy.decide(readings.level_liters, anything_broken)) {
+        case action::none:
+        case action::undecided: break;
+        // The first pump, as in check_initial_readings().
+        case action::open_pump: {
+            send(boiler::messages::to_units::open_pump{ 0 }).now();
+        } break;
+        case action::close_pump: {
+            send(boiler::messages::to_units::close_pump{ 0 }).now();
+        } break;
+        case action::emergency_stop: {
+            emergency_stop();
+        } break;
+        case action::switch_to_degraded: {
+            switch_mode(mode::degraded);
+        } break;
+        case action::switch_to_rescue: {
+            switch_mode(mode::rescue);
+        } break;
+    }
+}
+
+auto boiler::control_unit::degraded_routine() -> void
+{
+    // Without a level there is nothing to select on.
+    if (assumptions.level_broken) { return; }
+    // A pump stuck open can take the level where the working ones can't
+    // bring it back from: the critical levels stop like in normal mode.
+    using boiler::policy::action;
+    if (normal_policy.decide(readings.level_liters, false) == action::emergency_stop) {
+        emergency_stop();
+        return;
+    }
+
+    using boiler::messages::to_program::pump_state;
+    const auto all     = (1u << constants.pump_count) - 1u;
+    const auto healthy = static_cast<boiler::pump_selection::pump_mask>(all & ~assumptions.broken_pumps);
+    const auto open    = pump_selector.select(
+        healthy,
+        readings.level_liters,
+        assumptions.steam_broken ? std::nullopt : std::optional{ readings.steam_liters_per_sec });
+
+    for (auto n = ta::u8{ 0 }; n < constants.pump_count; ++n) {
+        if (!(healthy >> n & 1u)) { continue; }
+        const auto want   = (open >> n & 1u) != 0;
+        const auto opened = readings.pump_states[n] == pump_state::possible_states::open;
+        if (want && !opened) {
+            send(boiler::messages::to_units::open_pump{ n }).now();
+        } else if (!want && opened) {
+            send(boiler::messages::to_units::close_pump{ n }).now();
+        }
+    }
+}
 
 auto boiler::control_unit::rescue_routine() -> void {}
 
 auto boiler::control_unit::emergency_stop_routine() -> void {}
 
+auto boiler::control_unit::operational() const -> bool
+{
+    return mode_of_operation == mode::normal || mode_of_operation == mode::degraded ||
+           mode_of_operation == mode::rescue;
+}
+
 auto boiler::control_unit::run_mode_routine() -> void
 {
+    const auto traced =
+        trace::scope{ trace::point::mode_routine, static_cast<ta::u32>(mode_of_operation) };
+    ran_mode_routine = true;
     switch (mode_of_operation) {
         case mode::initialization: {
             init_routine();
@@ -119,54 +564,99 @@ auto boiler::control_unit::run_mode_routine() -> void
     }
 }
 
-auto boiler::control_unit::run_last(std::function<void(void)> func) -> void
+auto boiler::control_unit::run_last(deferred_fn func) -> void
 {
-    run_last_handlers.push_back(std::move(func));
+    if (run_last_count == max_run_last) {
+        capacity_exceeded("too many functions deferred in a single cycle");
+    }
+    run_last_handlers[run_last_count++] = func;
 }
 
-auto boiler::control_unit::handle_expected(std::vector<msg_from_units>& messages) -> void
+auto boiler::control_unit::arm(std::size_t slot, const msg_handler& handler)
+    -> expectation_handle
 {
-    auto unhandled = std::vector<std::string_view>(expected_handlers.size());
-    for (const auto& it : expected_handlers) { unhandled.push_back(it.first); }
-
-    auto unlistened = std::vector<std::string_view>(expected_handlers.size());
-
-    const auto handle_message = [&](auto msg) {
-        auto msgname = limbo::type_name<decltype(msg)>();
+    if (slot == no_slot) { bug<std::out_of_range>("there is no pump past max_pumps to expect"); }
+    const auto h = expectations.insert(slot, handler);
+    if (!h) { capacity_exceeded("too many expectations armed at once"); }
+    return *h;
+}
 
-        const auto& it = expected_handlers.find(msgname);
-        if (it == expected_handlers.end()) { return false; }
+auto boiler::control_unit::cancel(expectation_handle h) -> bool { return expectations.erase(h); }
 
-        unhandled.erase(std::find(unhandled.begin(), unhandled.end(), it->first));
+auto boiler::control_unit::handle_expected(std::vector<msg_from_units>& messages) -> void
+{
+    // Only the expectations armed before we start take part in this cycle,
+    // any expectation armed while handling it has to wait for the next.
+    const auto cutoff = expectations.stamp();
+
+    // By node, whether its expectation got a message this cycle.
+    auto received = std::array<bool, max_expectations>{};
+
+    const auto handle_message = [&](const msg_from_units& msg) {
+        auto consumed = false; // By a one-shot expectation.
+        auto handled  = false;
+
+        const auto id = boiler::messages::id_of_msg(msg);
+        const auto handle_slot = [&](std::size_t slot) {
+            expectations.for_each(slot, cutoff, [&](expectation_handle h, msg_handler& handler) {
+                if (handler.on_present) {
+                    handled = received[h.index] = true;
+                    const auto fired = trace::scope{ trace::point::on_present, id };
+                    if ((this->*handler.on_present)(msg) == msg_handler::response::unlisten) {
+                        expectations.erase(h);
+                    }
+                } else if (!consumed) {
+                    consumed = handled = received[h.index] = true;
+                    // Erased before running so the continuation can arm the
+                    // same expectation again.
+                    const auto on_receipt = handler.on_receipt;
+                    expectations.erase(h);
+                    if (on_receipt) {
+                        const auto fired = trace::scope{ trace::point::on_receipt, id };
+                        (this->*on_receipt)(msg);
+                    }
+                }
+            });
+        };
 
-        if (it->second.on_present(msg) == msg_handler::response::unlisten) {
-            unlistened.push_back(msgname);
+        // The expectations for this message's pump come first, a pump past
+        // max_pumps has none.
+        if (const auto n = boiler::messages::pump_of_msg(msg)) {
+            if (const auto slot = slot_of(id, n); slot != no_slot) { handle_slot(slot); }
         }
+        handle_slot(slot_of(id, std::nullopt));
 
-        return true;
+        return handled;
     };
 
-    for (auto it = messages.begin(); it != messages.end();) {
-        auto erase = std::visit(handle_message, *it);
-        if (erase) { it = messages.erase(it); }
-        if (it != messages.end()) { ++it; }
-    }
-
-    for (const auto& missing_message : unhandled) {
-        const auto& it = expected_handlers.find(missing_message);
-
-        if (it->second.on_missing() == msg_handler::response::unlisten) {
-            unlistened.push_back(it->first);
-        }
-    }
-
-    for (const auto& msgname : unlistened) {
-        expected_handlers.erase(expected_handlers.find(msgname));
+    messages.erase(
+        std::remove_if(messages.begin(), messages.end(), handle_message), messages.end());
+
+    for (auto slot = expectations.next_key(0); slot < expectations_t::keys;
+         slot      = expectations.next_key(slot + 1)) {
+        const auto id = static_cast<ta::u32>(slot / slots_per_message);
+        expectations.for_each(slot, cutoff, [&](expectation_handle h, msg_handler& handler) {
+            if (received[h.index]) { return; }
+            if (handler.pending) {
+                response.push_back(*handler.pending);
+            } else if (handler.on_missing) {
+                const auto fired = trace::scope{ trace::point::on_missing, id };
+                if ((this->*handler.on_missing)() == msg_handler::response::unlisten) {
+                    expectations.erase(h);
+                }
+            }
+        });
     }
 }
 
 auto boiler::control_unit::switch_mode(mode newmode) -> void
 {
+    // There's no way out of emergency_stop, whatever a handler that ran
+    // after the stop thinks.
+    if (mode_of_operation == mode::emergency_stop && newmode != mode::emergency_stop) {
+        return;
+    }
+    const auto traced = trace::scope{ trace::point::switch_mode, static_cast<ta::u32>(newmode) };
     mode_of_operation = newmode;
     run_mode_routine();
 }
@@ -0,0 +1,627 @@
+#include "boiler/fleet.hpp"
+
+#include <algorithm> // std::max, std::max_element, std::min_element.
+#include <array>
+#include <cerrno>
+#include <cmath> // std::abs.
+#include <cstring> // std::memcpy.
+#include <memory>  // std::unique_ptr.
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread> // std::this_thread::sleep_for.
+#include <unordered_map>
+
+#include <poll.h>
+#include <signal.h>     // kill.
+#include <sys/socket.h> // socketpair, send.
+#include <sys/wait.h>   // waitpid.
+#include <unistd.h>     // fork, read, close.
+
+#include "boiler/wire.hpp"
+
+namespace {
+    namespace fleet = boiler::fleet;
+    namespace wire  = boiler::wire;
+    using clock     = std::chrono::steady_clock;
+    using snapshot  = boiler::control_unit::snapshot;
+
+    enum class kind : ta::u8
+    {
+        adopt = 1, // u32 boiler | snapshot
+        release,   // u32 boiler
+        cycle,     // u32 cycle | u32 count | count datagrams
+        done,      // u32 cycle | u32 count | count (u32 cost in ns | changes | datagram)
+    };
+    // What changed in a snapshot since the one sent before it (or adopted):
+    //
+    //     u32 runs | runs (u32 offset | u32 length | length bytes)
+    struct change
+    {
+        ta::u32 offset;
+        ta::u32 length;
+        const std::byte* bytes;
+    };
+
+    // Enough for any message of either direction in the wire format.
+    constexpr std::size_t max_message = 16;
+    // Anything bigger is taken for garbage.
+    constexpr ta::u32 max_frame = ta::u32{ 1 } << 30;
+
+    auto fail(const std::string& what) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    // The size is filled in by bytes().
+    class frame_builder
+    {
+    public:
+        explicit frame_builder(kind k)
+            : frame(5)
+        {
+            frame[4] = static_cast<std::byte>(k);
+        }
+
+        auto u32(ta::u32 v) -> void
+        {
+            const auto at = frame.size();
+            frame.resize(at + 4);
+            wire::detail::put(frame.data() + at, v);
+        }
+
+        auto raw(const void* from, std::size_t n) -> void
+        {
+            const auto at = frame.size();
+            frame.resize(at + n);
+            std::memcpy(frame.data() + at, from, n);
+        }
+
+        template<typename Any>
+        auto datagram(wire::header h, const std::vector<Any>& messages) -> bool
+        {
+            const auto at = frame.size();
+            frame.resize(at + wire::header_size + max_message * messages.size());
+            const auto* end =
+                wire::encode_datagram(frame.data() + at, frame.data() + frame.size(), h, messages);
+            if (end == nullptr) {
+                frame.resize(at);
+                return false;
+            }
+            frame.resize(static_cast<std::size_t>(end - frame.data()));
+            return true;
+        }
+
+        auto bytes() -> const std::vector<std::byte>&
+        {
+            wire::detail::put(frame.data(), static_cast<ta::u32>(frame.size() - 4));
+            return frame;
+        }
+
+    private:
+        std::vector<std::byte> frame;
+    };
+
+    // Every read fails once past the end.
+    class frame_reader
+    {
+    public:
+        explicit frame_reader(const std::vector<std::byte>& frame)
+            : at{ frame.data() }
+            , end{ frame.data() + frame.size() }
+        {}
+
+        auto next_kind(kind& k) -> bool
+        {
+            if (end - at < 1) { return false; }
+            k = static_cast<kind>(*at++);
+            return true;
+        }
+
+        auto u32(ta::u32& v) -> bool
+        {
+            if (end - at < 4) { return false; }
+            v = wire::detail::get(at);
+            at += 4;
+            return true;
+        }
+
+        // Where n bytes start, nullptr if there aren't as many left.
+        auto raw(std::size_t n) -> const std::byte*
+        {
+            if (end - at < static_cast<std::ptrdiff_t>(n)) { return nullptr; }
+            const auto* first = at;
+            at += n;
+            return first;
+        }
+
+        template<typename Any>
+        auto datagram(wire::header& h, std::vector<Any>& out) -> bool
+        {
+            out.clear();
+            const auto* next = wire::decode_datagram(at, end, h, out);
+            if (next == nullptr) { return false; }
+            at = next;
+            return true;
+        }
+
+        auto finished() const -> bool { return at == end; }
+
+    private:
+        const std::byte* at;
+        const std::byte* end;
+    };
+
+    auto write_all(int fd, const std::vector<std::byte>& bytes) -> bool
+    {
+        auto sent = std::size_t{ 0 };
+        while (sent < bytes.size()) {
+            // No SIGPIPE for a peer that died, it's told by the result.
+            const auto n = ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) { continue; }
+                return false;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    // Gives up at `deadline`, time_point::max() for never.
+    auto read_exact(int fd, std::byte* at, std::size_t n, clock::time_point deadline) -> bool
+    {
+        while (n > 0) {
+            // Past the deadline, what's already there is still read: the
+            // answers are collected one after the other, one that came in
+            // while an earlier worker was waited for is on time.
+            auto timeout = -1;
+            if (deadline != clock::time_point::max()) {
+                const auto left =
+                    std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now());
+                timeout = static_cast<int>(std::max<ta::i64>(left.count(), 0));
+            }
+            auto p           = pollfd{};
+            p.fd             = fd;
+            p.events         = POLLIN;
+            const auto ready = ::poll(&p, 1, timeout);
+            if (ready < 0 && errno == EINTR) { continue; }
+            if (ready <= 0) { return false; }
+
+            const auto got = ::read(fd, at, n);
+            if (got < 0 && errno == EINTR) { continue; }
+            if (got <= 0) { return false; }
+            at += got;
+            n -= static_cast<std::size_t>(got);
+        }
+        return true;
+    }
+
+    // The frame without its size.
+    auto read_frame(int fd, std::vector<std::byte>& frame, clock::time_point deadline) -> bool
+    {
+        auto size = std::array<std::byte, 4>{};
+        if (!read_exact(fd, size.data(), size.size(), deadline)) { return false; }
+        const auto n = wire::detail::get(size.data());
+        if (n == 0 || n > max_frame) { return false; }
+        frame.resize(n);
+        return read_exact(fd, frame.data(), n, deadline);
+    }
+
+    // Runs of changed bytes less than a run header apart go as one.
+    auto put_changes(frame_builder& out, const snapshot& was, const snapshot& now) -> void
+    {
+        constexpr auto gap = std::size_t{ 8 };
+        const auto* a      = reinterpret_cast<const std::byte*>(&was);
+        const auto* b      = reinterpret_cast<const std::byte*>(&now);
+
+        auto runs = std::vector<change>{};
+        for (auto i = std::size_t{ 0 }; i < sizeof(snapshot); ++i) {
+            if (a[i] == b[i]) { continue; }
+            auto last = i;
+            for (auto j = i + 1; j < sizeof(snapshot) && j - last <= gap; ++j) {
+                if (a[j] != b[j]) { last = j; }
+            }
+            runs.push_back({ static_cast<ta::u32>(i), static_cast<ta::u32>(last + 1 - i), b + i });
+            i = last;
+        }
+
+        out.u32(static_cast<ta::u32>(runs.size()));
+        for (const auto& run : runs) {
+            out.u32(run.offset);
+            out.u32(run.length);
+            out.raw(run.bytes, run.length);
+        }
+    }
+
+    auto read_changes(frame_reader& in, std::vector<change>& out) -> bool
+    {
+        auto runs = ta::u32{};
+        if (!in.u32(runs) || runs > sizeof(snapshot)) { return false; }
+        out.resize(runs);
+        for (auto& run : out) {
+            if (!in.u32(run.offset) || !in.u32(run.length) || run.offset > sizeof(snapshot) ||
+                run.length > sizeof(snapshot) - run.offset) {
+                return false;
+            }
+            run.bytes = in.raw(run.length);
+            if (run.bytes == nullptr) { return false; }
+        }
+        return true;
+    }
+
+    auto apply_changes(snapshot& s, const std::vector<change>& changes) -> void
+    {
+        auto* at = reinterpret_cast<std::byte*>(&s);
+        for (const auto& run : changes) { std::memcpy(at + run.offset, run.bytes, run.length); }
+    }
+}
+
+auto boiler::fleet::plan_moves(
+    const std::vector<float>& costs,
+    const std::vector<std::size_t>& owners,
+    std::size_t workers,
+    float imbalance) -> std::vector<move>
+{
+    auto moves = std::vector<move>{};
+    if (workers < 2) { return moves; }
+
+    auto loads = std::vector<float>(workers, 0);
+    auto total = 0.0f;
+    for (auto b = std::size_t{ 0 }; b < costs.size(); ++b) {
+        if (owners[b] >= workers) { continue; }
+        loads[owners[b]] += costs[b];
+        total += costs[b];
+    }
+    const auto limit = total / static_cast<float>(workers) * (1 + imbalance);
+
+    // Every move narrows the gap between two workers, so this ends; the
+    // bound is only there for costs that aren't numbers.
+    auto owner = owners;
+    for (auto round = std::size_t{ 0 }; round < costs.size(); ++round) {
+        const auto first = loads.begin();
+        const auto hi = static_cast<std::size_t>(std::max_element(first, loads.end()) - first);
+        const auto lo = static_cast<std::size_t>(std::min_element(first, loads.end()) - first);
+        if (!(loads[hi] > limit)) { break; }
+
+        // Moving a boiler of cost c leaves a gap of |gap - 2c|.
+        const auto gap = loads[hi] - loads[lo];
+        auto best      = costs.size();
+        auto best_gap  = gap;
+        for (auto b = std::size_t{ 0 }; b < costs.size(); ++b) {
+            if (owner[b] != hi || !(costs[b] > 0)) { continue; }
+            const auto left = std::abs(gap - 2 * costs[b]);
+            if (left < best_gap) {
+                best     = b;
+                best_gap = left;
+            }
+        }
+        if (best == costs.size()) { break; }
+
+        loads[hi] -= costs[best];
+        loads[lo] += costs[best];
+        owner[best] = lo;
+        moves.push_back({ static_cast<boiler_id>(best), hi, lo });
+    }
+    return moves;
+}
+
+auto boiler::fleet::serve(int fd, const boiler::constants& c, const unit_factory& make_unit) -> int
+{
+    // With the snapshot it sent last, what the next one is sent against.
+    struct hosted
+    {
+        std::unique_ptr<control_unit> unit;
+        snapshot sent;
+    };
+    auto units    = std::unordered_map<boiler_id, hosted>{};
+    auto frame    = std::vector<std::byte>{};
+    auto messages = std::vector<messages::to_program::any>{};
+
+    while (read_frame(fd, frame, clock::time_point::max())) {
+        auto in = frame_reader{ frame };
+        auto k  = kind{};
+        if (!in.next_kind(k)) { return 2; }
+
+        switch (k) {
+            case kind::adopt: {
+                auto id         = boiler_id{};
+                auto s          = snapshot{};
+                const auto* raw = in.u32(id) ? in.raw(sizeof(s)) : nullptr;
+                if (raw == nullptr || !in.finished()) { return 2; }
+                std::memcpy(&s, raw, sizeof(s));
+                if (!control_unit::restorable(s)) { return 2; }
+                auto unit = make_unit ? make_unit(id, c) : std::make_unique<control_unit>(c);
+                unit->restore(s);
+                units[id] = hosted{ std::move(unit), s };
+            } break;
+            case kind::release: {
+                auto id = boiler_id{};
+                if (!in.u32(id) || !in.finished()) { return 2; }
+                units.erase(id);
+            } break;
+            case kind::cycle: {
+                auto cycle = ta::u32{};
+                auto count = ta::u32{};
+                if (!in.u32(cycle) || !in.u32(count)) { return 2; }
+
+                auto out = frame_builder{ kind::done };
+                out.u32(cycle);
+                out.u32(count);
+                for (auto i = ta::u32{ 0 }; i < count; ++i) {
+                    auto h = wire::header{};
+                    if (!in.datagram(h, messages)) { return 2; }
+                    const auto found = units.find(h.boiler);
+                    if (found == units.end()) { return 2; }
+                    auto& [unit, sent_last] = found->second;
+
+                    const auto start = clock::now();
+                    const auto sent  = unit->process_messages(std::move(messages));
+                    const auto took  = std::chrono::nanoseconds{ clock::now() - start }.count();
+                    const auto s     = unit->save();
+
+                    out.u32(static_cast<ta::u32>(std::min<ta::i64>(took, 0xffffffff)));
+                    put_changes(out, sent_last, s);
+                    sent_last = s;
+                    h.cycle   = cycle;
+                    if (!out.datagram(h, sent)) { return 2; }
+                }
+                if (!in.finished()) { return 2; }
+                if (!write_all(fd, out.bytes())) { return 0; }
+            } break;
+            default: return 2;
+        }
+    }
+    return 0;
+}
+
+boiler::fleet::coordinator::coordinator(const boiler::constants& c, std::size_t boilers, options o)
+    : constants{ c }
+    , opts{ o }
+    , pool(o.workers)
+    , owners(boilers)
+    , costs(boilers, 0)
+    , snapshots(boilers, control_unit{ c }.save())
+{
+    if (o.workers == 0) { throw std::invalid_argument{ "a fleet needs at least one worker" }; }
+    for (auto b = std::size_t{ 0 }; b < boilers; ++b) { owners[b] = b % o.workers; }
+    for (auto w = std::size_t{ 0 }; w < pool.size(); ++w) { pool[w] = spawn(shard(w)); }
+}
+
+boiler::fleet::coordinator::~coordinator()
+{
+    // A closed socket is how a worker is told to exit. One that's stopped,
+    // or stuck in a cycle, never reads it. Probes are only left if
+    // recover() threw.
+    for (auto& p : probes) { reap(p); }
+    for (auto& w : pool) {
+        if (w.fd >= 0) { ::close(w.fd); }
+    }
+    const auto until = clock::now() + opts.deadline;
+    for (auto& w : pool) {
+        if (w.pid <= 0) { continue; }
+        while (true) {
+            const auto done = ::waitpid(w.pid, nullptr, WNOHANG);
+            if (done > 0 || (done < 0 && errno != EINTR)) { break; }
+            if (clock::now() >= until) {
+                ::kill(w.pid, SIGKILL);
+                ::waitpid(w.pid, nullptr, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+    }
+}
+
+auto boiler::fleet::coordinator::shard(std::size_t w) const -> std::vector<boiler_id>
+{
+    auto boilers = std::vector<boiler_id>{};
+    for (auto b = boiler_id{ 0 }; b < owners.size(); ++b) {
+        if (owners[b] == w) { boilers.push_back(b); }
+    }
+    return boilers;
+}
+
+auto boiler::fleet::coordinator::spawn(const std::vector<boiler_id>& boilers) -> worker
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) { fail("can't create a worker's socket"); }
+
+    const auto pid = ::fork();
+    if (pid < 0) {
+        const auto error = errno;
+        ::close(fds[0]);
+        ::close(fds[1]);
+        errno = error;
+        fail("can't fork a worker");
+    }
+    if (pid == 0) {
+        // Only its own socket kept open, or the coordinator wouldn't see
+        // the others close when their workers die.
+        ::close(fds[0]);
+        for (const auto* group : { &pool, &probes }) {
+            for (const auto& other : *group) {
+                if (other.fd >= 0) { ::close(other.fd); }
+            }
+        }
+        ::_exit(serve(fds[1], constants, opts.make_unit));
+    }
+
+    ::close(fds[1]);
+    const auto w = worker{ .pid = pid, .fd = fds[0] };
+    // Failures show in the next cycle.
+    for (const auto b : boilers) { adopt(w, b); }
+    return w;
+}
+
+auto boiler::fleet::coordinator::reap(worker& dead) -> void
+{
+    if (dead.fd >= 0) { ::close(dead.fd); }
+    if (dead.pid > 0) {
+        ::kill(dead.pid, SIGKILL);
+        ::waitpid(dead.pid, nullptr, 0);
+    }
+    dead = worker{};
+}
+
+auto boiler::fleet::coordinator::adopt(const worker& w, boiler_id b) -> bool
+{
+    auto frame = frame_builder{ kind::adopt };
+    frame.u32(b);
+    frame.raw(&snapshots[b], sizeof(snapshot));
+    return write_all(w.fd, frame.bytes());
+}
+
+auto boiler::fleet::coordinator::send_cycle(
+    const worker& w,
+    const std::vector<boiler_id>& boilers,
+    const inputs& in) -> bool
+{
+    auto frame = frame_builder{ kind::cycle };
+    frame.u32(cycle);
+    frame.u32(static_cast<ta::u32>(boilers.size()));
+    for (const auto b : boilers) {
+        // Checked by step(), can't fail.
+        frame.datagram(
+            wire::header{ .boiler = b, .cycle = cycle, .acked = 0, .count = 0, .flags = 0 }, in[b]);
+    }
+    return write_all(w.fd, frame.bytes());
+}
+
+auto boiler::fleet::coordinator::receive_cycle(
+    const worker& w,
+    std::size_t owner,
+    clock::time_point deadline,
+    outputs& out) -> bool
+{
+    auto frame = std::vector<std::byte>{};
+    if (!read_frame(w.fd, frame, deadline)) { return false; }
+
+    auto in       = frame_reader{ frame };
+    auto k        = kind{};
+    auto answered = ta::u32{};
+    auto count    = ta::u32{};
+    if (!in.next_kind(k) || k != kind::done || !in.u32(answered) || answered != cycle ||
+        !in.u32(count)) {
+        return false;
+    }
+
+    // Nothing is committed unless the whole answer is valid.
+    struct answer
+    {
+        boiler_id boiler;
+        ta::u32 ns;
+        std::vector<change> changes;
+        std::vector<messages::to_units::any> sent;
+    };
+    auto answers = std::vector<answer>(count);
+    for (auto& a : answers) {
+        auto h = wire::header{};
+        if (!in.u32(a.ns) || !read_changes(in, a.changes) || !in.datagram(h, a.sent)) {
+            return false;
+        }
+        if (h.boiler >= owners.size() || owners[h.boiler] != owner) { return false; }
+        a.boiler = h.boiler;
+    }
+    if (!in.finished()) { return false; }
+
+    for (auto& a : answers) {
+        apply_changes(snapshots[a.boiler], a.changes);
+        const auto ns  = static_cast<float>(a.ns);
+        auto& average  = costs[a.boiler];
+        average        = average == 0 ? ns : average + 0.25f * (ns - average);
+        out[a.boiler]  = std::move(a.sent);
+    }
+    return true;
+}
+
+auto boiler::fleet::coordinator::step(const inputs& in) -> outputs
+{
+    if (in.size() != owners.size()) {
+        throw std::invalid_argument{ "step needs the messages of every boiler" };
+    }
+    for (const auto& messages : in) {
+        if (messages.size() > 255) {
+            throw std::invalid_argument{ "too many messages for a boiler in a cycle" };
+        }
+    }
+
+    ++cycle;
+    ++counters.cycles;
+    auto out = outputs(owners.size());
+    for (const auto o : owners) { counters.lost += o == quarantine; }
+
+    // Everyone works on the cycle at once, then the answers are collected.
+    const auto deadline = clock::now() + opts.deadline;
+    auto sent           = std::vector<bool>(pool.size());
+    for (auto w = std::size_t{ 0 }; w < pool.size(); ++w) {
+        sent[w] = send_cycle(pool[w], shard(w), in);
+    }
+    auto failed = std::vector<std::size_t>{};
+    for (auto w = std::size_t{ 0 }; w < pool.size(); ++w) {
+        if (!sent[w] || !receive_cycle(pool[w], w, deadline, out)) { failed.push_back(w); }
+    }
+    // The boilers of a failed worker run the cycle again, from where they
+    // were at the end of the last one.
+    if (!failed.empty()) { recover(failed, in, out); }
+
+    if (opts.rebalance_interval != 0 && cycle % opts.rebalance_interval == 0) { rebalance(); }
+    return out;
+}
+
+auto boiler::fleet::coordinator::recover(
+    const std::vector<std::size_t>& failed,
+    const inputs& in,
+    outputs& out) -> void
+{
+    // A probe per boiler, all at once: whether the boilers crash or hang,
+    // and however many there are, finding the ones that do takes a
+    // deadline.
+    auto suspects = std::vector<boiler_id>{};
+    for (const auto w : failed) {
+        reap(pool[w]);
+        for (const auto b : shard(w)) {
+            suspects.push_back(b);
+            probes.push_back(spawn({ b }));
+        }
+    }
+    auto sent = std::vector<bool>(probes.size());
+    for (auto i = std::size_t{ 0 }; i < probes.size(); ++i) {
+        sent[i] = send_cycle(probes[i], { suspects[i] }, in);
+    }
+    const auto deadline = clock::now() + opts.deadline;
+    for (auto i = std::size_t{ 0 }; i < probes.size(); ++i) {
+        if (sent[i] && receive_cycle(probes[i], owners[suspects[i]], deadline, out)) { continue; }
+        owners[suspects[i]] = quarantine;
+        ++counters.quarantined;
+        ++counters.lost;
+    }
+    for (auto& p : probes) { reap(p); }
+    probes.clear();
+
+    for (const auto w : failed) {
+        pool[w] = spawn(shard(w));
+        ++counters.restarts;
+    }
+}
+
+auto boiler::fleet::coordinator::rebalance() -> void
+{
+    for (const auto& m : plan_moves(costs, owners, pool.size(), opts.imbalance)) {
+        // Failures show in the next cycle.
+        auto frame = frame_builder{ kind::release };
+        frame.u32(m.boiler);
+        write_all(pool[m.from].fd, frame.bytes());
+
+        owners[m.boiler] = m.to;
+        adopt(pool[m.to], m.boiler);
+        ++counters.moved;
+    }
+}
+
+auto boiler::fleet::coordinator::readmit(boiler_id b) -> void
+{
+    if (owners[b] != quarantine) { return; }
+    // Failures show in the next cycle.
+    owners[b] = b % pool.size();
+    adopt(pool[owners[b]], b);
+}
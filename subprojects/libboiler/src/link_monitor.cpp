@@ -0,0 +1,88 @@
+#include "boiler/link_monitor.hpp"
+
+#include <algorithm> // std::min.
+#include <bit>       // std::popcount.
+#include <variant>
+
+static_assert(boiler::link_monitor::window == 64, "The history of a slot is a ta::u64");
+static_assert(boiler::max_pumps <= 16, "Pump arrivals are a ta::u16");
+
+boiler::link_monitor::link_monitor(ta::u8 pumps)
+    : pump_count{ static_cast<ta::u8>(std::min<std::size_t>(pumps, max_pumps)) }
+{}
+
+auto boiler::link_monitor::slots_of(periodic type) const -> std::size_t
+{
+    switch (type) {
+        case periodic::pump_state:
+        case periodic::pump_control_state: return pump_count;
+        case periodic::level:
+        case periodic::steam: return 1;
+    }
+    return 0;
+}
+
+auto boiler::link_monitor::observe(const std::vector<messages::from_units::any>& messages)
+    -> void
+{
+    namespace to_program = boiler::messages::to_program;
+
+    arrivals = {};
+    const auto mark = [&](periodic type, ta::u8 n) {
+        if (n < slots_of(type)) {
+            arrivals[index(type)] = static_cast<ta::u16>(arrivals[index(type)] | (1u << n));
+        }
+    };
+    for (const auto& msg : messages) {
+        if (const auto* p = std::get_if<to_program::pump_state>(&msg)) {
+            mark(periodic::pump_state, p->n);
+        } else if (const auto* c = std::get_if<to_program::pump_control_state>(&msg)) {
+            mark(periodic::pump_control_state, c->n);
+        } else if (std::holds_alternative<to_program::level>(msg)) {
+            mark(periodic::level, 0);
+        } else if (std::holds_alternative<to_program::steam>(msg)) {
+            mark(periodic::steam, 0);
+        }
+    }
+
+    // Constant work from here on: at most periodic_count * max_pumps slots.
+    const auto window_full = observed_cycles >= window;
+    ++observed_cycles;
+    arrived_last_cycle = 0;
+    missing_last_cycle = 0;
+
+    for (auto t = std::size_t{ 0 }; t < periodic_count; ++t) {
+        const auto type  = static_cast<periodic>(t);
+        const auto slots = slots_of(type);
+        auto& counter    = counters[t];
+
+        for (auto slot = std::size_t{ 0 }; slot < slots; ++slot) {
+            const auto missing  = ta::u64{ ((static_cast<unsigned>(arrivals[t]) >> slot) & 1u) == 0 };
+            const auto dropping = window_full ? (history[t][slot] >> (window - 1)) & 1u : 0u;
+            history[t][slot]    = (history[t][slot] << 1) | missing;
+
+            counter.missing_in_window = static_cast<ta::u32>(
+                counter.missing_in_window + missing - dropping);
+            counter.missing += missing;
+            missing_last_cycle += static_cast<ta::u32>(missing);
+        }
+        counter.expected += slots;
+        counter.expected_in_window = static_cast<ta::u32>(
+            std::min<ta::u64>(observed_cycles, window) * slots);
+        arrived_last_cycle += static_cast<ta::u32>(std::popcount(arrivals[t]));
+    }
+
+    incomplete_cycles = missing_last_cycle == 0 ? 0 : incomplete_cycles + 1;
+}
+
+auto boiler::link_monitor::arrived(periodic type, ta::u8 n) const -> bool
+{
+    return ((static_cast<unsigned>(arrivals[index(type)]) >> n) & 1u) != 0;
+}
+
+auto boiler::link_monitor::loss_rate(periodic type) const -> float
+{
+    const auto& c = counters[index(type)];
+    if (c.expected_in_window == 0) { return 0; }
+    return static_cast<float>(c.missing_in_window) / static_cast<float>(c.expected_in_window);
+}
@@ -1,14 +1,12 @@
 #include "boiler/messages.hpp"
+#include "boiler/message_format.hpp" // The enum name tables.
 
 #include <type_traits> // std::underlying_type.
 
 namespace boiler::messages::to_units {
     auto operator<<(std::ostream& os, const mode::possible_modes& val) -> std::ostream&
     {
-        static constexpr const char* repr[] = {
-            "initialization", "normal", "degraded", "rescue", "emergency_stop",
-        };
-        os << repr[static_cast<std::underlying_type<mode::possible_modes>::type>(val)];
+        os << mode_names[static_cast<std::underlying_type<mode::possible_modes>::type>(val)];
         return os;
     }
 }
@@ -17,15 +15,26 @@ namespace boiler::messages::to_program {
     auto operator<<(std::ostream& os, const pump_state::possible_states& val)
         -> std::ostream&
     {
-        os << (val == pump_state::possible_states::open ? "open" : "closed");
+        os << pump_state_names[static_cast<std::size_t>(val)];
         return os;
     }
     auto operator<<(std::ostream& os, const pump_control_state::possible_states& val)
         -> std::ostream&
     {
-        os
-            << (val == pump_control_state::possible_states::flowing ? "flowing"
-                                                                    : "not_flowing");
+        os << pump_control_state_names[static_cast<std::size_t>(val)];
         return os;
     }
-}
\ No newline at end of file
+}
+
+namespace boiler::messages {
+    auto format_to(char* first, char* last, const to_units::any& msg)
+        -> std::to_chars_result
+    {
+        return std::visit([&](const auto& m) { return format_to(first, last, m); }, msg);
+    }
+    auto format_to(char* first, char* last, const to_program::any& msg)
+        -> std::to_chars_result
+    {
+        return std::visit([&](const auto& m) { return format_to(first, last, m); }, msg);
+    }
+}
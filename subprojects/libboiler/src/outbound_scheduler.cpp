@@ -0,0 +1,104 @@
+#include "boiler/outbound_scheduler.hpp"
+
+#include <algorithm> // std::max.
+
+boiler::outbound::scheduler::scheduler(boiler::constants::link_budget b)
+    : budget{ b }
+{}
+
+auto boiler::outbound::scheduler::enqueue(const msg_to_units& msg) -> void
+{
+    const auto id  = boiler::messages::id_of_msg(msg);
+    const auto p   = static_cast<std::size_t>(priorities[id]);
+    auto& q        = positions[p];
+    auto& counters = class_stats_of[p];
+
+    // A newer message for the same type and pump replaces the waiting one.
+    // Not for actuation, where the order of the commands matters: there a
+    // pump command is only dropped when the last one waiting for its pump
+    // is the same, which the routines send again every cycle until the
+    // pump does it. The valve has no pump, each command toggles it.
+    const auto pump      = boiler::messages::pump_of_msg(msg);
+    const auto coalesces = priorities[id] != priority::actuation;
+    for (auto i = q.count; !coalesces && pump && i > 0; --i) {
+        const auto& e = at(p, i - 1);
+        if (boiler::messages::pump_of_msg(e.msg) != pump) { continue; }
+        if (boiler::messages::id_of_msg(e.msg) == id) {
+            ++counters.coalesced;
+            return;
+        }
+        break;
+    }
+    for (auto i = std::size_t{ 0 }; coalesces && i < q.count; ++i) {
+        auto& e = at(p, i);
+        if (boiler::messages::id_of_msg(e.msg) == id && boiler::messages::pump_of_msg(e.msg) == pump) {
+            e.msg = msg;
+            ++counters.coalesced;
+            return;
+        }
+    }
+
+    if (q.count == queue_capacity) {
+        ++counters.dropped;
+        return;
+    }
+    at(p, q.count++) = entry{ msg, cycle, false };
+}
+
+auto boiler::outbound::scheduler::schedule(std::vector<msg_to_units>& out) -> void
+{
+    for (const auto& msg : out) { enqueue(msg); }
+    out.clear();
+
+    auto messages_left = budget.messages == 0 ? ~ta::u64{ 0 } : ta::u64{ budget.messages };
+    auto bytes_left    = budget.bytes == 0 ? ~ta::u64{ 0 } : ta::u64{ budget.bytes };
+
+    // Strict priorities: once a class has to wait, so do all the ones below.
+    auto blocked = false;
+    for (auto p = std::size_t{ 0 }; p < priority_count; ++p) {
+        auto& q           = positions[p];
+        auto& counters    = class_stats_of[p];
+        const auto exempt = static_cast<priority>(p) == priority::safety;
+
+        while (q.count > 0) {
+            auto& e         = at(p, 0);
+            const auto size = sizes[boiler::messages::id_of_msg(e.msg)];
+            if (!exempt && (blocked || messages_left == 0 || bytes_left < size)) {
+                blocked = true;
+                break;
+            }
+
+            if (!exempt) {
+                --messages_left;
+                bytes_left -= size;
+            }
+
+            const auto delay = cycle - e.queued_at;
+            counters.total_delay += delay;
+            counters.max_delay = std::max(counters.max_delay, delay);
+            ++counters.sent;
+
+            out.push_back(e.msg);
+            q.first = (q.first + 1) % queue_capacity;
+            --q.count;
+        }
+
+        // What's left waits for the next cycle.
+        for (auto i = std::size_t{ 0 }; i < q.count; ++i) {
+            auto& e = at(p, i);
+            if (!e.deferred) {
+                e.deferred = true;
+                ++counters.deferred;
+            }
+        }
+    }
+
+    ++cycle;
+}
+
+auto boiler::outbound::scheduler::backlog() const -> std::size_t
+{
+    auto total = std::size_t{ 0 };
+    for (const auto& q : positions) { total += q.count; }
+    return total;
+}
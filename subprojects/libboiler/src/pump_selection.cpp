@@ -0,0 +1,96 @@
+#include "boiler/pump_selection.hpp"
+
+#include <algorithm> // std::max, std::min.
+#include <chrono>
+#include <cmath> // std::abs.
+
+namespace {
+    namespace sel = boiler::pump_selection;
+
+    constexpr auto lanes = boiler::max_pumps + 1;
+
+    // How far from [min_normal, max_normal] the level predicted for the
+    // end of the cycle gets with each count of pumps open, starting from
+    // [level_low, level_high] with the steam in [steam_low, steam_high].
+    // Being off the middle of the band only breaks ties.
+    auto costs(
+        const boiler::constants& c,
+        float level_low,
+        float level_high,
+        float steam_low,
+        float steam_high) -> std::array<float, lanes>
+    {
+        const auto dt  = std::chrono::duration<float>(c.cycle_time).count();
+        const auto mid = (c.boiler.min_normal + c.boiler.max_normal) / 2;
+
+        auto cost = std::array<float, lanes>{};
+        for (auto k = std::size_t{ 0 }; k < lanes; ++k) {
+            const auto in    = dt * c.pump_capacity * static_cast<float>(k);
+            const auto low   = level_low + in - dt * steam_high;
+            const auto high  = level_high + in - dt * steam_low;
+            const auto under = std::max(0.0f, c.boiler.min_normal - low);
+            const auto over  = std::max(0.0f, high - c.boiler.max_normal);
+            cost[k] = under + over + 1e-3f * std::abs((low + high) / 2 - mid);
+        }
+        return cost;
+    }
+
+    // The fewest pumps among the cheapest.
+    auto cheapest(const std::array<float, lanes>& cost) -> ta::u8
+    {
+        auto best = std::size_t{ 0 };
+        for (auto k = std::size_t{ 1 }; k < lanes; ++k) {
+            if (cost[k] < cost[best]) { best = k; }
+        }
+        return static_cast<ta::u8>(best);
+    }
+}
+
+boiler::pump_selection::table::table(const boiler::constants& c)
+    : level_scale{ c.boiler.capacity > 0 ? static_cast<float>(level_bands) / c.boiler.capacity : 0 }
+    , steam_scale{
+        c.steam.max_throughput > 0 ? static_cast<float>(steam_bands) / c.steam.max_throughput : 0
+    }
+{
+    const auto dt         = std::chrono::duration<float>(c.cycle_time).count();
+    const auto level_step = c.boiler.capacity / static_cast<float>(level_bands);
+    const auto steam_step = c.steam.max_throughput / static_cast<float>(steam_bands);
+
+    for (auto l = std::size_t{ 0 }; l < level_bands; ++l) {
+        const auto level_low  = level_step * static_cast<float>(l);
+        const auto level_high = level_low + level_step;
+        for (auto s = std::size_t{ 0 }; s <= steam_bands; ++s) {
+            // Over the cycle the steam can drift from its band by its
+            // gradients; without a reading it can be anything.
+            auto steam_low  = 0.0f;
+            auto steam_high = c.steam.max_throughput;
+            if (s < steam_bands) {
+                steam_low  = std::max(0.0f, steam_step * static_cast<float>(s) - dt * c.steam.min_gradient);
+                steam_high = std::min(
+                    c.steam.max_throughput,
+                    steam_step * static_cast<float>(s + 1) + dt * c.steam.max_gradient);
+            }
+            counts[l][s] = cheapest(costs(c, level_low, level_high, steam_low, steam_high));
+        }
+    }
+}
+
+auto boiler::pump_selection::table::select(
+    pump_mask healthy,
+    float level,
+    std::optional<float> steam) -> pump_mask
+{
+    if (healthy != cached) {
+        cached       = healthy;
+        auto open    = pump_mask{ 0 };
+        auto count   = std::size_t{ 0 };
+        for (auto n = std::size_t{ 0 }; n < boiler::max_pumps; ++n) {
+            if (healthy >> n & 1u) {
+                open = static_cast<pump_mask>(open | 1u << n);
+                first[++count] = open;
+            }
+        }
+        for (auto k = count + 1; k < first.size(); ++k) { first[k] = open; }
+    }
+    return first[best_count(level, steam)];
+}
@@ -0,0 +1,81 @@
+#include "boiler/realtime.hpp"
+
+#include <cerrno>
+#include <cstring> // std::memset.
+#include <memory>  // std::unique_ptr.
+
+#include <malloc.h>       // mallopt.
+#include <pthread.h>      // pthread_setaffinity_np, pthread_setschedparam.
+#include <sched.h>        // cpu_set_t, SCHED_FIFO.
+#include <sys/mman.h>     // mlockall.
+#include <sys/resource.h> // getrusage.
+
+static_assert(boiler::realtime::max_cpus == CPU_SETSIZE);
+
+namespace {
+    auto last_error() -> std::error_code { return { errno, std::generic_category() }; }
+
+    // One frame per chunk. The recursion comes before the writes so it
+    // can't be turned into a loop reusing the same frame.
+    [[gnu::noinline]] auto fault_in_stack(std::size_t bytes) -> void
+    {
+        constexpr auto chunk = std::size_t{ 16 << 10 };
+        volatile char frame[chunk];
+        if (bytes > chunk) { fault_in_stack(bytes - chunk); }
+        std::memset(const_cast<char*>(frame), 0, chunk);
+    }
+
+    auto fault_in_heap(std::size_t bytes) -> void
+    {
+        // Freed memory goes back to the allocator's free lists instead of
+        // the kernel, and large blocks come from there instead of fresh
+        // mappings, so the pages faulted in here are the ones later
+        // allocations get.
+        ::mallopt(M_TRIM_THRESHOLD, -1);
+        ::mallopt(M_MMAP_MAX, 0);
+
+        auto reserve = std::unique_ptr<char[]>{ new char[bytes] };
+        std::memset(reserve.get(), 0, bytes);
+    }
+}
+
+auto boiler::realtime::prepare(const options& o) -> outcome
+{
+    auto result = outcome{};
+
+    // CPU_SET doesn't check its argument, a core past the set would be
+    // written past it.
+    if (o.cpu && *o.cpu >= max_cpus) {
+        result.pinning = { EINVAL, std::generic_category() };
+    } else if (o.cpu) {
+        auto set = cpu_set_t{};
+        CPU_ZERO(&set);
+        CPU_SET(*o.cpu, &set);
+        if (const auto e = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); e != 0) {
+            result.pinning = { e, std::generic_category() };
+        }
+    }
+
+    if (o.lock_memory) {
+        fault_in_stack(o.stack_bytes);
+        fault_in_heap(o.heap_bytes);
+        if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) { result.locking = last_error(); }
+    }
+
+    if (o.fifo_priority) {
+        auto param           = sched_param{};
+        param.sched_priority = *o.fifo_priority;
+        if (const auto e = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param); e != 0) {
+            result.scheduling = { e, std::generic_category() };
+        }
+    }
+
+    return result;
+}
+
+auto boiler::realtime::usage() -> counters
+{
+    auto u = rusage{};
+    ::getrusage(RUSAGE_THREAD, &u);
+    return { u.ru_minflt, u.ru_majflt, u.ru_nvcsw, u.ru_nivcsw };
+}
@@ -0,0 +1,182 @@
+#include "boiler/simulator.hpp"
+
+#include <algorithm> // std::clamp, std::min.
+#include <variant>
+
+namespace {
+    // Cheap enough to keep thousands of simulators around, see
+    // https://prng.di.unimi.it/splitmix64.c
+    auto splitmix64(ta::u64& state) -> ta::u64
+    {
+        auto z = (state += 0x9e3779b97f4a7c15);
+        z      = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z      = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    template<typename... Fs>
+    struct overloaded : Fs...
+    {
+        using Fs::operator()...;
+    };
+    template<typename... Fs>
+    overloaded(Fs...) -> overloaded<Fs...>;
+}
+
+boiler::simulator::simulator(boiler::constants c, ta::u64 seed)
+    : constants{ c }
+    , rng_state{ seed }
+{
+    const auto& b = constants.boiler;
+    water_liters  = b.min_normal + (b.max_normal - b.min_normal) * (0.25f + 0.5f * random_unit());
+
+    const auto max_steam = std::min(constants.steam.max_throughput, constants.pump_capacity);
+    target_steam         = max_steam * (0.3f + 0.5f * random_unit());
+}
+
+boiler::simulator::simulator(boiler::constants c, ta::u64 seed, initial_state initial)
+    : constants{ c }
+    , rng_state{ seed }
+    , water_liters{ initial.level_liters }
+    , target_steam{ initial.target_steam_liters_per_sec }
+{}
+
+auto boiler::simulator::random_unit() -> float
+{
+    // Top 24 bits, exactly representable in a float.
+    return static_cast<float>(splitmix64(rng_state) >> 40) / static_cast<float>(1 << 24);
+}
+
+auto boiler::simulator::inject(fault f, ta::u8 target) -> void
+{
+    current_fault = f;
+    // A plant without pumps has no pump to break.
+    fault_target  = constants.pump_count == 0
+                        ? ta::u8{ 0 }
+                        : static_cast<ta::u8>(target % constants.pump_count);
+    fault_cycle   = cycles;
+
+    switch (f) {
+        case fault::level: {
+            stuck_reading = constants.boiler.capacity * 1.2f * random_unit();
+        } break;
+        case fault::steam: {
+            stuck_reading = constants.steam.max_throughput * 1.5f * random_unit();
+        } break;
+        default: break;
+    }
+}
+
+auto boiler::simulator::repair() -> void
+{
+    if (current_fault == fault::pump) { pumps_repaired |= 1u << fault_target; }
+    current_fault = fault::none;
+}
+
+auto boiler::simulator::get_messages() -> std::vector<messages::to_program::any>
+{
+    namespace to_program = messages::to_program;
+
+    // A dead link stays dead.
+    if (current_fault == fault::transmission) { return {}; }
+
+    auto messages = std::vector<to_program::any>{};
+    messages.reserve(2 * constants.pump_count + 4u);
+
+    if (current_fault == fault::stop && cycles - fault_cycle < 3) {
+        messages.push_back(to_program::stop{});
+    }
+
+    if (!waiting_sent) {
+        messages.push_back(to_program::steam_boiler_waiting{});
+        waiting_sent = true;
+    }
+    if (program_ready_received && !running) {
+        messages.push_back(to_program::physical_units_ready{});
+        running = true;
+    }
+    for (auto n = ta::u8{ 0 }; n < constants.pump_count; ++n) {
+        if (failures_to_ack >> n & 1u) {
+            messages.push_back(to_program::pump_failure_acknowledgement{ n });
+        }
+        if (pumps_repaired >> n & 1u) { messages.push_back(to_program::pump_repaired{ n }); }
+    }
+    failures_to_ack = 0;
+    pumps_repaired  = 0;
+
+    for (auto n = ta::u8{ 0 }; n < constants.pump_count; ++n) {
+        const auto open = pump_open[n];
+        auto flowing    = open;
+        if (current_fault == fault::pump_control && n == fault_target) { flowing = !open; }
+
+        messages.push_back(to_program::pump_state{
+            n,
+            open ? to_program::pump_state::possible_states::open
+                 : to_program::pump_state::possible_states::closed });
+        messages.push_back(to_program::pump_control_state{
+            n,
+            flowing ? to_program::pump_control_state::possible_states::flowing
+                    : to_program::pump_control_state::possible_states::not_flowing });
+    }
+
+    messages.push_back(to_program::level{
+        current_fault == fault::level ? stuck_reading : water_liters });
+    messages.push_back(to_program::steam{
+        current_fault == fault::steam ? stuck_reading : steam_liters_per_sec });
+
+    return messages;
+}
+
+auto boiler::simulator::process_messages(
+    const std::vector<messages::to_units::any>& messages) -> void
+{
+    namespace to_units = messages::to_units;
+
+    const auto set_pump = [&](ta::u8 n, bool open) {
+        if (n >= constants.pump_count) { return; }
+        if (current_fault == fault::pump && n == fault_target) { return; }
+        if (pump_open[n] != open) { ++switches; }
+        pump_open[n] = open;
+    };
+
+    valve_open = false;
+    for (const auto& msg : messages) {
+        std::visit(
+            overloaded{
+                [&](const to_units::mode& m) { announced_mode = m.m; },
+                [&](const to_units::program_ready&) { program_ready_received = true; },
+                [&](const to_units::valve&) { valve_open = true; },
+                [&](const to_units::open_pump& m) { set_pump(m.n, true); },
+                [&](const to_units::close_pump& m) { set_pump(m.n, false); },
+                [&](const to_units::pump_failure_detection& m) {
+                    if (m.n < constants.pump_count) { failures_to_ack |= 1u << m.n; }
+                },
+                [](const auto&) {},
+            },
+            msg);
+    }
+
+    step_physics();
+    ++cycles;
+}
+
+auto boiler::simulator::step_physics() -> void
+{
+    using seconds = std::chrono::duration<float>;
+    const auto dt = std::chrono::duration_cast<seconds>(constants.cycle_time).count();
+
+    if (running) {
+        const auto max_step = constants.steam.max_gradient * dt;
+        steam_liters_per_sec +=
+            std::clamp(target_steam - steam_liters_per_sec, -max_step, max_step);
+    }
+
+    auto inflow = 0.f;
+    for (auto n = 0u; n < constants.pump_count; ++n) {
+        if (pump_open[n]) { inflow += constants.pump_capacity; }
+    }
+    const auto drained = valve_open ? constants.pump_capacity * constants.pump_count : 0.f;
+
+    water_liters += (inflow - steam_liters_per_sec - drained) * dt;
+    water_liters = std::clamp(water_liters, 0.f, constants.boiler.capacity);
+}
@@ -0,0 +1,646 @@
+#include "boiler/telemetry.hpp"
+
+#include <algorithm> // std::min, std::max, std::sort, std::lower_bound.
+#include <bit>       // std::bit_cast, std::countl_zero, std::countr_zero.
+#include <cerrno>
+#include <charconv> // std::from_chars.
+#include <cstdio>  // std::snprintf.
+#include <cstring> // std::memcpy.
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>    // open.
+#include <sys/mman.h> // mmap, munmap.
+#include <unistd.h>   // close, ftruncate.
+
+namespace {
+    using boiler::telemetry::sample;
+
+    constexpr char segment_magic[8] = { 'B', 'L', 'R', 'T', 'L', 'M', '0', '1' };
+
+    // The only place that's ever rewritten: used_bytes moves forward once a
+    // block has been fully written, so a crash loses at most the block being
+    // written.
+    struct segment_header
+    {
+        char magic[8];
+        ta::u64 used_bytes;
+        ta::u64 block_count;
+        ta::u64 reserved;
+    };
+
+    enum column : std::size_t
+    {
+        time_column,
+        level_column,
+        steam_column,
+        pumps_column,
+        mode_column,
+        column_count,
+    };
+
+    struct block_header
+    {
+        ta::i64 first_ms;
+        ta::i64 last_ms;
+        ta::u32 count;
+        ta::u32 column_bytes[column_count];
+        float min_level;
+        float max_level;
+        float min_steam;
+        float max_steam;
+        ta::u32 padding;
+        double sum_level;
+        double sum_steam;
+    };
+    static_assert(sizeof(block_header) % 8 == 0);
+
+    // Worst case: 4 + 64 bits of time, 2 + 5 + 6 + 32 bits per float, 1 + 16
+    // bits of pumps and 1 + 8 bits of mode per sample, plus padding.
+    constexpr auto max_block_bytes =
+        sizeof(block_header) +
+        (boiler::telemetry::block_samples * (68 + 2 * 45 + 17 + 9) + 7) / 8 + 8 * column_count;
+
+    auto align8(std::size_t n) -> std::size_t { return (n + 7) & ~std::size_t{ 7 }; }
+
+    auto fail(const std::string& what) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    // Most significant bit first.
+    class bit_writer
+    {
+    public:
+        auto write(ta::u64 value, unsigned bits) -> void
+        {
+            for (auto i = bits; i > 0; --i) {
+                const auto bit = (value >> (i - 1)) & 1u;
+                if (used % 8 == 0) { bytes.push_back(std::byte{ 0 }); }
+                if (bit != 0) { bytes.back() |= std::byte{ 0x80 } >> (used % 8); }
+                ++used;
+            }
+        }
+
+        auto data() const -> const std::vector<std::byte>& { return bytes; }
+
+    private:
+        std::vector<std::byte> bytes;
+        std::size_t used = 0;
+    };
+
+    class bit_reader
+    {
+    public:
+        bit_reader(const std::byte* first)
+            : data{ first }
+        {}
+
+        auto read(unsigned bits) -> ta::u64
+        {
+            auto value = ta::u64{ 0 };
+            for (auto i = 0u; i < bits; ++i) {
+                const auto byte = std::to_integer<unsigned>(data[position / 8]);
+                value           = (value << 1) | ((byte >> (7 - position % 8)) & 1u);
+                ++position;
+            }
+            return value;
+        }
+
+        auto bit() -> bool { return read(1) != 0; }
+
+    private:
+        const std::byte* data;
+        std::size_t position = 0;
+    };
+
+    // Timestamps: delta of deltas in buckets, regular cycles cost one bit.
+    auto encode_times(const std::vector<sample>& samples) -> bit_writer
+    {
+        auto out   = bit_writer{};
+        auto prev  = samples.front().time_ms;
+        auto delta = ta::i64{ 0 };
+        for (auto i = std::size_t{ 1 }; i < samples.size(); ++i) {
+            const auto d   = samples[i].time_ms - prev;
+            const auto dod = d - delta;
+            const auto raw = static_cast<ta::u64>(dod);
+            if (dod == 0) {
+                out.write(0b0, 1);
+            } else if (dod >= -64 && dod <= 63) {
+                out.write(0b10, 2);
+                out.write(raw, 7);
+            } else if (dod >= -256 && dod <= 255) {
+                out.write(0b110, 3);
+                out.write(raw, 9);
+            } else if (dod >= -2048 && dod <= 2047) {
+                out.write(0b1110, 4);
+                out.write(raw, 12);
+            } else {
+                out.write(0b1111, 4);
+                out.write(raw, 64);
+            }
+            prev  = samples[i].time_ms;
+            delta = d;
+        }
+        return out;
+    }
+
+    auto sign_extend(ta::u64 value, unsigned bits) -> ta::i64
+    {
+        const auto shift = 64 - bits;
+        return static_cast<ta::i64>(value << shift) >> shift;
+    }
+
+    auto decode_times(bit_reader in, ta::i64 first_ms, std::vector<sample>& out, std::size_t from)
+        -> void
+    {
+        auto prev  = first_ms;
+        auto delta = ta::i64{ 0 };
+        out[from].time_ms = first_ms;
+        for (auto i = from + 1; i < out.size(); ++i) {
+            auto dod = ta::i64{ 0 };
+            if (in.bit()) {
+                if (!in.bit()) {
+                    dod = sign_extend(in.read(7), 7);
+                } else if (!in.bit()) {
+                    dod = sign_extend(in.read(9), 9);
+                } else if (!in.bit()) {
+                    dod = sign_extend(in.read(12), 12);
+                } else {
+                    dod = static_cast<ta::i64>(in.read(64));
+                }
+            }
+            delta += dod;
+            prev += delta;
+            out[i].time_ms = prev;
+        }
+    }
+
+    // Floats: XOR with the previous value, only the meaningful bits are
+    // stored and the window of meaningful bits is reused when possible.
+    template<float sample::*Member>
+    auto encode_floats(const std::vector<sample>& samples) -> bit_writer
+    {
+        auto out      = bit_writer{};
+        auto prev     = std::bit_cast<ta::u32>(samples.front().*Member);
+        auto leading  = 32u + 1; // No window yet.
+        auto trailing = 0u;
+        out.write(prev, 32);
+        for (auto i = std::size_t{ 1 }; i < samples.size(); ++i) {
+            const auto value = std::bit_cast<ta::u32>(samples[i].*Member);
+            const auto x     = value ^ prev;
+            prev             = value;
+            if (x == 0) {
+                out.write(0b0, 1);
+                continue;
+            }
+            const auto lz = std::min(31u, static_cast<unsigned>(std::countl_zero(x)));
+            const auto tz = static_cast<unsigned>(std::countr_zero(x));
+            if (leading <= 32 && lz >= leading && tz >= trailing) {
+                out.write(0b10, 2);
+                out.write(x >> trailing, 32 - leading - trailing);
+            } else {
+                leading  = lz;
+                trailing = tz;
+                const auto meaningful = 32 - leading - trailing;
+                out.write(0b11, 2);
+                out.write(leading, 5);
+                out.write(meaningful - 1, 5); // In [1, 32].
+                out.write(x >> trailing, meaningful);
+            }
+        }
+        return out;
+    }
+
+    template<float sample::*Member>
+    auto decode_floats(bit_reader in, std::vector<sample>& out, std::size_t from) -> void
+    {
+        auto prev     = static_cast<ta::u32>(in.read(32));
+        auto leading  = 0u;
+        auto trailing = 0u;
+        out[from].*Member = std::bit_cast<float>(prev);
+        for (auto i = from + 1; i < out.size(); ++i) {
+            if (in.bit()) {
+                if (in.bit()) {
+                    leading  = static_cast<unsigned>(in.read(5));
+                    trailing = 32 - leading - (static_cast<unsigned>(in.read(5)) + 1);
+                }
+                const auto meaningful = 32 - leading - trailing;
+                prev ^= static_cast<ta::u32>(in.read(meaningful) << trailing);
+            }
+            out[i].*Member = std::bit_cast<float>(prev);
+        }
+    }
+
+    // Pump masks and modes barely change: 1 bit when unchanged.
+    template<typename T, T sample::*Member, unsigned Bits>
+    auto encode_changes(const std::vector<sample>& samples) -> bit_writer
+    {
+        auto out  = bit_writer{};
+        auto prev = static_cast<ta::u64>(samples.front().*Member);
+        out.write(prev, Bits);
+        for (auto i = std::size_t{ 1 }; i < samples.size(); ++i) {
+            const auto value = static_cast<ta::u64>(samples[i].*Member);
+            if (value == prev) {
+                out.write(0b0, 1);
+            } else {
+                out.write(0b1, 1);
+                out.write(value, Bits);
+                prev = value;
+            }
+        }
+        return out;
+    }
+
+    template<typename T, T sample::*Member, unsigned Bits>
+    auto decode_changes(bit_reader in, std::vector<sample>& out, std::size_t from) -> void
+    {
+        auto prev = in.read(Bits);
+        out[from].*Member = static_cast<T>(prev);
+        for (auto i = from + 1; i < out.size(); ++i) {
+            if (in.bit()) { prev = in.read(Bits); }
+            out[i].*Member = static_cast<T>(prev);
+        }
+    }
+
+    auto header_at(const std::byte* at) -> block_header
+    {
+        auto header = block_header{};
+        std::memcpy(&header, at, sizeof(header));
+        return header;
+    }
+
+    // Appends the samples of the block at `at` to `out`.
+    auto decode_block(const std::byte* at, std::vector<sample>& out) -> void
+    {
+        const auto header = header_at(at);
+        const auto from   = out.size();
+        out.resize(from + header.count);
+
+        // Columns follow the header back to back.
+        auto cursor     = at + sizeof(block_header);
+        const auto next = [&](column c) {
+            const auto start = cursor;
+            cursor += header.column_bytes[c];
+            return bit_reader{ start };
+        };
+        decode_times(next(time_column), header.first_ms, out, from);
+        decode_floats<&sample::level_liters>(next(level_column), out, from);
+        decode_floats<&sample::steam_liters_per_sec>(next(steam_column), out, from);
+        decode_changes<ta::u16, &sample::pumps_open, 16>(next(pumps_column), out, from);
+        decode_changes<boiler::telemetry::mode, &sample::m, 8>(next(mode_column), out, from);
+    }
+
+    // Running min/max/sum of both float columns over a window.
+    struct accumulator
+    {
+        ta::u32 count = 0;
+        float min_level = std::numeric_limits<float>::infinity();
+        float max_level = -std::numeric_limits<float>::infinity();
+        float min_steam = std::numeric_limits<float>::infinity();
+        float max_steam = -std::numeric_limits<float>::infinity();
+        double sum_level = 0;
+        double sum_steam = 0;
+
+        auto add(const sample& s) -> void
+        {
+            ++count;
+            min_level = std::min(min_level, s.level_liters);
+            max_level = std::max(max_level, s.level_liters);
+            min_steam = std::min(min_steam, s.steam_liters_per_sec);
+            max_steam = std::max(max_steam, s.steam_liters_per_sec);
+            sum_level += static_cast<double>(s.level_liters);
+            sum_steam += static_cast<double>(s.steam_liters_per_sec);
+        }
+
+        auto add(const block_header& b) -> void
+        {
+            count += b.count;
+            min_level = std::min(min_level, b.min_level);
+            max_level = std::max(max_level, b.max_level);
+            min_steam = std::min(min_steam, b.min_steam);
+            max_steam = std::max(max_steam, b.max_steam);
+            sum_level += b.sum_level;
+            sum_steam += b.sum_steam;
+        }
+
+        auto summary(ta::i64 start_ms) const -> boiler::telemetry::window_summary
+        {
+            const auto n = static_cast<double>(count);
+            return {
+                .start_ms     = start_ms,
+                .count        = count,
+                .level_liters = { min_level, max_level, static_cast<float>(sum_level / n) },
+                .steam_liters_per_sec = { min_steam, max_steam,
+                                          static_cast<float>(sum_steam / n) },
+            };
+        }
+    };
+}
+
+struct boiler::telemetry::store::segment
+{
+    int fd;
+    std::byte* data;
+    std::size_t capacity;
+    bool writable;
+
+    auto header() const -> segment_header
+    {
+        auto h = segment_header{};
+        std::memcpy(&h, data, sizeof(h));
+        return h;
+    }
+    auto set_header(const segment_header& h) -> void { std::memcpy(data, &h, sizeof(h)); }
+};
+
+auto boiler::telemetry::sample_of(const control_unit::snapshot& s, ta::i64 time_ms) -> sample
+{
+    using pump_state = boiler::messages::to_program::pump_state::possible_states;
+
+    auto pumps = ta::u16{ 0 };
+    for (auto n = 0u; n < boiler::max_pumps; ++n) {
+        if (s.readings.pump_states[n] == pump_state::open) {
+            pumps = static_cast<ta::u16>(pumps | (1u << n));
+        }
+    }
+    return {
+        .time_ms              = time_ms,
+        .level_liters         = s.readings.level_liters,
+        .steam_liters_per_sec = s.readings.steam_liters_per_sec,
+        .pumps_open           = pumps,
+        .m                    = s.mode_of_operation,
+    };
+}
+
+boiler::telemetry::store::store(std::filesystem::path dir, std::size_t bytes)
+    : directory{ std::move(dir) }
+    , segment_bytes{ bytes }
+{
+    if (segment_bytes < sizeof(segment_header) + max_block_bytes) {
+        throw std::invalid_argument{ "telemetry segments are too small to hold a block" };
+    }
+    std::filesystem::create_directories(directory);
+    open_block.reserve(block_samples);
+
+    auto paths = std::vector<std::filesystem::path>{};
+    for (const auto& entry : std::filesystem::directory_iterator{ directory }) {
+        if (entry.path().extension() == ".seg") { paths.push_back(entry.path()); }
+    }
+    // Names are zero padded sequence numbers. Old segments may have been
+    // deleted, so new ones are numbered after the highest one left rather
+    // than after how many there are.
+    std::sort(paths.begin(), paths.end());
+    for (const auto& path : paths) {
+        const auto stem = path.stem().string();
+        auto n          = std::size_t{ 0 };
+        const auto [end, error] = std::from_chars(stem.data(), stem.data() + stem.size(), n);
+        if (error == std::errc{} && end == stem.data() + stem.size()) {
+            next_segment = std::max(next_segment, n + 1);
+        }
+    }
+
+    for (const auto& path : paths) {
+        const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { fail("can't open " + path.string()); }
+        const auto size = std::filesystem::file_size(path);
+        if (size < sizeof(segment_header)) {
+            ::close(fd);
+            continue;
+        }
+        auto* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            fail("can't map " + path.string());
+        }
+        segments.push_back({ fd, static_cast<std::byte*>(data), size, false });
+
+        const auto header = segments.back().header();
+        if (std::memcmp(header.magic, segment_magic, sizeof(segment_magic)) != 0) { continue; }
+        auto at = segments.back().data + sizeof(segment_header);
+        for (auto b = ta::u64{ 0 }; b < header.block_count; ++b) {
+            const auto block = header_at(at);
+            blocks.push_back({ at, block.first_ms, block.last_ms });
+            samples += block.count;
+            last_time_ms = block.last_ms;
+            any_sample   = true;
+
+            auto size_of_block = sizeof(block_header);
+            for (auto c : block.column_bytes) { size_of_block += c; }
+            at += align8(size_of_block);
+        }
+    }
+}
+
+boiler::telemetry::store::~store()
+{
+    // Whatever is still buffered would be lost otherwise.
+    if (!open_block.empty()) {
+        try {
+            seal_block();
+        } catch (...) {
+        }
+    }
+    for (auto& s : segments) {
+        if (s.writable) {
+            // Give the unused tail of the last segment back, nothing else
+            // can be done about it failing here.
+            if (::ftruncate(s.fd, static_cast<off_t>(s.header().used_bytes)) != 0) {}
+        }
+        ::munmap(s.data, s.capacity);
+        ::close(s.fd);
+    }
+}
+
+auto boiler::telemetry::store::append(const sample& s) -> void
+{
+    if (any_sample && s.time_ms <= last_time_ms) {
+        throw std::invalid_argument{ "telemetry samples must be in increasing time order" };
+    }
+    open_block.push_back(s);
+    last_time_ms = s.time_ms;
+    any_sample   = true;
+    ++samples;
+    if (open_block.size() == block_samples) { seal_block(); }
+}
+
+auto boiler::telemetry::store::flush() -> void
+{
+    if (!open_block.empty()) { seal_block(); }
+}
+
+auto boiler::telemetry::store::open_segment() -> void
+{
+    if (!segments.empty() && segments.back().writable) {
+        // Done with it, keep only what's used.
+        auto& last = segments.back();
+        if (::ftruncate(last.fd, static_cast<off_t>(last.header().used_bytes)) != 0) {
+            fail("can't shrink telemetry segment");
+        }
+        last.writable = false;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08zu.seg", next_segment++);
+    const auto path = directory / name;
+
+    const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) { fail("can't create " + path.string()); }
+    if (::ftruncate(fd, static_cast<off_t>(segment_bytes)) != 0) {
+        ::close(fd);
+        fail("can't size " + path.string());
+    }
+    auto* data = ::mmap(nullptr, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        fail("can't map " + path.string());
+    }
+
+    auto s = segment{ fd, static_cast<std::byte*>(data), segment_bytes, true };
+    auto header = segment_header{};
+    std::memcpy(header.magic, segment_magic, sizeof(segment_magic));
+    header.used_bytes = sizeof(segment_header);
+    s.set_header(header);
+    segments.push_back(s);
+}
+
+auto boiler::telemetry::store::seal_block() -> void
+{
+    auto header     = block_header{};
+    header.first_ms = open_block.front().time_ms;
+    header.last_ms  = open_block.back().time_ms;
+    header.count    = static_cast<ta::u32>(open_block.size());
+
+    auto stats = accumulator{};
+    for (const auto& s : open_block) { stats.add(s); }
+    header.min_level = stats.min_level;
+    header.max_level = stats.max_level;
+    header.min_steam = stats.min_steam;
+    header.max_steam = stats.max_steam;
+    header.sum_level = stats.sum_level;
+    header.sum_steam = stats.sum_steam;
+
+    const bit_writer columns[column_count] = {
+        encode_times(open_block),
+        encode_floats<&sample::level_liters>(open_block),
+        encode_floats<&sample::steam_liters_per_sec>(open_block),
+        encode_changes<ta::u16, &sample::pumps_open, 16>(open_block),
+        encode_changes<mode, &sample::m, 8>(open_block),
+    };
+    auto size = sizeof(block_header);
+    for (auto c = 0u; c < column_count; ++c) {
+        header.column_bytes[c] = static_cast<ta::u32>(columns[c].data().size());
+        size += columns[c].data().size();
+    }
+    size = align8(size);
+
+    if (segments.empty() || !segments.back().writable ||
+        segments.back().header().used_bytes + size > segments.back().capacity) {
+        open_segment();
+    }
+    auto& seg      = segments.back();
+    auto seg_header = seg.header();
+
+    auto at = seg.data + seg_header.used_bytes;
+    std::memcpy(at, &header, sizeof(header));
+    auto out = at + sizeof(header);
+    for (const auto& c : columns) {
+        // Single sample blocks have empty columns.
+        if (c.data().empty()) { continue; }
+        std::memcpy(out, c.data().data(), c.data().size());
+        out += c.data().size();
+    }
+
+    // Only now is the block part of the segment.
+    seg_header.used_bytes += size;
+    ++seg_header.block_count;
+    seg.set_header(seg_header);
+
+    blocks.push_back({ at, header.first_ms, header.last_ms });
+    open_block.clear();
+}
+
+auto boiler::telemetry::store::blocks_from(ta::i64 from_ms) const
+    -> std::vector<block_ref>::const_iterator
+{
+    return std::lower_bound(
+        blocks.begin(), blocks.end(), from_ms,
+        [](const block_ref& b, ta::i64 t) { return b.last_ms < t; });
+}
+
+auto boiler::telemetry::store::scan(ta::i64 from_ms, ta::i64 to_ms, std::vector<sample>& out)
+    const -> void
+{
+    const auto in_range = [&](const sample& s) {
+        return s.time_ms >= from_ms && s.time_ms < to_ms;
+    };
+
+    for (auto b = blocks_from(from_ms); b != blocks.end() && b->first_ms < to_ms; ++b) {
+        const auto start = out.size();
+        decode_block(b->header, out);
+        if (b->first_ms < from_ms || b->last_ms >= to_ms) {
+            // Only the blocks at either end need trimming.
+            const auto kept = std::stable_partition(out.begin() + static_cast<std::ptrdiff_t>(start), out.end(), in_range);
+            out.erase(kept, out.end());
+        }
+    }
+    for (const auto& s : open_block) {
+        if (in_range(s)) { out.push_back(s); }
+    }
+}
+
+auto boiler::telemetry::store::downsample(ta::i64 from_ms, ta::i64 to_ms, ta::i64 window_ms) const
+    -> std::vector<window_summary>
+{
+    if (window_ms <= 0) { throw std::invalid_argument{ "window_ms must be positive" }; }
+
+    auto result  = std::vector<window_summary>{};
+    auto current = accumulator{};
+    auto window  = from_ms;
+
+    // Windows are visited in order, a sample or block never goes back.
+    const auto move_to = [&](ta::i64 time_ms) {
+        const auto start = from_ms + (time_ms - from_ms) / window_ms * window_ms;
+        if (start != window) {
+            if (current.count > 0) { result.push_back(current.summary(window)); }
+            current = accumulator{};
+            window  = start;
+        }
+    };
+    const auto add = [&](const sample& s) {
+        if (s.time_ms < from_ms || s.time_ms >= to_ms) { return; }
+        move_to(s.time_ms);
+        current.add(s);
+    };
+
+    auto decoded = std::vector<sample>{};
+    decoded.reserve(block_samples);
+    for (auto b = blocks_from(from_ms); b != blocks.end() && b->first_ms < to_ms; ++b) {
+        const auto same_window = (b->first_ms - from_ms) / window_ms ==
+                                 (b->last_ms - from_ms) / window_ms;
+        if (b->first_ms >= from_ms && b->last_ms < to_ms && same_window) {
+            // The header has everything needed.
+            move_to(b->first_ms);
+            current.add(header_at(b->header));
+            continue;
+        }
+        decoded.clear();
+        decode_block(b->header, decoded);
+        for (const auto& s : decoded) { add(s); }
+    }
+    for (const auto& s : open_block) { add(s); }
+
+    if (current.count > 0) { result.push_back(current.summary(window)); }
+    return result;
+}
+
+auto boiler::telemetry::store::size() const -> std::size_t { return samples; }
+
+auto boiler::telemetry::store::bytes_used() const -> std::size_t
+{
+    auto total = std::size_t{ 0 };
+    for (const auto& s : segments) { total += s.header().used_bytes; }
+    return total;
+}
@@ -0,0 +1,200 @@
+#include "boiler/trace.hpp"
+
+#include <algorithm> // std::max.
+#include <array>
+#include <chrono>
+#include <memory> // std::unique_ptr.
+#include <mutex>
+#include <vector>
+
+#include <sys/syscall.h> // SYS_gettid.
+#include <unistd.h>      // getpid, syscall.
+
+#include "boiler/message_format.hpp" // boiler::messages::mode_names.
+#include "boiler/message_ids.hpp"
+
+namespace {
+    namespace trace = boiler::trace;
+
+    constexpr const char* point_names[] = {
+        "process_messages", "safety_signals", "mailbox",    "link_monitor",
+        "handle_expected",  "run_last",       "mode_routine", "schedule",
+        "on_present",       "on_receipt",     "on_missing", "run_last_call",
+        "switch_mode",
+    };
+    static_assert(std::size(point_names) == trace::point_count);
+
+    // One thread's events. Only that thread writes, so recording is a
+    // handful of relaxed stores. Event i lives in slot i % ring_capacity,
+    // the reader tells the ones overwritten while it copied them from
+    // `started` (a seqlock per slot, in effect).
+    struct ring
+    {
+        std::array<std::atomic<ta::u64>, trace::ring_capacity> when;
+        // point | phase << 8 | arg << 32.
+        std::array<std::atomic<ta::u64>, trace::ring_capacity> what;
+        std::atomic<ta::u64> started{ 0 };
+        std::atomic<ta::u64> written{ 0 };
+        std::atomic<ta::u64> cleared{ 0 };
+        long tid = 0;
+    };
+
+    struct registry
+    {
+        std::mutex m;
+        std::vector<std::unique_ptr<ring>> rings;
+    };
+
+    auto rings() -> registry&
+    {
+        static auto r = registry{};
+        return r;
+    }
+
+    // Registered on the thread's first event, rings outlive their threads
+    // so that their events can still be dumped.
+    auto this_threads_ring() -> ring&
+    {
+        thread_local ring* mine = nullptr;
+        if (mine == nullptr) {
+            auto r = std::make_unique<ring>();
+            r->tid = ::syscall(SYS_gettid);
+            mine   = r.get();
+
+            auto& all  = rings();
+            auto lock  = std::scoped_lock{ all.m };
+            all.rings.push_back(std::move(r));
+        }
+        return *mine;
+    }
+
+    auto now_ns() -> ta::u64
+    {
+        return static_cast<ta::u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch())
+                                        .count());
+    }
+
+    struct event
+    {
+        ta::u64 when;
+        ta::u64 what;
+    };
+
+    // The events of `r` still in the ring, oldest first.
+    auto snapshot(const ring& r) -> std::vector<event>
+    {
+        const auto last  = r.written.load(std::memory_order_acquire);
+        const auto first = std::max(
+            r.cleared.load(std::memory_order_relaxed),
+            last > trace::ring_capacity ? last - trace::ring_capacity : 0);
+
+        auto events = std::vector<event>{};
+        events.reserve(last - first);
+        for (auto i = first; i < last; ++i) {
+            const auto slot = i % trace::ring_capacity;
+            events.push_back({ r.when[slot].load(std::memory_order_relaxed),
+                               r.what[slot].load(std::memory_order_relaxed) });
+        }
+
+        // The ones the writer has started overwriting since are dropped.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const auto started = r.started.load(std::memory_order_relaxed);
+        const auto valid_from =
+            started > trace::ring_capacity ? started - trace::ring_capacity : 0;
+        const auto dropped = std::min<ta::u64>(events.size(), std::max(valid_from, first) - first);
+        events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(dropped));
+        return events;
+    }
+
+    auto write_args(std::ostream& os, trace::point p, ta::u32 arg) -> void
+    {
+        using boiler::messages::to_program::names;
+        switch (p) {
+            case trace::point::on_present:
+            case trace::point::on_receipt:
+            case trace::point::on_missing: {
+                if (arg < names.size()) { os << ",\"args\":{\"message\":\"" << names[arg] << "\"}"; }
+            } break;
+            case trace::point::switch_mode:
+            case trace::point::mode_routine: {
+                if (arg < std::size(boiler::messages::mode_names)) {
+                    os << ",\"args\":{\"mode\":\"" << boiler::messages::mode_names[arg] << "\"}";
+                }
+            } break;
+            case trace::point::run_last_call: {
+                os << ",\"args\":{\"index\":" << arg << '}';
+            } break;
+            default: break;
+        }
+    }
+}
+
+auto boiler::trace::enable(bool enabled) -> void
+{
+    detail::on.store(enabled, std::memory_order_relaxed);
+}
+
+auto boiler::trace::detail::record(point p, char phase, ta::u32 arg) -> void
+{
+    auto& r      = this_threads_ring();
+    const auto n = r.written.load(std::memory_order_relaxed);
+    const auto slot = n % ring_capacity;
+
+    r.started.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.when[slot].store(now_ns(), std::memory_order_relaxed);
+    r.what[slot].store(
+        static_cast<ta::u64>(p) | static_cast<ta::u64>(phase) << 8 | static_cast<ta::u64>(arg) << 32,
+        std::memory_order_relaxed);
+    r.written.store(n + 1, std::memory_order_release);
+}
+
+auto boiler::trace::write_chrome_json(std::ostream& os) -> void
+{
+    auto& all       = rings();
+    auto lock       = std::scoped_lock{ all.m };
+    const auto pid  = ::getpid();
+    auto separator  = "";
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (const auto& r : all.rings) {
+        os << separator << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+           << ",\"tid\":" << r->tid << ",\"args\":{\"name\":\"thread " << r->tid << "\"}}";
+        separator = ",";
+
+        // An end whose begin was overwritten would close a scope that
+        // isn't there.
+        auto depth = std::size_t{ 0 };
+        for (const auto& e : snapshot(*r)) {
+            const auto p     = static_cast<point>(e.what & 0xff);
+            const auto phase = static_cast<char>((e.what >> 8) & 0xff);
+            const auto arg   = static_cast<ta::u32>(e.what >> 32);
+            if (phase == 'E') {
+                if (depth == 0) { continue; }
+                --depth;
+            } else {
+                ++depth;
+            }
+
+            // Microseconds, to the nanosecond.
+            os << ",\n{\"name\":\"" << point_names[static_cast<std::size_t>(p)]
+               << "\",\"cat\":\"control_unit\",\"ph\":\"" << phase << "\",\"ts\":"
+               << e.when / 1000 << '.' << static_cast<char>('0' + e.when / 100 % 10)
+               << static_cast<char>('0' + e.when / 10 % 10) << static_cast<char>('0' + e.when % 10)
+               << ",\"pid\":" << pid << ",\"tid\":" << r->tid;
+            write_args(os, p, arg);
+            os << '}';
+        }
+    }
+    os << "\n]}\n";
+}
+
+auto boiler::trace::clear() -> void
+{
+    auto& all = rings();
+    auto lock = std::scoped_lock{ all.m };
+    for (const auto& r : all.rings) {
+        r->cleared.store(r->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,310 @@
+#include "boiler/udp_gateway.hpp"
+
+#include <algorithm> // std::max.
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <arpa/inet.h> // inet_pton.
+#include <poll.h>
+#include <unistd.h> // close.
+
+namespace {
+    auto fail(const std::string& what) -> void
+    {
+        throw std::system_error{ errno, std::generic_category(), what };
+    }
+
+    auto address_of(const char* ip, ta::u16 port) -> sockaddr_in
+    {
+        auto a       = sockaddr_in{};
+        a.sin_family = AF_INET;
+        a.sin_port   = htons(port);
+        if (::inet_pton(AF_INET, ip, &a.sin_addr) != 1) {
+            throw std::invalid_argument{ std::string{ "invalid IPv4 address " } + ip };
+        }
+        return a;
+    }
+
+    // For a family of AF_UNSPEC: not known yet.
+    constexpr auto unknown = sockaddr_in{};
+
+    // See endpoint::published_peers.
+    constexpr auto known = ta::u64{ 1 } << 48;
+    auto pack(const sockaddr_in& a) -> ta::u64
+    {
+        return known | ta::u64{ a.sin_port } << 32 | a.sin_addr.s_addr;
+    }
+    auto unpack(ta::u64 packed) -> sockaddr_in
+    {
+        auto a            = sockaddr_in{};
+        a.sin_family      = AF_INET;
+        a.sin_port        = static_cast<in_port_t>(packed >> 32);
+        a.sin_addr.s_addr = static_cast<in_addr_t>(packed);
+        return a;
+    }
+}
+
+template<typename In, typename Out>
+boiler::net::endpoint<In, Out>::batch_buffers::batch_buffers(std::size_t batch)
+    : bytes(batch * wire::max_datagram)
+    , iov(batch)
+    , addresses(batch)
+    , headers(batch)
+{
+    for (auto i = std::size_t{ 0 }; i < batch; ++i) { reset(i); }
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::batch_buffers::reset(std::size_t i) -> void
+{
+    iov[i]     = { bytes.data() + i * wire::max_datagram, wire::max_datagram };
+    headers[i] = {};
+    headers[i].msg_hdr.msg_iov     = &iov[i];
+    headers[i].msg_hdr.msg_iovlen  = 1;
+    headers[i].msg_hdr.msg_name    = &addresses[i];
+    headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+}
+
+template<typename In, typename Out>
+boiler::net::endpoint<In, Out>::endpoint(
+    const char* ip,
+    ta::u16 port,
+    std::size_t boilers,
+    std::size_t batch)
+    : incoming{ batch }
+    , outgoing{ batch }
+    , inboxes(boilers)
+    , peers(boilers, unknown)
+    , published_peers(boilers)
+    , cycles(boilers)
+    , acks(boilers)
+    , sent_cycles(boilers)
+{
+    const auto local = address_of(ip, port);
+
+    fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { fail("can't create a UDP socket"); }
+    // A cycle of a whole fleet arrives at once, more than the default
+    // buffer holds. Best effort, capped by net.core.rmem_max.
+    const auto buffer_bytes = static_cast<int>(boilers * wire::max_datagram);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_bytes, sizeof(buffer_bytes));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_bytes, sizeof(buffer_bytes));
+
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0) {
+        const auto error = errno;
+        ::close(fd);
+        errno = error;
+        fail("can't bind to " + std::string{ ip } + ":" + std::to_string(port));
+    }
+}
+
+template<typename In, typename Out>
+boiler::net::endpoint<In, Out>::~endpoint()
+{
+    ::close(fd);
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::port() const -> ta::u16
+{
+    auto local  = sockaddr_in{};
+    auto length = socklen_t{ sizeof(local) };
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length);
+    return ntohs(local.sin_port);
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::connect(const char* ip, ta::u16 port) -> void
+{
+    const auto remote = address_of(ip, port);
+    for (auto& p : peers) { p = remote; }
+    for (auto& p : published_peers) { p.store(pack(remote), std::memory_order_relaxed); }
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::enable_delta(ta::u32 keyframe_interval) -> void
+{
+    encoders.assign(inboxes.size(), delta::encoder<Out>{ keyframe_interval });
+    decoders.assign(inboxes.size(), delta::decoder<In>{});
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::poll(std::chrono::milliseconds timeout) -> std::size_t
+{
+    auto waiting = pollfd{ fd, POLLIN, 0 };
+    if (::poll(&waiting, 1, static_cast<int>(timeout.count())) <= 0) { return 0; }
+
+    const auto batch = static_cast<unsigned>(incoming.headers.size());
+    auto received    = std::size_t{ 0 };
+    while (true) {
+        const auto n = ::recvmmsg(fd, incoming.headers.data(), batch, MSG_DONTWAIT, nullptr);
+        if (n <= 0) { break; }
+
+        for (auto i = std::size_t{ 0 }; i < static_cast<std::size_t>(n); ++i) {
+            const auto* first = static_cast<const std::byte*>(incoming.iov[i].iov_base);
+            const auto* last  = first + incoming.headers[i].msg_len;
+
+            counters.bytes_in += static_cast<ta::u64>(last - first);
+
+            // The boiler id is read on its own first, to find the inbox.
+            auto h = wire::header{};
+            if (last - first < static_cast<std::ptrdiff_t>(wire::header_size)) {
+                ++counters.malformed;
+                continue;
+            }
+            const auto boiler = wire::detail::get(first);
+            if (boiler >= inboxes.size()) {
+                ++counters.unknown_boiler;
+                continue;
+            }
+            auto& inbox         = inboxes[boiler];
+            const auto previous = inbox.size();
+            if (wire::decode_datagram(first, last, h, inbox) != last) {
+                // Trailing bytes: its messages decoded, but the datagram
+                // isn't one, none of them is kept.
+                inbox.resize(previous);
+                ++counters.malformed;
+                continue;
+            }
+
+            peers[boiler]  = incoming.addresses[i];
+            published_peers[boiler].store(pack(peers[boiler]), std::memory_order_relaxed);
+            cycles[boiler] = h.cycle;
+            acks[boiler]   = std::max(acks[boiler], h.cycle + 1);
+            if (!decoders.empty()) {
+                if (h.acked > 0) { encoders[boiler].acknowledge(h.acked - 1); }
+                decoders[boiler].decode(
+                    h.cycle, inbox, previous, (h.flags & wire::keyframe) != 0);
+            }
+        }
+        // recvmmsg shrinks msg_namelen to what it wrote.
+        for (auto i = std::size_t{ 0 }; i < static_cast<std::size_t>(n); ++i) {
+            incoming.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        received += static_cast<std::size_t>(n);
+        counters.datagrams_in += static_cast<ta::u64>(n);
+        if (static_cast<unsigned>(n) < batch) { break; }
+    }
+    return received;
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::take(ta::u32 boiler, std::vector<In>& out) -> void
+{
+    out.clear();
+    // Swapped rather than copied: both keep their capacity, neither
+    // allocates once warmed up.
+    out.swap(inboxes[boiler]);
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::send(ta::u32 boiler, const std::vector<Out>& messages)
+    -> bool
+{
+    if (boiler >= peers.size() || peers[boiler].sin_family != AF_INET) {
+        ++counters.unroutable;
+        return false;
+    }
+    if (staged == outgoing.headers.size()) { flush(); }
+
+    // Used up even if the datagram then can't be encoded: the delta
+    // encoder has already taken its changes as sent in it.
+    const auto cycle = ++sent_cycles[boiler];
+
+    const auto* sent = &messages;
+    auto flags       = ta::u8{ 0 };
+    if (!encoders.empty()) {
+        delta_scratch = messages;
+        const auto before = encoders[boiler].suppressed();
+        if (encoders[boiler].encode(cycle, delta_scratch)) { flags = wire::keyframe; }
+        counters.suppressed += encoders[boiler].suppressed() - before;
+        sent = &delta_scratch;
+    }
+
+    auto* first     = static_cast<std::byte*>(outgoing.iov[staged].iov_base);
+    const auto* end = wire::encode_datagram(
+        first, first + wire::max_datagram, wire::header{ boiler, cycle, acks[boiler], 0, flags }, *sent);
+    if (end == nullptr) {
+        ++counters.unroutable;
+        return false;
+    }
+
+    outgoing.iov[staged].iov_len = static_cast<std::size_t>(end - first);
+    counters.bytes_out += outgoing.iov[staged].iov_len;
+    outgoing.addresses[staged]   = peers[boiler];
+    ++staged;
+    return true;
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::flush() -> void
+{
+    auto sent = std::size_t{ 0 };
+    while (sent < staged) {
+        const auto n = ::sendmmsg(
+            fd, outgoing.headers.data() + sent, static_cast<unsigned>(staged - sent), 0);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            // The first one failed, the rest may still go.
+            ++counters.send_failures;
+            ++sent;
+            continue;
+        }
+        sent += static_cast<std::size_t>(n);
+        counters.datagrams_out += static_cast<ta::u64>(n);
+    }
+    for (auto i = std::size_t{ 0 }; i < staged; ++i) { outgoing.reset(i); }
+    staged = 0;
+}
+
+template<typename In, typename Out>
+auto boiler::net::endpoint<In, Out>::send_now(
+    ta::u32 boiler,
+    const std::vector<Out>& messages) const -> bool
+{
+    if (boiler >= published_peers.size()) { return false; }
+    const auto packed = published_peers[boiler].load(std::memory_order_relaxed);
+    if ((packed & known) == 0) { return false; }
+
+    // On the stack: the staging buffers belong to the cycle thread.
+    auto bytes      = std::array<std::byte, wire::max_datagram>{};
+    const auto* end = wire::encode_datagram(
+        bytes.data(), bytes.data() + bytes.size(), wire::header{ boiler, 0, 0, 0, 0 }, messages);
+    if (end == nullptr) { return false; }
+
+    const auto to   = unpack(packed);
+    const auto size = static_cast<std::size_t>(end - bytes.data());
+    while (true) {
+        const auto n = ::sendto(
+            fd, bytes.data(), size, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+        if (n < 0 && errno == EINTR) { continue; }
+        return n == static_cast<ssize_t>(size);
+    }
+}
+
+template class boiler::net::endpoint<boiler::messages::to_program::any, boiler::messages::to_units::any>;
+template class boiler::net::endpoint<boiler::messages::to_units::any, boiler::messages::to_program::any>;
+
+auto boiler::net::gateway_units::get_messages() -> std::vector<messages::to_program::any>
+{
+    g.poll(std::chrono::milliseconds{ 0 });
+    auto messages = std::vector<messages::to_program::any>{};
+    g.take(boiler, messages);
+    return messages;
+}
+
+auto boiler::net::gateway_units::process_messages(
+    const std::vector<messages::to_units::any>& messages) -> void
+{
+    g.send(boiler, messages);
+    if (flushes == flushing::per_boiler) { g.flush(); }
+}
+
+auto boiler::net::gateway_units::emergency_stop() -> void
+{
+    using mode = messages::to_units::mode;
+    g.send_now(boiler, { mode{ mode::possible_modes::emergency_stop } });
+}
@@ -0,0 +1,71 @@
+#include "boiler/watchdog.hpp"
+
+#include <iterator> // std::size.
+#include <utility>  // std::move.
+
+namespace {
+    namespace watchdog = boiler::watchdog;
+
+    constexpr const char* phase_names[] = {
+        "idle",           "plant_input",     "safety_signals", "mailbox",  "link_monitor",
+        "handle_expected", "run_last",       "mode_routine",   "schedule", "plant_output",
+    };
+    static_assert(std::size(phase_names) == watchdog::phase_count);
+}
+
+auto boiler::watchdog::operator<<(std::ostream& os, phase p) -> std::ostream&
+{
+    return os << phase_names[static_cast<std::size_t>(p)];
+}
+
+boiler::watchdog::monitor::monitor(
+    const heartbeat& h,
+    std::chrono::nanoseconds max_stuck,
+    on_stall_fn callback,
+    std::chrono::nanoseconds poll)
+    : watched{ h }
+    , limit{ max_stuck }
+    , period{ poll > poll.zero() ? poll : max_stuck / 4 }
+    , on_stall{ std::move(callback) }
+    , thread{ [this] { watch(); } }
+{}
+
+boiler::watchdog::monitor::~monitor()
+{
+    {
+        const auto lock = std::lock_guard{ stop_lock };
+        stopping        = true;
+    }
+    stop_requested.notify_one();
+    thread.join();
+}
+
+auto boiler::watchdog::monitor::watch() -> void
+{
+    using clock = std::chrono::steady_clock;
+
+    auto last          = watched.word();
+    auto since         = clock::now();
+    auto reported_last = false;
+
+    auto lock = std::unique_lock{ stop_lock };
+    while (!stop_requested.wait_for(lock, period, [this] { return stopping; })) {
+        const auto now  = clock::now();
+        const auto word = watched.word();
+        if (word != last) {
+            last          = word;
+            since         = now;
+            reported_last = false;
+            continue;
+        }
+
+        const auto stuck = heartbeat::phase_of(word);
+        if (stuck == phase::idle || reported_last || now - since <= limit) { continue; }
+        reported_last = true;
+        reported.fetch_add(1, std::memory_order_relaxed);
+        // Without the lock, on_stall() may take its time.
+        lock.unlock();
+        on_stall(stall{ .stuck = stuck, .for_how_long = now - since });
+        lock.lock();
+    }
+}
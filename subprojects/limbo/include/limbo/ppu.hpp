@@ -53,6 +53,11 @@ namespace limbo::ppu {
     template<std::size_t Index, typename Head, typename... Tail>
     struct nth_type;
 
+    // Position of the first T in Types, fails to compile if T isn't there.
+    // Recover using ::value.
+    template<typename T, typename... Types>
+    struct index_of;
+
     // Just a simple wrapper around nth_type for ease of use.
     template<typename... Types>
     struct accessors_for
@@ -230,6 +235,26 @@ namespace limbo::ppu /* A.K.A parameter_pack_utils */
         using type = NthType;
     };
 
+    // Pops one type at a time from the pack until T is found.
+    template<typename T, typename PoppedType, typename... Types>
+    struct index_of<T, PoppedType, Types...>
+    {
+        static constexpr std::size_t value = 1 + index_of<T, Types...>::value;
+    };
+    // Found it.
+    template<typename T, typename... Types>
+    struct index_of<T, T, Types...>
+    {
+        static constexpr std::size_t value = 0;
+    };
+    // Ran out of types.
+    template<typename T>
+    struct index_of<T>
+    {
+        static_assert(!std::is_same_v<T, T>, "Type not found in pack");
+        static constexpr std::size_t value = 0;
+    };
+
     template<std::size_t Index, typename... Types>
     struct types_before
     {
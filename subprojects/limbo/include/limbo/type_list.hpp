@@ -67,6 +67,9 @@ namespace limbo {
 
         template<typename T>
         static const bool contains = (std::is_same_v<T, Types> || ...);
+        // Position of T in the list, fails to compile if T isn't there.
+        template<typename T>
+        static constexpr std::size_t index_of = ppu::index_of<T, Types...>::value;
     };
 
     // Empty list case.
@@ -0,0 +1,244 @@
+#include "boiler/checkpoint.hpp"
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h> // waitpid.
+#include <unistd.h>   // fork, execv, getpid.
+
+namespace msg        = boiler::messages;
+namespace checkpoint = boiler::checkpoint;
+
+namespace {
+    constexpr auto cycles_before = 20;
+
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    auto to_string(const std::vector<boiler::control_unit::msg_to_units>& messages)
+    {
+        auto ss = std::stringstream{};
+        for (const auto& m : messages) {
+            std::visit([&](const auto& alt) { ss << alt << ' '; }, m);
+        }
+        return ss.str();
+    }
+
+    // Through the handshake, into normal mode, checkpointing every cycle
+    // if given a writer.
+    auto run_up_to_checkpoint(
+        boiler::simulator& plant,
+        boiler::control_unit& ctrl,
+        checkpoint::writer* written = nullptr) -> void
+    {
+        for (auto cycle = 0; cycle < cycles_before; ++cycle) {
+            plant.process_messages(ctrl.process_messages(plant.get_messages()));
+            if (written != nullptr) { written->offer(ctrl); }
+        }
+    }
+
+    // What the process that is restarted does, in a process of its own:
+    // its code is somewhere else than in the one that loads the checkpoint.
+    auto write(const boiler::constants& c, const char* path) -> int
+    {
+        auto plant   = boiler::simulator{ c, 7 };
+        auto ctrl    = boiler::control_unit{ c };
+        auto written = checkpoint::writer{ path, c };
+        run_up_to_checkpoint(plant, ctrl, &written);
+        // The last one is the one to resume from, in the other slot than
+        // an earlier one.
+        while (written.written() == 0) { std::this_thread::yield(); }
+        while (!written.offer(ctrl)) {}
+        return 0;
+    }
+
+    auto corrupt(const std::filesystem::path& path, std::streamoff at) -> void
+    {
+        auto f = std::fstream{ path, std::ios::binary | std::ios::in | std::ios::out };
+        f.seekg(at);
+        const auto c = static_cast<char>(f.get());
+        f.seekp(at);
+        f.put(static_cast<char>(~c));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const auto constants = make_constants();
+    if (argc == 3 && std::string_view{ argv[1] } == "write") { return write(constants, argv[2]); }
+
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("boiler_checkpoint_test_" + std::to_string(::getpid()));
+
+    {
+        // Written by another process, then resumed here: the unit carries
+        // on exactly like one that was never stopped.
+        const auto child = ::fork();
+        assert(child >= 0);
+        if (child == 0) {
+            char mode[] = "write";
+            char* args[] = { argv[0], mode, const_cast<char*>(path.c_str()), nullptr };
+            ::execv("/proc/self/exe", args);
+            ::_exit(127);
+        }
+        auto status = 0;
+        ::waitpid(child, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        auto plant     = boiler::simulator{ constants, 7 };
+        auto reference = boiler::control_unit{ constants };
+        run_up_to_checkpoint(plant, reference);
+
+        const auto f = checkpoint::load(path, constants);
+        assert(f);
+        assert(f->state.mode_of_operation == boiler::control_unit::mode::normal);
+        // The readings' handlers at least.
+        assert(f->state.expectation_count >= 4);
+
+        auto first = plant.get_messages();
+        const auto now = std::chrono::system_clock::now();
+        assert(checkpoint::plausible(*f, constants, first, now, std::chrono::minutes{ 1 }));
+
+        auto restored = boiler::control_unit{ constants };
+        restored.restore(f->state);
+        for (auto cycle = 0; cycle < 30; ++cycle) {
+            auto in = cycle == 0 ? first : plant.get_messages();
+            const auto expected = reference.process_messages(in);
+            assert(to_string(restored.process_messages(in)) == to_string(expected));
+            plant.process_messages(expected);
+        }
+
+        // What the first cycle must agree with.
+        const auto old = f->taken + std::chrono::minutes{ 2 };
+        assert(!checkpoint::plausible(*f, constants, first, old, std::chrono::minutes{ 1 }));
+
+        auto restarted = first;
+        restarted.push_back(msg::to_program::steam_boiler_waiting{});
+        assert(!checkpoint::plausible(*f, constants, restarted, now, std::chrono::minutes{ 1 }));
+
+        auto moved = std::vector<boiler::control_unit::msg_from_units>{};
+        for (const auto& m : first) {
+            if (const auto* l = std::get_if<msg::to_program::level>(&m)) {
+                moved.push_back(msg::to_program::level{ l->liters + 500 });
+            } else {
+                moved.push_back(m);
+            }
+        }
+        assert(!checkpoint::plausible(*f, constants, moved, now, std::chrono::minutes{ 1 }));
+
+        auto starting = *f;
+        starting.state = boiler::control_unit{ constants }.save();
+        assert(!checkpoint::plausible(starting, constants, first, now, std::chrono::minutes{ 1 }));
+    }
+
+    {
+        // Other constants, torn slots, a file taken over, no file.
+        auto other          = constants;
+        other.pump_capacity = 7;
+        assert(!checkpoint::load(path, other));
+
+        // The header, then two slots of mostly snapshot: one of them torn
+        // leaves the other, both leave nothing.
+        const auto size = static_cast<std::streamoff>(std::filesystem::file_size(path));
+        corrupt(path, size * 3 / 4);
+        assert(checkpoint::load(path, constants));
+        corrupt(path, size * 3 / 8);
+        assert(!checkpoint::load(path, constants));
+
+        {
+            auto ctrl    = boiler::control_unit{ constants };
+            auto written = checkpoint::writer{ path, constants, { .every = 3 } };
+            assert(!checkpoint::load(path, constants));
+            assert(!written.offer(ctrl) && !written.offer(ctrl));
+        }
+        assert(!checkpoint::load(path, constants));
+
+        assert(!checkpoint::load(path.string() + ".missing", constants));
+    }
+
+    {
+        // A file taken over keeps its checkpoints until the writer has put
+        // one of its own: a process that dies before then leaves the last
+        // one for the next restart.
+        const auto wait_for = [](const checkpoint::writer& w, ta::u64 n) {
+            while (w.written() < n) { std::this_thread::yield(); }
+        };
+        {
+            auto plant   = boiler::simulator{ constants, 7 };
+            auto ctrl    = boiler::control_unit{ constants };
+            auto written = checkpoint::writer{ path, constants };
+            run_up_to_checkpoint(plant, ctrl, &written);
+        }
+        const auto last = checkpoint::load(path, constants);
+        assert(last && last->state.mode_of_operation == boiler::control_unit::mode::normal);
+
+        auto other          = constants;
+        other.pump_capacity = 7;
+        {
+            const auto unused = checkpoint::writer{ path, other };
+            assert(checkpoint::load(path, constants));
+        }
+        const auto kept = checkpoint::load(path, constants);
+        assert(kept && kept->taken == last->taken);
+
+        // The same constants carry on in the older slot: the other one
+        // still has the last checkpoint.
+        {
+            auto fresh   = boiler::control_unit{ constants };
+            auto written = checkpoint::writer{ path, constants };
+            assert(checkpoint::load(path, constants)->taken == last->taken);
+            assert(written.offer(fresh));
+            wait_for(written, 1);
+        }
+        const auto newest = checkpoint::load(path, constants);
+        assert(newest->state.mode_of_operation == boiler::control_unit::mode::initialization);
+
+        auto modes = std::vector<boiler::control_unit::mode>{};
+        const auto size = static_cast<std::streamoff>(std::filesystem::file_size(path));
+        for (const auto at : { size * 3 / 8, size * 3 / 4 }) {
+            const auto copy = path.string() + ".copy";
+            std::filesystem::copy_file(path, copy);
+            corrupt(copy, at);
+            const auto f = checkpoint::load(copy, constants);
+            assert(f);
+            modes.push_back(f->state.mode_of_operation);
+            std::filesystem::remove(copy);
+        }
+        assert(modes[0] != modes[1]);
+
+        // Other constants take the file over once they have a checkpoint.
+        {
+            auto ctrl    = boiler::control_unit{ other };
+            auto written = checkpoint::writer{ path, other };
+            assert(written.offer(ctrl));
+            wait_for(written, 1);
+        }
+        assert(!checkpoint::load(path, constants));
+        assert(checkpoint::load(path, other));
+    }
+
+    std::filesystem::remove(path);
+    std::cout << "checkpoint ok\n";
+}
@@ -0,0 +1,73 @@
+#include "boiler/command_mailbox.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Meant to also be run under ThreadSanitizer:
+//     meson configure -Db_sanitize=thread && meson test 'command mailbox test'
+int main()
+{
+    using boiler::operator_command;
+
+    constexpr auto total_commands = 200'000u;
+
+    auto mailbox       = boiler::command_mailbox{};
+    auto producer_done = std::atomic<bool>{ false };
+    auto stops_posted  = std::atomic<unsigned>{ 0 };
+
+    // Single producer of commands, numbered through n so we can check order.
+    auto producer = std::thread{ [&] {
+        for (auto i = 0u; i < total_commands;) {
+            auto cmd = operator_command{ i % 2 == 0 ? operator_command::kind::open_pump
+                                                    : operator_command::kind::close_pump,
+                                         static_cast<ta::u8>(i % 256) };
+            if (mailbox.post(cmd)) { ++i; }
+        }
+        producer_done.store(true);
+    } };
+
+    // Any number of threads may request an emergency stop.
+    auto stoppers = std::vector<std::thread>{};
+    for (auto t = 0; t < 3; ++t) {
+        stoppers.emplace_back([&] {
+            for (auto i = 0; i < 1000; ++i) {
+                mailbox.request_emergency_stop();
+                stops_posted.fetch_add(1);
+                std::this_thread::yield();
+            }
+        });
+    }
+
+    auto received = 0u;
+    auto stops    = 0u;
+    auto drain    = [&] {
+        mailbox.drain(
+            [&] { ++stops; },
+            [&](operator_command cmd) {
+                const auto expected_kind = received % 2 == 0
+                                               ? operator_command::kind::open_pump
+                                               : operator_command::kind::close_pump;
+                assert(cmd.k == expected_kind);
+                assert(cmd.n == received % 256);
+                ++received;
+            });
+    };
+
+    while (!producer_done.load() || received < total_commands) { drain(); }
+    for (auto& t : stoppers) { t.join(); }
+    producer.join();
+    drain();
+
+    assert(received == total_commands);
+    // Requests between two drains coalesce into a single stop.
+    assert(stops >= 1 && stops <= stops_posted.load());
+    // Nothing is left behind.
+    auto leftover = false;
+    mailbox.drain([&] { leftover = true; }, [&](auto) { leftover = true; });
+    assert(!leftover);
+
+    std::cout << received << " commands and " << stops << " emergency stops received\n";
+}
@@ -0,0 +1,170 @@
+#include "boiler/common.hpp"
+#include "boiler/config.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <unistd.h> // getpid.
+
+namespace {
+    constexpr auto text = std::string_view{ R"(
+# Overrides first, the defaults still apply to them.
+[unit north-7]
+pump_count = 2
+link.messages = 6
+
+[defaults]
+boiler.capacity   = 1000
+boiler.max_limit  = 900
+boiler.max_normal = 650
+boiler.min_normal = 350
+boiler.min_limit  = 100
+steam.max_throughput = 8   # liters/sec.
+steam.max_gradient = 0.5
+steam.min_gradient = 0.5
+pump_capacity = 6
+cycle_time_ms = 2500
+
+[unit east-1]
+boiler.max_normal = 700
+margins.critical_low = 2
+)" };
+
+    auto throws_invalid(std::string_view config) -> bool
+    {
+        try {
+            boiler::config::parse(config);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    }
+
+    auto write(const std::filesystem::path& path, std::string_view contents) -> void
+    {
+        auto out = std::ofstream{ path, std::ios::binary };
+        out << contents;
+    }
+}
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path() /
+                     ("boiler_config_test_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    const auto f = boiler::config::parse(text);
+    assert(f.defaults.boiler.capacity == 1000 && f.defaults.pump_count == 4);
+    assert(f.defaults.cycle_time == std::chrono::milliseconds{ 2500 });
+    assert(f.units.size() == 2);
+    // Sorted by name.
+    assert(f.units[0].name == "east-1" && f.units[1].name == "north-7");
+    assert(f.units[0].constants.boiler.max_normal == 700);
+    assert(f.units[0].constants.steam.max_throughput == 8);
+    assert(f.units[1].constants.pump_count == 2 && f.units[1].constants.link.messages == 6);
+    assert(f.units[1].constants.pump_capacity == 6);
+    assert(f.units[0].constants.margins.critical_low == 2);
+    assert(f.units[1].constants.margins.critical_low == 1.5f);
+
+    assert(throws_invalid("[defaults]\npump_count = 17\n"));
+    assert(throws_invalid("[defaults]\npump_count = 0\n"));
+    assert(throws_invalid("[defaults]\ncycle_time_ms = 0\n"));
+    assert(throws_invalid("[defaults]\nboiler.capacity = lots\n"));
+    assert(throws_invalid("[defaults]\nboiler.volume = 3\n"));
+    assert(throws_invalid("[defaults]\nboiler.min_limit = 5\n"));
+    assert(throws_invalid("[unit a]\n[unit a]\n"));
+    assert(throws_invalid("[unit " + std::string(40, 'x') + "]\n"));
+    assert(throws_invalid("[defaults\n"));
+    assert(throws_invalid("pump_count 2\n"));
+    assert(throws_invalid(std::string{ text } + "margins.critical_low = 4\n"));
+    assert(throws_invalid(std::string{ text } + "margins.critical_high = 1.1\n"));
+
+    {
+        const auto text_path     = dir / "fleet.conf";
+        const auto compiled_path = dir / "fleet.bin";
+        write(text_path, text);
+        boiler::config::compile(f, compiled_path);
+        assert(!boiler::config::is_compiled(text_path));
+        assert(boiler::config::is_compiled(compiled_path));
+
+        const auto image = boiler::config::image{ compiled_path };
+        assert(image.size() == 2 && image.name(0) == "east-1");
+        assert(image.defaults().cycle_time == std::chrono::milliseconds{ 2500 });
+        assert(image.find("north-7")->pump_count == 2);
+        assert(!image.find("north-8") && !image.find("") && !image.find("zzz"));
+
+        // Both formats give the same constants.
+        for (const auto* path : { &text_path, &compiled_path }) {
+            const auto c = boiler::config::load(*path, "east-1");
+            assert(c.boiler.max_normal == 700 && c.boiler.min_normal == 350);
+            assert(c.margins.critical_low == 2 && c.margins.critical_high == 0.95f);
+            assert(boiler::config::load(*path).boiler.max_normal == 650);
+            try {
+                boiler::config::load(*path, "west-3");
+                assert(false);
+            } catch (const std::invalid_argument&) {
+            }
+        }
+
+        // A truncated file is refused.
+        std::filesystem::resize_file(compiled_path, std::filesystem::file_size(compiled_path) - 1);
+        try {
+            boiler::config::image{ compiled_path };
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+
+    {
+        // A big fleet: every unit is found through the mapping.
+        auto big = boiler::config::fleet{};
+        for (auto i = std::size_t{ 0 }; i < 5000; ++i) {
+            auto c       = big.defaults;
+            c.pump_count = static_cast<ta::u8>(1 + i % boiler::max_pumps);
+            big.units.push_back({ "unit-" + std::to_string(i), c });
+        }
+        boiler::config::compile(big, dir / "big.bin");
+
+        const auto image = boiler::config::image{ dir / "big.bin" };
+        assert(image.size() == 5000);
+        for (auto i = std::size_t{ 0 }; i < 5000; i += 7) {
+            assert(image.find("unit-" + std::to_string(i))->pump_count == 1 + i % boiler::max_pumps);
+        }
+    }
+
+    {
+        // Records are checked like parsed units, whatever wrote them.
+        auto bad                = boiler::config::fleet{};
+        bad.defaults.pump_count = 200;
+        auto stopped            = bad.defaults;
+        stopped.pump_count      = 2;
+        stopped.cycle_time      = std::chrono::milliseconds{ 0 };
+        auto fine               = stopped;
+        fine.cycle_time         = std::chrono::milliseconds{ 100 };
+        bad.units               = { { "fine", fine }, { "stopped", stopped } };
+        boiler::config::compile(bad, dir / "bad.bin");
+
+        const auto image = boiler::config::image{ dir / "bad.bin" };
+        assert(image.find("fine")->cycle_time == std::chrono::milliseconds{ 100 });
+        try {
+            image.defaults();
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+        try {
+            image.find("stopped");
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    std::cout << "config ok\n";
+}
@@ -1,8 +1,18 @@
 #include "boiler/common.hpp"
 #include "boiler/control_unit.hpp"
 
+#include <cassert>
+#include <cstdint> // std::uintptr_t.
+
 int main()
 {
     auto constants = boiler::constants{};
     auto ctrl = boiler::control_unit{ constants };
+
+    // What every cycle touches fits in the first two cache lines.
+    const auto f = ctrl.footprint();
+    assert(f.size == sizeof(boiler::control_unit));
+    assert(alignof(boiler::control_unit) == 64);
+    assert(f.hot <= 2 * 64);
+    assert(reinterpret_cast<std::uintptr_t>(&ctrl) % 64 == 0);
 }
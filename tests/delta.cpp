@@ -0,0 +1,215 @@
+#include "boiler/common.hpp"
+#include "boiler/delta.hpp"
+#include "boiler/udp_gateway.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <variant>
+#include <vector>
+
+namespace msg = boiler::messages;
+using program  = msg::to_program::any;
+
+namespace {
+    auto readings(float level) -> std::vector<program>
+    {
+        auto cycle = std::vector<program>{};
+        for (auto n = ta::u8{ 0 }; n < 2; ++n) {
+            cycle.push_back(msg::to_program::pump_state{
+                n, msg::to_program::pump_state::possible_states::closed });
+        }
+        cycle.push_back(msg::to_program::level{ level });
+        cycle.push_back(msg::to_program::steam{ 0 });
+        return cycle;
+    }
+
+    auto level_of(const std::vector<program>& messages) -> float
+    {
+        for (const auto& m : messages) {
+            if (const auto* l = std::get_if<msg::to_program::level>(&m)) { return l->liters; }
+        }
+        return -1;
+    }
+}
+
+int main()
+{
+    {
+        auto encoder = boiler::delta::encoder<program>{ 8 };
+        auto decoder = boiler::delta::decoder<program>{};
+
+        // Everything goes until the other side has acknowledged something.
+        auto sent = readings(500);
+        sent.push_back(msg::to_program::stop{});
+        encoder.encode(1, sent);
+        assert(sent.size() == 5);
+        decoder.decode(1, sent);
+        encoder.acknowledge(1);
+
+        // Unchanged readings stay home, the rest always goes.
+        sent = readings(500);
+        sent.push_back(msg::to_program::stop{});
+        encoder.encode(2, sent);
+        assert(sent.size() == 1 && std::holds_alternative<msg::to_program::stop>(sent[0]));
+        decoder.decode(2, sent);
+        assert(sent.size() == 5 && level_of(sent) == 500);
+
+        // A change is sent until a cycle carrying it is acknowledged: cycle
+        // 3 is lost, 4 carries the change again.
+        sent = readings(510);
+        encoder.encode(3, sent);
+        assert(sent.size() == 1 && level_of(sent) == 510);
+        sent = readings(510);
+        encoder.encode(4, sent);
+        assert(sent.size() == 1);
+        decoder.decode(4, sent);
+        assert(sent.size() == 4 && level_of(sent) == 510);
+        encoder.acknowledge(4);
+        sent = readings(510);
+        encoder.encode(5, sent);
+        assert(sent.empty());
+
+        // An acknowledgement of a cycle before the change doesn't count.
+        sent = readings(520);
+        encoder.encode(6, sent);
+        encoder.acknowledge(5);
+        sent = readings(520);
+        encoder.encode(7, sent);
+        assert(sent.size() == 1);
+
+        // Keyframes send everything.
+        sent = readings(520);
+        encoder.encode(8, sent);
+        assert(sent.size() == 4);
+
+        // A cycle arriving late is left alone.
+        auto late = std::vector<program>{ msg::to_program::level{ 1 } };
+        decoder.decode(3, late);
+        assert(late.size() == 1);
+        auto next = std::vector<program>{};
+        decoder.decode(9, next);
+        assert(level_of(next) == 510);
+        assert(encoder.suppressed() == 4 + 3 + 3 + 4 + 3 + 3);
+    }
+
+    {
+        // Pump 1 stops reporting: filled in until a keyframe doesn't have
+        // it, forgotten on both sides after that.
+        auto encoder = boiler::delta::encoder<program>{ 4 };
+        auto decoder = boiler::delta::decoder<program>{};
+        const auto without_pump_1 = [] {
+            auto cycle = readings(500);
+            cycle.erase(cycle.begin() + 1);
+            return cycle;
+        };
+
+        auto sent = readings(500);
+        decoder.decode(1, sent, 0, encoder.encode(1, sent));
+        encoder.acknowledge(1);
+
+        sent = without_pump_1();
+        decoder.decode(2, sent, 0, encoder.encode(2, sent));
+        assert(sent.size() == 4);
+
+        sent = without_pump_1();
+        assert(encoder.encode(4, sent) && sent.size() == 3);
+        decoder.decode(4, sent, 0, true);
+        assert(sent.size() == 3);
+        encoder.acknowledge(4);
+
+        sent = {};
+        decoder.decode(5, sent);
+        assert(sent.size() == 3);
+
+        // Back, unchanged: sent again, the rest still left out.
+        sent = readings(500);
+        assert(!encoder.encode(6, sent) && sent.size() == 1);
+        decoder.decode(6, sent);
+        assert(sent.size() == 4);
+    }
+
+    {
+        // The mode changes in a datagram that's lost: the next cycles carry
+        // it until the plant acknowledges one of them.
+        using units = msg::to_units::any;
+        using modes = msg::to_units::mode::possible_modes;
+        auto encoder    = boiler::delta::encoder<units>{};
+        auto decoder    = boiler::delta::decoder<units>{};
+        const auto mode = [](const std::vector<units>& m) {
+            assert(m.size() == 1);
+            return std::get<msg::to_units::mode>(m[0]).m;
+        };
+
+        auto sent = std::vector<units>{};
+        for (auto cycle = ta::u32{ 1 }; cycle <= 10; ++cycle) {
+            sent = { msg::to_units::mode{ modes::normal } };
+            decoder.decode(cycle, sent, 0, encoder.encode(cycle, sent));
+            encoder.acknowledge(cycle);
+        }
+
+        sent = { msg::to_units::mode{ modes::emergency_stop } };
+        encoder.encode(11, sent);
+        assert(mode(sent) == modes::emergency_stop);
+        for (auto cycle = ta::u32{ 12 }; cycle <= 14; ++cycle) {
+            sent = { msg::to_units::mode{ modes::emergency_stop } };
+            decoder.decode(cycle, sent, 0, encoder.encode(cycle, sent));
+            assert(mode(sent) == modes::emergency_stop);
+        }
+        encoder.acknowledge(14);
+        sent = { msg::to_units::mode{ modes::emergency_stop } };
+        encoder.encode(15, sent);
+        assert(sent.empty());
+
+        // A cycle sent again goes whole and changes nothing: acknowledged,
+        // it doesn't stand for the change it carried the first time.
+        sent = { msg::to_units::mode{ modes::normal } };
+        assert(!encoder.encode(15, sent) && mode(sent) == modes::normal);
+        encoder.acknowledge(15);
+        sent = { msg::to_units::mode{ modes::normal } };
+        encoder.encode(16, sent);
+        assert(mode(sent) == modes::normal);
+    }
+
+    {
+        // Over the wire: a steady boiler costs a header per cycle and the
+        // gateway still hands out full cycles.
+        auto gateway = boiler::net::gateway{ "127.0.0.1", 0, 1 };
+        auto plant   = boiler::net::loopback_plant{ "127.0.0.1", 0, 1 };
+        plant.connect("127.0.0.1", gateway.port());
+        gateway.enable_delta();
+        plant.enable_delta();
+
+        auto in  = std::vector<program>{};
+        auto out = std::vector<msg::to_units::any>{};
+        for (auto cycle = ta::u32{ 1 }; cycle < 20; ++cycle) {
+            plant.send(0, readings(cycle < 10 ? 500.f : 600.f));
+            plant.flush();
+            while (gateway.poll(std::chrono::milliseconds{ 100 }) == 0) {}
+            gateway.take(0, in);
+            assert(in.size() == 4 && level_of(in) == (cycle < 10 ? 500.f : 600.f));
+
+            gateway.send(0, { msg::to_units::mode{ msg::to_units::mode::possible_modes::normal } });
+            gateway.flush();
+            while (plant.poll(std::chrono::milliseconds{ 100 }) == 0) {}
+            plant.take(0, out);
+            assert(out.size() == 1);
+        }
+        assert(plant.stats().suppressed > 50 && gateway.stats().suppressed > 10);
+        assert(plant.stats().bytes_out < 19 * (boiler::wire::header_size + 20));
+
+        // The plant's datagram is lost and the gateway sends the next cycle
+        // anyway, with the change: a cycle of its own, not the plant's
+        // last one again.
+        const auto before = plant.last_cycle(0);
+        gateway.send(0, { msg::to_units::mode{ msg::to_units::mode::possible_modes::emergency_stop } });
+        gateway.flush();
+        while (plant.poll(std::chrono::milliseconds{ 100 }) == 0) {}
+        plant.take(0, out);
+        assert(plant.last_cycle(0) == before + 1 && out.size() == 1);
+        const auto* mode = std::get_if<msg::to_units::mode>(&out.front());
+        assert(mode && mode->m == msg::to_units::mode::possible_modes::emergency_stop);
+    }
+
+    std::cout << "delta ok\n";
+}
@@ -0,0 +1,149 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/expectation_pool.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+namespace msg = boiler::messages;
+
+namespace {
+    using pool = boiler::expectation_pool<int, 4, 2>;
+    static_assert(std::is_trivially_copyable_v<pool>);
+
+    auto values(pool& p, std::size_t key, ta::u32 up_to)
+    {
+        auto result = std::vector<int>{};
+        p.for_each(key, up_to, [&](pool::handle, int& v) { result.push_back(v); });
+        return result;
+    }
+
+    // Exposes the protected expectation API.
+    struct unit : boiler::control_unit
+    {
+        using control_unit::control_unit;
+
+        std::vector<ta::u8> acked;
+
+        auto on_ack(const msg_from_units& m) -> void
+        {
+            acked.push_back(std::get<msg::to_program::pump_failure_acknowledgement>(m).n);
+        }
+
+        auto report_failure(ta::u8 n) -> expectation_handle
+        {
+            return send(msg::to_units::pump_failure_detection{ n })
+                .until_ack(static_cast<receipt_fn>(&unit::on_ack));
+        }
+
+        using control_unit::cancel;
+        using control_unit::expecting;
+    };
+
+    auto count_detections(const std::vector<boiler::control_unit::msg_to_units>& out)
+    {
+        auto count = 0;
+        for (const auto& m : out) {
+            count += std::holds_alternative<msg::to_units::pump_failure_detection>(m);
+        }
+        return count;
+    }
+}
+
+int main()
+{
+    {
+        auto p = pool{};
+        const auto a = *p.insert(0, 1);
+        const auto b = *p.insert(0, 2);
+        const auto c = *p.insert(1, 3);
+        const auto d = *p.insert(0, 4);
+        assert(p.size() == 4);
+        // Full.
+        assert(!p.insert(1, 5));
+
+        assert((values(p, 0, p.stamp()) == std::vector{ 1, 2, 4 }));
+        assert((values(p, 1, p.stamp()) == std::vector{ 3 }));
+
+        assert(p.erase(b));
+        assert(!p.erase(b));
+        assert(!p.alive(b) && p.get(b) == nullptr);
+        assert((values(p, 0, p.stamp()) == std::vector{ 1, 4 }));
+
+        // b's node is reused, b stays stale.
+        const auto cutoff = p.stamp();
+        const auto e      = *p.insert(0, 5);
+        assert(e.index == b.index && !(e == b));
+        assert(!p.erase(b) && p.alive(e) && *p.get(e) == 5);
+
+        // Values inserted after the cutoff are left out.
+        assert((values(p, 0, cutoff) == std::vector{ 1, 4 }));
+
+        // Erasing while iterating, the current one and the next.
+        auto seen = std::vector<int>{};
+        p.for_each(0, p.stamp(), [&](pool::handle h, int& v) {
+            seen.push_back(v);
+            if (v == 1) {
+                p.erase(h);
+                p.erase(d);
+            }
+        });
+        assert((seen == std::vector{ 1, 5 }));
+        assert(!p.alive(a) && p.alive(c) && p.size() == 2);
+        assert(p.empty(0) == false && p.erase(e) && p.empty(0));
+    }
+
+    {
+        // Keys in use, across words of the bitmap.
+        using wide = boiler::expectation_pool<int, 4, 130>;
+        auto p     = wide{};
+        assert(p.next_key(0) == wide::keys);
+
+        const auto a = *p.insert(3, 1);
+        const auto b = *p.insert(64, 2);
+        const auto c = *p.insert(129, 3);
+        *p.insert(64, 4);
+        assert(p.next_key(0) == 3 && p.next_key(3) == 3);
+        assert(p.next_key(4) == 64 && p.next_key(65) == 129);
+        assert(p.next_key(130) == wide::keys);
+
+        // Only once its last value is gone is a key no longer in use.
+        assert(p.erase(b) && p.next_key(4) == 64);
+        assert(p.erase(a) && p.erase(c));
+        assert(p.next_key(0) == 64 && p.next_key(65) == wide::keys);
+    }
+
+    {
+        // One pending ack per pump at the same time.
+        auto ctrl = unit{ boiler::constants{} };
+        ctrl.process_messages({});
+
+        const auto first  = ctrl.report_failure(1);
+        const auto second = ctrl.report_failure(2);
+        const auto third  = ctrl.report_failure(3);
+        assert(ctrl.expecting<msg::to_program::pump_failure_acknowledgement>());
+
+        // All three are sent again while unacknowledged.
+        assert(count_detections(ctrl.process_messages({})) == 3);
+
+        // The third is given up on, in O(1).
+        assert(ctrl.cancel(third));
+        assert(!ctrl.cancel(third));
+        assert(count_detections(ctrl.process_messages({})) == 2);
+
+        // Every ack completes one expectation, the oldest first.
+        ctrl.process_messages({ msg::to_program::pump_failure_acknowledgement{ 1 } });
+        assert(ctrl.acked.size() == 1);
+        assert(!ctrl.cancel(first));
+        assert(count_detections(ctrl.process_messages({})) == 1);
+
+        ctrl.process_messages({ msg::to_program::pump_failure_acknowledgement{ 2 } });
+        assert(!ctrl.cancel(second));
+        assert(!ctrl.expecting<msg::to_program::pump_failure_acknowledgement>());
+        assert(count_detections(ctrl.process_messages({})) == 0);
+    }
+
+    std::cout << "expectation pool ok\n";
+}
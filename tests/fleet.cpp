@@ -0,0 +1,264 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/fleet.hpp"
+#include "boiler/simulator.hpp"
+
+#include <algorithm> // std::max.
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory> // std::unique_ptr.
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <signal.h> // kill.
+#include <unistd.h> // _exit, getpid.
+
+namespace fleet = boiler::fleet;
+
+namespace {
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    auto to_string(const std::vector<boiler::control_unit::msg_to_units>& messages)
+    {
+        auto ss = std::stringstream{};
+        for (const auto& m : messages) {
+            std::visit([&](const auto& alt) { ss << alt << ' '; }, m);
+        }
+        return ss.str();
+    }
+
+    auto loads(
+        const std::vector<float>& costs,
+        const std::vector<std::size_t>& owners,
+        std::size_t workers)
+    {
+        auto l = std::vector<float>(workers, 0);
+        for (auto b = std::size_t{ 0 }; b < costs.size(); ++b) { l[owners[b]] += costs[b]; }
+        return l;
+    }
+
+    auto after_moves(std::vector<std::size_t> owners, const std::vector<fleet::move>& moves)
+    {
+        for (const auto& m : moves) {
+            assert(owners[m.boiler] == m.from);
+            owners[m.boiler] = m.to;
+        }
+        return owners;
+    }
+}
+
+int main()
+{
+    {
+        // Balanced already, or nowhere to go.
+        assert(fleet::plan_moves({ 1, 1, 1, 1 }, { 0, 1, 0, 1 }, 2, 0.1f).empty());
+        assert(fleet::plan_moves({ 1, 1 }, { 0, 0 }, 1, 0.1f).empty());
+
+        // Everything on one worker.
+        const auto costs  = std::vector<float>{ 10, 10, 10, 10, 10, 10 };
+        const auto start  = std::vector<std::size_t>{ 0, 0, 0, 0, 0, 0 };
+        const auto owners = after_moves(start, fleet::plan_moves(costs, start, 3, 0.1f));
+        assert((loads(costs, owners, 3) == std::vector<float>{ 20, 20, 20 }));
+
+        // A boiler heavier than the others together: the best there is has
+        // it alone on a worker.
+        const auto uneven = std::vector<float>{ 100, 5, 5, 5, 5 };
+        const auto moves  = fleet::plan_moves(uneven, { 0, 0, 0, 0, 1 }, 2, 0.1f);
+        const auto after  = loads(uneven, after_moves({ 0, 0, 0, 0, 1 }, moves), 2);
+        assert(std::max(after[0], after[1]) == 100);
+        assert(moves.size() <= 4);
+    }
+
+    {
+        // A fleet answers like control units stepped in this process would,
+        // through a worker killed between cycles, one that hangs past the
+        // deadline, and rebalancing.
+        constexpr auto boilers = 8u;
+        const auto constants   = make_constants();
+        auto options           = fleet::options{};
+        options.workers            = 3;
+        options.deadline           = std::chrono::milliseconds{ 500 };
+        options.rebalance_interval = 4;
+        options.imbalance          = 0.0f;
+        auto coordinator           = fleet::coordinator{ constants, boilers, options };
+        assert(coordinator.workers() == 3 && coordinator.boilers() == boilers);
+
+        auto plants    = std::vector<boiler::simulator>{};
+        auto reference = std::vector<std::unique_ptr<boiler::control_unit>>{};
+        for (auto b = 0u; b < boilers; ++b) {
+            plants.emplace_back(constants, b + 1);
+            reference.push_back(std::make_unique<boiler::control_unit>(constants));
+        }
+
+        for (auto cycle = 0; cycle < 30; ++cycle) {
+            if (cycle == 10) { ::kill(coordinator.worker_pid(1), SIGKILL); }
+            if (cycle == 20) { ::kill(coordinator.worker_pid(2), SIGSTOP); }
+
+            auto in = fleet::coordinator::inputs{};
+            for (auto& plant : plants) { in.push_back(plant.get_messages()); }
+            const auto out = coordinator.step(in);
+            assert(out.size() == boilers);
+
+            for (auto b = 0u; b < boilers; ++b) {
+                const auto expected = reference[b]->process_messages(in[b]);
+                assert(to_string(out[b]) == to_string(expected));
+                assert(coordinator.cost(b) > 0);
+                plants[b].process_messages(out[b]);
+            }
+        }
+
+        const auto& stats = coordinator.stats();
+        assert(stats.cycles == 30);
+        assert(stats.restarts == 2);
+        assert(stats.lost == 0);
+        for (auto b = 0u; b < boilers; ++b) { assert(coordinator.owner(b) < 3); }
+        std::cout << "fleet: " << stats.moved << " boilers moved by rebalancing\n";
+    }
+
+    {
+        // A boiler that takes down any worker that adopts it (while the
+        // poison file exists): found by its probe and quarantined, the rest
+        // of its shard keeps answering, and no worker is replaced for it
+        // after the cycle it was found in.
+        constexpr auto boilers = 8u;
+        constexpr auto bad     = 5u;
+        const auto poison      = std::filesystem::temp_directory_path() /
+                                 ("boiler_fleet_poison_" + std::to_string(::getpid()));
+        const auto constants   = make_constants();
+        auto options           = fleet::options{};
+        options.workers            = 2;
+        options.deadline           = std::chrono::milliseconds{ 500 };
+        options.rebalance_interval = 0;
+        options.make_unit          = [&](fleet::boiler_id b, const boiler::constants& c) {
+            if (b == bad && std::filesystem::exists(poison)) { ::_exit(3); }
+            return std::make_unique<boiler::control_unit>(c);
+        };
+        auto coordinator = std::optional<fleet::coordinator>{};
+        coordinator.emplace(constants, boilers, options);
+
+        auto plants    = std::vector<boiler::simulator>{};
+        auto reference = std::vector<std::unique_ptr<boiler::control_unit>>{};
+        for (auto b = 0u; b < boilers; ++b) {
+            plants.emplace_back(constants, b + 1);
+            reference.push_back(std::make_unique<boiler::control_unit>(constants));
+        }
+
+        const auto shard = coordinator->owner(bad);
+        for (auto cycle = 0; cycle < 30; ++cycle) {
+            if (cycle == 10) {
+                std::ofstream{ poison };
+                ::kill(coordinator->worker_pid(shard), SIGKILL);
+            }
+            if (cycle == 20) {
+                assert(coordinator->owner(bad) == fleet::quarantine);
+                std::filesystem::remove(poison);
+                coordinator->readmit(bad);
+                assert(coordinator->owner(bad) < 2);
+            }
+
+            auto in = fleet::coordinator::inputs{};
+            for (auto& plant : plants) { in.push_back(plant.get_messages()); }
+            const auto out = coordinator->step(in);
+
+            for (auto b = 0u; b < boilers; ++b) {
+                const auto expected = reference[b]->process_messages(in[b]);
+                if (b != bad) {
+                    assert(to_string(out[b]) == to_string(expected));
+                } else if (cycle >= 10 && cycle < 20) {
+                    assert(out[b].empty());
+                } else if (cycle > 20) {
+                    assert(!out[b].empty());
+                }
+                plants[b].process_messages(b == bad ? expected : out[b]);
+            }
+            if (cycle == 10) { assert(coordinator->stats().restarts == 1); }
+        }
+
+        const auto& stats = coordinator->stats();
+        assert(stats.quarantined == 1);
+        assert(stats.restarts == 1);
+        assert(stats.lost == 10);
+
+        // A worker that never reads its socket again: killed once the
+        // deadline is over instead of waited for.
+        ::kill(coordinator->worker_pid(0), SIGSTOP);
+        const auto began = std::chrono::steady_clock::now();
+        coordinator.reset();
+        assert(std::chrono::steady_clock::now() - began < std::chrono::seconds{ 5 });
+    }
+
+    {
+        // A boiler that hangs rather than crashes: its worker and then its
+        // probe miss the deadline, and the cycle it's found in takes two
+        // deadlines, whatever the size of its shard.
+        constexpr auto boilers = 8u;
+        constexpr auto stuck   = 2u;
+        const auto hang        = std::filesystem::temp_directory_path() /
+                                 ("boiler_fleet_hang_" + std::to_string(::getpid()));
+        const auto constants   = make_constants();
+        auto options           = fleet::options{};
+        options.workers            = 1;
+        options.deadline           = std::chrono::milliseconds{ 200 };
+        options.rebalance_interval = 0;
+        options.make_unit          = [&](fleet::boiler_id b, const boiler::constants& c) {
+            while (b == stuck && std::filesystem::exists(hang)) { ::pause(); }
+            return std::make_unique<boiler::control_unit>(c);
+        };
+        auto coordinator = fleet::coordinator{ constants, boilers, options };
+
+        auto plants    = std::vector<boiler::simulator>{};
+        auto reference = std::vector<std::unique_ptr<boiler::control_unit>>{};
+        for (auto b = 0u; b < boilers; ++b) {
+            plants.emplace_back(constants, b + 1);
+            reference.push_back(std::make_unique<boiler::control_unit>(constants));
+        }
+
+        for (auto cycle = 0; cycle < 15; ++cycle) {
+            if (cycle == 5) {
+                std::ofstream{ hang };
+                ::kill(coordinator.worker_pid(0), SIGSTOP);
+            }
+
+            auto in = fleet::coordinator::inputs{};
+            for (auto& plant : plants) { in.push_back(plant.get_messages()); }
+            const auto began = std::chrono::steady_clock::now();
+            const auto out   = coordinator.step(in);
+            const auto took  = std::chrono::steady_clock::now() - began;
+            assert(took < 3 * options.deadline);
+
+            for (auto b = 0u; b < boilers; ++b) {
+                const auto expected = reference[b]->process_messages(in[b]);
+                if (b != stuck || cycle < 5) {
+                    assert(to_string(out[b]) == to_string(expected));
+                } else {
+                    assert(out[b].empty());
+                }
+                plants[b].process_messages(b == stuck ? expected : out[b]);
+            }
+        }
+        std::filesystem::remove(hang);
+
+        const auto& stats = coordinator.stats();
+        assert(coordinator.owner(stuck) == fleet::quarantine);
+        assert(stats.quarantined == 1 && stats.restarts == 1 && stats.lost == 10);
+    }
+
+    std::cout << "fleet ok\n";
+}
@@ -0,0 +1,157 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace msg = boiler::messages;
+
+namespace {
+    // Exposes the protected expectation API.
+    struct unit : boiler::control_unit
+    {
+        using control_unit::control_unit;
+
+        std::vector<ta::u8> acked;
+        std::vector<ta::u8> repaired;
+        int pump_states = 0;
+
+        auto on_ack(const msg_from_units& m) -> void
+        {
+            acked.push_back(std::get<msg::to_program::pump_failure_acknowledgement>(m).n);
+        }
+        auto on_repaired(const msg_from_units& m) -> void
+        {
+            repaired.push_back(std::get<msg::to_program::pump_repaired>(m).n);
+        }
+
+        auto report_failure(ta::u8 n) -> void
+        {
+            send(msg::to_units::pump_failure_detection{ n })
+                .until_ack(static_cast<receipt_fn>(&unit::on_ack));
+        }
+        auto wait_repair(ta::u8 n) -> void
+        {
+            expect<msg::to_program::pump_repaired>(n)
+                .eventually(static_cast<receipt_fn>(&unit::on_repaired));
+        }
+
+        auto on_pump_state(const msg_from_units&) -> msg_handler::response
+        {
+            ++pump_states;
+            return msg_handler::response::keep_listening;
+        }
+        auto count_pump_states() -> void
+        {
+            expect<msg::to_program::pump_state>().always({
+                .on_present = static_cast<msg_handler::present_fn>(&unit::on_pump_state),
+                .pending    = std::nullopt,
+            });
+        }
+
+        using control_unit::expecting;
+    };
+
+    auto pending_detections(const std::vector<boiler::control_unit::msg_to_units>& out)
+    {
+        auto pumps = std::vector<ta::u8>{};
+        for (const auto& m : out) {
+            if (const auto* d = std::get_if<msg::to_units::pump_failure_detection>(&m)) {
+                pumps.push_back(d->n);
+            }
+        }
+        return pumps;
+    }
+}
+
+int main()
+{
+    auto constants       = boiler::constants{};
+    constants.pump_count = boiler::max_pumps;
+
+    {
+        auto ctrl = unit{ constants };
+        ctrl.process_messages({});
+        ctrl.report_failure(1);
+        ctrl.report_failure(2);
+
+        // The ack for pump 2 doesn't satisfy the one waiting on pump 1.
+        auto out = ctrl.process_messages({ msg::to_program::pump_failure_acknowledgement{ 2 } });
+        assert((ctrl.acked == std::vector<ta::u8>{ 2 }));
+        assert((pending_detections(out) == std::vector<ta::u8>{ 1 }));
+        assert(ctrl.expecting<msg::to_program::pump_failure_acknowledgement>(1));
+        assert(!ctrl.expecting<msg::to_program::pump_failure_acknowledgement>(2));
+
+        // Nor does an ack for a pump nobody's waiting on.
+        out = ctrl.process_messages({ msg::to_program::pump_failure_acknowledgement{ 5 } });
+        assert((ctrl.acked == std::vector<ta::u8>{ 2 }));
+        assert((pending_detections(out) == std::vector<ta::u8>{ 1 }));
+    }
+
+    {
+        // Keyed expectations only see their pump.
+        auto ctrl = unit{ constants };
+        ctrl.process_messages({});
+        ctrl.wait_repair(3);
+        ctrl.process_messages({ msg::to_program::pump_repaired{ 4 } });
+        assert(ctrl.repaired.empty());
+        ctrl.process_messages({ msg::to_program::pump_repaired{ 3 } });
+        assert((ctrl.repaired == std::vector<ta::u8>{ 3 }));
+    }
+
+    {
+        // A pump past max_pumps is only seen by the expectations for any
+        // pump, once.
+        auto ctrl = unit{ constants };
+        ctrl.process_messages({});
+        ctrl.count_pump_states();
+        ctrl.process_messages({ msg::to_program::pump_state{
+            20, msg::to_program::pump_state::possible_states::open } });
+        assert(ctrl.pump_states == 1);
+
+        // Nor can it be waited on: the ack of another pump would do.
+        ctrl.report_failure(3);
+        assert(!ctrl.expecting<msg::to_program::pump_failure_acknowledgement>(20));
+#if defined(__cpp_exceptions)
+        for (const auto n : { ta::u8{ 20 }, static_cast<ta::u8>(boiler::max_pumps) }) {
+            auto refused = 0;
+            try {
+                ctrl.report_failure(n);
+            } catch (const std::out_of_range&) {
+                ++refused;
+            }
+            try {
+                ctrl.wait_repair(n);
+            } catch (const std::out_of_range&) {
+                ++refused;
+            }
+            assert(refused == 2);
+        }
+#endif
+        const auto out =
+            ctrl.process_messages({ msg::to_program::pump_failure_acknowledgement{ 3 } });
+        assert((ctrl.acked == std::vector<ta::u8>{ 3 }));
+        assert(pending_detections(out).empty());
+    }
+
+    {
+        // Every pump of a 16 pump boiler fails at once and all the acks come
+        // back in a single cycle, in any order.
+        auto ctrl = unit{ constants };
+        ctrl.process_messages({});
+        for (auto n = ta::u8{ 0 }; n < boiler::max_pumps; ++n) { ctrl.report_failure(n); }
+        assert(pending_detections(ctrl.process_messages({})).size() == boiler::max_pumps);
+
+        auto acks = std::vector<boiler::control_unit::msg_from_units>{};
+        for (auto n = boiler::max_pumps; n > 0; --n) {
+            acks.push_back(msg::to_program::pump_failure_acknowledgement{ static_cast<ta::u8>(n - 1) });
+        }
+        assert(pending_detections(ctrl.process_messages(acks)).empty());
+        assert(ctrl.acked.size() == boiler::max_pumps);
+        assert(!ctrl.expecting<msg::to_program::pump_failure_acknowledgement>());
+    }
+
+    std::cout << "keyed expectations ok\n";
+}
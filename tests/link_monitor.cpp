@@ -0,0 +1,110 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/link_monitor.hpp"
+#include "boiler/simulator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <variant>
+#include <vector>
+
+namespace msg = boiler::messages;
+using periodic = boiler::link_monitor::periodic;
+
+namespace {
+    // Everything the units send in a cycle, for `pumps` pumps.
+    auto full_cycle(ta::u8 pumps) -> std::vector<msg::from_units::any>
+    {
+        auto messages = std::vector<msg::from_units::any>{};
+        for (auto n = ta::u8{ 0 }; n < pumps; ++n) {
+            messages.push_back(msg::to_program::pump_state{
+                n, msg::to_program::pump_state::possible_states::closed });
+            messages.push_back(msg::to_program::pump_control_state{
+                n, msg::to_program::pump_control_state::possible_states::not_flowing });
+        }
+        messages.push_back(msg::to_program::level{ 500 });
+        messages.push_back(msg::to_program::steam{ 0 });
+        return messages;
+    }
+
+    auto without_level(std::vector<msg::from_units::any> messages)
+    {
+        messages.erase(
+            std::remove_if(messages.begin(), messages.end(), [](const auto& m) {
+                return std::holds_alternative<msg::to_program::level>(m);
+            }),
+            messages.end());
+        return messages;
+    }
+}
+
+int main()
+{
+    {
+        auto link = boiler::link_monitor{ 4 };
+
+        link.observe(full_cycle(4));
+        assert(link.complete() && !link.silent());
+        assert(link.arrived(periodic::pump_state, 3));
+        assert(!link.arrived(periodic::pump_state, 4));
+
+        link.observe(without_level(full_cycle(4)));
+        assert(!link.complete() && !link.silent());
+        assert(!link.arrived(periodic::level) && link.arrived(periodic::steam));
+        assert(link.incomplete_streak() == 1);
+
+        link.observe({});
+        assert(link.silent() && link.incomplete_streak() == 2);
+
+        const auto level = link.of(periodic::level);
+        assert(level.expected == 3 && level.missing == 2);
+        assert(level.expected_in_window == 3 && level.missing_in_window == 2);
+
+        const auto pumps = link.of(periodic::pump_state);
+        assert(pumps.expected == 12 && pumps.missing == 4);
+
+        // Pumps past pump_count aren't expected, and don't count as arrived.
+        auto extra = full_cycle(4);
+        extra.push_back(msg::to_program::pump_state{
+            7, msg::to_program::pump_state::possible_states::open });
+        link.observe(extra);
+        assert(link.complete() && link.incomplete_streak() == 0);
+        assert(!link.arrived(periodic::pump_state, 7));
+
+        // Losses slide out of the window.
+        for (auto i = 0u; i < boiler::link_monitor::window - 2; ++i) { link.observe(full_cycle(4)); }
+        assert(link.of(periodic::level).missing_in_window == 1);
+        link.observe(full_cycle(4));
+        assert(link.of(periodic::level).missing_in_window == 0);
+        assert(link.loss_rate(periodic::level) == 0);
+        assert(link.of(periodic::level).missing == 2);
+        assert(link.of(periodic::level).expected_in_window == boiler::link_monitor::window);
+    }
+
+    {
+        // A unit that is up goes to emergency_stop when a cycle is incomplete.
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+
+        auto sim  = boiler::simulator{ c, 7 };
+        auto ctrl = boiler::control_unit{ c };
+        for (auto i = 0; i < 10; ++i) {
+            sim.process_messages(ctrl.process_messages(sim.get_messages()));
+        }
+        assert(sim.controller_mode() == boiler::simulator::mode::normal);
+        assert(ctrl.link().cycles() == 10);
+
+        sim.process_messages(ctrl.process_messages(without_level(sim.get_messages())));
+        assert(sim.controller_mode() == boiler::simulator::mode::emergency_stop);
+        assert(ctrl.link().of(periodic::level).missing == 1);
+    }
+
+    std::cout << "link monitor ok\n";
+}
@@ -0,0 +1,81 @@
+#include "boiler/message_format.hpp"
+#include "boiler/messages.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+template<typename Msg>
+auto check(const Msg& msg)
+{
+    auto expected = std::ostringstream{};
+    expected << msg;
+
+    char buffer[boiler::messages::max_formatted_size];
+    auto [end, ec] = boiler::messages::format_to(std::begin(buffer), std::end(buffer), msg);
+    assert(ec == std::errc{});
+    assert(std::string_view(buffer, static_cast<std::size_t>(end - buffer)) == expected.str());
+
+    // Running out of room is reported, not overrun.
+    auto tiny        = std::string(expected.str().size() - 1, '\0');
+    auto [_, too_small] =
+        boiler::messages::format_to(tiny.data(), tiny.data() + tiny.size(), msg);
+    assert(too_small == std::errc::value_too_large);
+}
+
+// Variants print through format_to(any) but through std::visit with
+// operator<<.
+template<typename Any>
+auto check_any(const Any& msg)
+{
+    auto expected = std::ostringstream{};
+    std::visit([&](const auto& m) { expected << m; }, msg);
+
+    char buffer[boiler::messages::max_formatted_size];
+    auto [end, ec] = boiler::messages::format_to(std::begin(buffer), std::end(buffer), msg);
+    assert(ec == std::errc{});
+    assert(std::string_view(buffer, static_cast<std::size_t>(end - buffer)) == expected.str());
+}
+
+template<typename... Types>
+struct check_defaults
+{
+    template<typename Any>
+    static auto run()
+    {
+        (check(Types{}), ...);
+        (check_any(Any{ Types{} }), ...);
+    }
+};
+
+int main()
+{
+    namespace to_units   = boiler::messages::to_units;
+    namespace to_program = boiler::messages::to_program;
+
+    to_units::types::recover_to<check_defaults>::run<to_units::any>();
+    to_program::types::recover_to<check_defaults>::run<to_program::any>();
+
+    for (auto m = 0; m < 5; ++m) {
+        check(to_units::mode{ static_cast<to_units::mode::possible_modes>(m) });
+    }
+    for (auto n = 0; n < 256; n += 17) {
+        check(to_units::open_pump{ static_cast<ta::u8>(n) });
+        check(to_program::pump_state{ static_cast<ta::u8>(n),
+                                      to_program::pump_state::possible_states::open });
+        check(to_program::pump_control_state{
+            static_cast<ta::u8>(n), to_program::pump_control_state::possible_states::not_flowing });
+    }
+    for (auto value : { 0.f, -0.f, 1.f, 0.1f, 1.f / 3, 123456.f, 1234567.f, 1e-5f, 1e-4f,
+                        -42.125f, 3.4e38f, std::numeric_limits<float>::infinity(),
+                        std::numeric_limits<float>::denorm_min() }) {
+        check(to_program::level{ value });
+        check(to_program::steam{ value });
+    }
+    for (auto value = -1000.f; value < 1000.f; value += 0.37f) { check(to_program::level{ value }); }
+
+    std::cout << "format_to matches operator<<\n";
+}
@@ -0,0 +1,46 @@
+#include "boiler/message_ids.hpp"
+
+#include <cassert>
+#include <iostream>
+
+template<typename TypeList>
+struct id_checker;
+
+template<typename... Types>
+struct id_checker<limbo::type_list<Types...>>
+{
+    template<typename Any>
+    static auto check(const std::array<std::string_view, sizeof...(Types)>& names)
+    {
+        (
+            [&] {
+                // The id must match the variant index and name tables.
+                auto msg = Any{ Types{} };
+                assert(boiler::messages::id_of_msg(msg) == boiler::messages::id_of<Types>);
+                assert(names[boiler::messages::id_of<Types>] == boiler::messages::name_of<Types>);
+                assert(boiler::messages::name_of_msg(msg) == boiler::messages::name_of<Types>);
+                std::cout << ta::u16{ boiler::messages::id_of<Types> } << ": "
+                          << boiler::messages::name_of<Types> << '\n';
+            }(),
+            ...);
+    }
+};
+
+int main()
+{
+    using namespace boiler::messages;
+
+    id_checker<to_units::types>::check<to_units::any>(to_units::names);
+    id_checker<to_program::types>::check<to_program::any>(to_program::names);
+
+    // Ids are part of the log and wire formats, these must never change.
+    static_assert(id_of<to_units::mode> == 0);
+    static_assert(id_of<to_units::steam_repaired_acknowledgement> == 12);
+    static_assert(id_of<to_program::stop> == 0);
+    static_assert(id_of<to_program::level> == 5);
+    static_assert(id_of<to_program::steam_outcome_failure_acknowledgment> == 14);
+    static_assert(id_of<const to_program::level&> == id_of<to_program::level>);
+
+    assert(to_units::names[id_of<to_units::open_pump>] == "open_pump");
+    assert(to_program::names[id_of<to_program::pump_state>] == "pump_state");
+}
@@ -0,0 +1,174 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/outbound_scheduler.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <variant>
+#include <vector>
+
+namespace msg      = boiler::messages;
+namespace outbound = boiler::outbound;
+using priority     = outbound::priority;
+using out_t        = std::vector<boiler::control_unit::msg_to_units>;
+
+static_assert(outbound::priority_of<msg::to_units::mode> == priority::safety);
+static_assert(outbound::priority_of<msg::to_units::close_pump> == priority::actuation);
+static_assert(outbound::priority_of<msg::to_units::level_failure_detection> == priority::acks);
+static_assert(outbound::priority_of<msg::to_units::steam_repaired_acknowledgement> == priority::acks);
+static_assert(outbound::size_of<msg::to_units::valve> == 1);
+static_assert(outbound::size_of<msg::to_units::open_pump> == 2);
+
+namespace {
+    auto stop() -> msg::to_units::mode
+    {
+        return { msg::to_units::mode::possible_modes::emergency_stop };
+    }
+}
+
+int main()
+{
+    {
+        // Most important first, production order within a class.
+        auto s   = outbound::scheduler{};
+        auto out = out_t{
+            msg::to_units::pump_repaired_acknowledgement{ 2 },
+            msg::to_units::open_pump{ 1 },
+            stop(),
+            msg::to_units::close_pump{ 0 },
+        };
+        s.schedule(out);
+        assert(out.size() == 4);
+        assert(std::holds_alternative<msg::to_units::mode>(out[0]));
+        assert(std::get<msg::to_units::open_pump>(out[1]).n == 1);
+        assert(std::get<msg::to_units::close_pump>(out[2]).n == 0);
+        assert(std::holds_alternative<msg::to_units::pump_repaired_acknowledgement>(out[3]));
+        assert(s.backlog() == 0);
+    }
+
+    {
+        // Two messages a cycle: the rest is carried over, safety isn't
+        // counted against anything.
+        auto s   = outbound::scheduler{ { .messages = 2 } };
+        auto out = out_t{
+            msg::to_units::pump_failure_detection{ 0 },
+            msg::to_units::pump_failure_detection{ 1 },
+            msg::to_units::open_pump{ 0 },
+            msg::to_units::open_pump{ 1 },
+            msg::to_units::open_pump{ 2 },
+            stop(),
+        };
+        s.schedule(out);
+        assert(out.size() == 3);
+        assert(std::holds_alternative<msg::to_units::mode>(out[0]));
+        assert(std::get<msg::to_units::open_pump>(out[2]).n == 1);
+        assert(s.backlog() == 3);
+
+        // The detections are sent again, they replace the waiting ones.
+        out = { msg::to_units::pump_failure_detection{ 0 },
+                msg::to_units::pump_failure_detection{ 1 },
+                stop() };
+        s.schedule(out);
+        assert(out.size() == 3);
+        assert(std::get<msg::to_units::open_pump>(out[1]).n == 2);
+        assert(std::get<msg::to_units::pump_failure_detection>(out[2]).n == 0);
+        assert(s.backlog() == 1);
+
+        out.clear();
+        s.schedule(out);
+        assert(out.size() == 1);
+        assert(std::get<msg::to_units::pump_failure_detection>(out[0]).n == 1);
+        assert(s.backlog() == 0);
+
+        const auto acks = s.stats(priority::acks);
+        assert(acks.sent == 2 && acks.coalesced == 2 && acks.deferred == 2);
+        assert(acks.total_delay == 3 && acks.max_delay == 2);
+        const auto actuation = s.stats(priority::actuation);
+        assert(actuation.sent == 3 && actuation.deferred == 1 && actuation.max_delay == 1);
+        assert(s.stats(priority::safety).sent == 2);
+        assert(s.stats(priority::safety).max_delay == 0);
+    }
+
+    {
+        // Actuation commands keep their order, they are never merged.
+        auto s   = outbound::scheduler{ { .messages = 1 } };
+        auto out = out_t{ msg::to_units::open_pump{ 0 }, msg::to_units::close_pump{ 0 } };
+        s.schedule(out);
+        out = { msg::to_units::open_pump{ 0 } };
+        s.schedule(out);
+        assert(std::holds_alternative<msg::to_units::close_pump>(out[0]));
+        s.schedule(out = {});
+        assert(std::holds_alternative<msg::to_units::open_pump>(out[0]));
+        assert(s.stats(priority::actuation).coalesced == 0);
+    }
+
+    {
+        // But the same command sent again every cycle while it waits isn't
+        // queued again behind itself.
+        auto s   = outbound::scheduler{ { .messages = 1 } };
+        auto out = out_t{};
+        for (auto cycle = 0; cycle < 5; ++cycle) {
+            out = { msg::to_units::open_pump{ 0 },
+                    msg::to_units::open_pump{ 1 },
+                    msg::to_units::close_pump{ 2 } };
+            s.schedule(out);
+        }
+        // Each one is only queued again once the last one for its pump has
+        // been sent.
+        assert(s.backlog() == 2);
+        assert(s.stats(priority::actuation).dropped == 0);
+        assert(s.stats(priority::actuation).coalesced == 8);
+
+        // A different command for the pump is queued, and so is the first
+        // one again after it.
+        out = { msg::to_units::close_pump{ 0 }, msg::to_units::open_pump{ 0 } };
+        s.schedule(out);
+        assert(s.backlog() == 3);
+        auto sent = out_t{};
+        for (auto cycle = 0; cycle < 3; ++cycle) {
+            s.schedule(out = {});
+            sent.push_back(out[0]);
+        }
+        assert(std::get<msg::to_units::close_pump>(sent[1]).n == 0);
+        assert(std::get<msg::to_units::open_pump>(sent[2]).n == 0);
+        assert(s.backlog() == 0);
+    }
+
+    {
+        // Three bytes: one open_pump fits, the second doesn't, and nothing
+        // of lower priority overtakes it.
+        auto s   = outbound::scheduler{ { .bytes = 3 } };
+        auto out = out_t{ msg::to_units::open_pump{ 0 },
+                          msg::to_units::open_pump{ 1 },
+                          msg::to_units::level_repaired_acknowledgement{} };
+        s.schedule(out);
+        assert(out.size() == 1);
+        assert(s.backlog() == 2);
+    }
+
+    {
+        // A full queue drops.
+        auto s   = outbound::scheduler{ { .messages = 1 } };
+        auto out = out_t{};
+        for (auto i = std::size_t{ 0 }; i < outbound::scheduler::queue_capacity + 2; ++i) {
+            out.push_back(msg::to_units::valve{});
+        }
+        s.schedule(out);
+        assert(out.size() == 1);
+        assert(s.stats(priority::actuation).dropped == 2);
+        assert(s.backlog() == outbound::scheduler::queue_capacity - 1);
+    }
+
+    {
+        // control_unit sends what fits its link, mode first.
+        auto c     = boiler::constants{};
+        c.link     = { .messages = 1 };
+        auto ctrl  = boiler::control_unit{ c };
+        const auto out = ctrl.process_messages({ msg::to_program::steam_boiler_waiting{} });
+        assert(!out.empty());
+        assert(std::holds_alternative<msg::to_units::mode>(out.front()));
+        assert(ctrl.outbound().stats(priority::safety).sent == 1);
+    }
+
+    std::cout << "outbound scheduler ok\n";
+}
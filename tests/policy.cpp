@@ -0,0 +1,90 @@
+#include "boiler/common.hpp"
+#include "boiler/policy.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <limits>
+
+namespace policy = boiler::policy;
+
+// Constants known at compile time get their whole policy checked at compile
+// time.
+constexpr auto make_constants()
+{
+    auto c   = boiler::constants{};
+    c.boiler = { .capacity   = 1000,
+                 .max_limit  = 900,
+                 .max_normal = 650,
+                 .min_normal = 350,
+                 .min_limit  = 100 };
+    return c;
+}
+constexpr auto constants = make_constants();
+static_assert(policy::verify(constants));
+
+constexpr auto decisions = policy::normal_policy{ constants };
+static_assert(decisions.decide(500, false) == policy::action::none);
+static_assert(decisions.decide(200, false) == policy::action::open_pump);
+static_assert(decisions.decide(700, false) == policy::action::close_pump);
+static_assert(decisions.decide(50, false) == policy::action::emergency_stop);
+static_assert(decisions.decide(890, false) == policy::action::emergency_stop);
+static_assert(decisions.decide(-1, false) == policy::action::switch_to_rescue);
+static_assert(decisions.decide(1001, true) == policy::action::switch_to_rescue);
+static_assert(decisions.decide(500, true) == policy::action::switch_to_degraded);
+
+// A NaN level can't be trusted, whichever way the band is computed.
+constexpr auto nan = std::numeric_limits<float>::quiet_NaN();
+static_assert(policy::band_of(policy::thresholds_for(constants), nan) ==
+              policy::level_band::implausible_low);
+static_assert(policy::band_of_checked(policy::thresholds_for(constants), nan) ==
+              policy::level_band::implausible_low);
+
+// The critical bands follow the margins.
+constexpr auto wide_margins()
+{
+    auto c    = make_constants();
+    c.margins = { .critical_low = 3, .critical_high = 0.8f };
+    return c;
+}
+static_assert(policy::verify(wide_margins()));
+static_assert(policy::normal_policy{ wide_margins() }.decide(200, false) ==
+              policy::action::emergency_stop);
+static_assert(policy::normal_policy{ wide_margins() }.decide(750, false) ==
+              policy::action::emergency_stop);
+
+// Misordered constants are caught.
+constexpr auto misordered()
+{
+    auto c              = make_constants();
+    c.boiler.min_normal = 800;
+    return c;
+}
+static_assert(!policy::verify(misordered()));
+
+int main()
+{
+    // The branch-free band computation agrees with the if-chain everywhere,
+    // including exactly on the thresholds.
+    const auto t = policy::thresholds_for(constants);
+    auto checked = 0;
+    for (auto level = -10.f; level <= 1010.f; level += 0.25f) {
+        assert(policy::band_of(t, level) == policy::band_of_checked(t, level));
+        ++checked;
+    }
+    for (auto level : { t.critical_low, t.low, t.normal, t.high, t.critical_high,
+                        t.implausible_high }) {
+        assert(policy::band_of(t, level) == policy::band_of_checked(t, level));
+    }
+
+    // Constants only known at runtime (and even misordered ones) work too.
+    const auto runtime = policy::normal_policy{ misordered() };
+    const auto tm      = policy::thresholds_for(misordered());
+    for (auto level = -10.f; level <= 1010.f; level += 0.25f) {
+        const auto expected =
+            policy::normal_table()[static_cast<std::size_t>(policy::band_of_checked(tm, level))][0];
+        assert(runtime.decide(level, false) == expected);
+    }
+    assert(runtime.decide(nan, false) == policy::action::switch_to_rescue);
+
+    std::cout << checked << " levels checked\n";
+}
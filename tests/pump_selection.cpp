@@ -0,0 +1,208 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/pump_selection.hpp"
+#include "boiler/simulator.hpp"
+
+#include <bit> // std::popcount.
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+namespace msg = boiler::messages;
+namespace sel = boiler::pump_selection;
+
+namespace {
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    // Which pumps the response opens and closes.
+    auto commanded(const std::vector<boiler::control_unit::msg_to_units>& out)
+        -> std::pair<sel::pump_mask, sel::pump_mask>
+    {
+        auto opened = sel::pump_mask{ 0 };
+        auto closed = sel::pump_mask{ 0 };
+        for (const auto& m : out) {
+            if (const auto* o = std::get_if<msg::to_units::open_pump>(&m)) {
+                opened = static_cast<sel::pump_mask>(opened | 1u << o->n);
+            } else if (const auto* c = std::get_if<msg::to_units::close_pump>(&m)) {
+                closed = static_cast<sel::pump_mask>(closed | 1u << c->n);
+            }
+        }
+        return { opened, closed };
+    }
+
+    auto readings(float level, float steam, sel::pump_mask open)
+        -> std::vector<boiler::control_unit::msg_from_units>
+    {
+        using state = msg::to_program::pump_state::possible_states;
+        using flow  = msg::to_program::pump_control_state::possible_states;
+        auto in     = std::vector<boiler::control_unit::msg_from_units>{
+            msg::to_program::level{ level },
+            msg::to_program::steam{ steam },
+        };
+        for (auto n = ta::u8{ 0 }; n < 4; ++n) {
+            const auto is_open = (open >> n & 1u) != 0;
+            in.push_back(msg::to_program::pump_state{ n, is_open ? state::open : state::closed });
+            in.push_back(
+                msg::to_program::pump_control_state{ n, is_open ? flow::flowing : flow::not_flowing });
+        }
+        return in;
+    }
+}
+
+int main()
+{
+    const auto constants = make_constants();
+    const auto dt        = std::chrono::duration<float>(constants.cycle_time).count();
+    auto table           = sel::table{ constants };
+
+    // Empty boiler: every pump there is. Overflowing boiler: none.
+    assert(table.best_count(100, 8) > constants.pump_count);
+    assert(table.select(0b1111, 100, 8) == 0b1111);
+    assert(table.best_count(950, 0) == 0);
+    assert(table.select(0b1111, 950, 0) == 0);
+
+    // Fewer pumps as the level rises, more as the steam does; not knowing
+    // the steam is in between.
+    for (auto steam = 0.0f; steam <= 8; steam += 0.5f) {
+        for (auto level = 0.0f; level + 10 <= 1000; level += 10) {
+            assert(table.best_count(level + 10, steam) <= table.best_count(level, steam));
+            assert(table.best_count(level, steam + 0.5f) >= table.best_count(level, steam));
+            assert(table.best_count(level, std::nullopt) >= table.best_count(level, 0));
+            assert(table.best_count(level, std::nullopt) <= table.best_count(level, 8));
+        }
+    }
+
+    // Within the normal band, the level stays there.
+    for (auto steam = 0.0f; steam <= 8; steam += 1) {
+        for (auto level = 400.0f; level <= 600; level += 25) {
+            const auto k    = static_cast<float>(table.best_count(level, steam));
+            const auto next = level + dt * (k * constants.pump_capacity - steam);
+            assert(next >= constants.boiler.min_normal && next <= constants.boiler.max_normal);
+        }
+    }
+
+    // Only healthy pumps, the first ones, as many as the table says or as
+    // there are; the cache follows failures and repairs.
+    for (auto round = 0; round < 2; ++round) {
+        for (auto healthy = sel::pump_mask{ 0 }; healthy < 16; ++healthy) {
+            for (auto level = 0.0f; level <= 1000; level += 50) {
+                const auto open = table.select(healthy, level, 4);
+                assert((open & ~healthy) == 0);
+                const auto want = std::min<std::size_t>(
+                    table.best_count(level, 4),
+                    static_cast<std::size_t>(std::popcount(healthy)));
+                assert(static_cast<std::size_t>(std::popcount(open)) == want);
+                // No healthy pump left closed below an open one.
+                const auto below = static_cast<sel::pump_mask>((1u << std::bit_width(open)) - 1u);
+                assert((healthy & below & ~open) == 0);
+            }
+        }
+    }
+
+    {
+        // Pump 0 doesn't open when told to: the unit says so, goes degraded
+        // with the other three, and back to normal once it's repaired. Get
+        // to normal first, so that the readings are listened to.
+        auto plant = boiler::simulator{ constants, 1 };
+        auto ctrl  = boiler::control_unit{ constants };
+        for (auto cycle = 0; cycle < 20; ++cycle) {
+            plant.process_messages(ctrl.process_messages(plant.get_messages()));
+        }
+        const auto mode_of = [](const std::vector<boiler::control_unit::msg_to_units>& out) {
+            for (const auto& m : out) {
+                if (const auto* mode = std::get_if<msg::to_units::mode>(&m)) { return mode->m; }
+            }
+            return boiler::control_unit::mode::initialization;
+        };
+        const auto detected = [](const std::vector<boiler::control_unit::msg_to_units>& out) {
+            auto pumps = sel::pump_mask{ 0 };
+            for (const auto& m : out) {
+                if (const auto* d = std::get_if<msg::to_units::pump_failure_detection>(&m)) {
+                    pumps = static_cast<sel::pump_mask>(pumps | 1u << d->n);
+                }
+            }
+            return pumps;
+        };
+
+        // Low: normal mode opens the first pump...
+        auto out              = ctrl.process_messages(readings(200, 4, 0));
+        auto [opened, closed] = commanded(out);
+        assert(opened == 0b0001 && mode_of(out) == boiler::control_unit::mode::normal);
+
+        // ...which stays closed: detected, and the other three are opened.
+        out                      = ctrl.process_messages(readings(200, 4, 0));
+        std::tie(opened, closed) = commanded(out);
+        assert(detected(out) == 0b0001 && mode_of(out) == boiler::control_unit::mode::degraded);
+        assert(opened == 0b1110 && closed == 0);
+
+        // Told again until acknowledged; the open ones are left open.
+        out                      = ctrl.process_messages(readings(200, 4, 0b1110));
+        std::tie(opened, closed) = commanded(out);
+        assert(detected(out) == 0b0001 && opened == 0 && closed == 0);
+        auto acked = readings(200, 4, 0b1110);
+        acked.push_back(msg::to_program::pump_failure_acknowledgement{ 0 });
+        assert(detected(ctrl.process_messages(acked)) == 0);
+
+        // High: they are closed again, the broken one is left alone.
+        out                      = ctrl.process_messages(readings(800, 4, 0b1111));
+        std::tie(opened, closed) = commanded(out);
+        assert(opened == 0 && closed == 0b1110);
+        assert(mode_of(out) == boiler::control_unit::mode::degraded);
+
+        // Repaired: acknowledged, and normal again.
+        auto repaired = readings(500, 4, 0);
+        repaired.push_back(msg::to_program::pump_repaired{ 0 });
+        out = ctrl.process_messages(repaired);
+        assert(mode_of(out) == boiler::control_unit::mode::normal);
+        auto repair_acked = false;
+        for (const auto& m : out) {
+            if (const auto* a = std::get_if<msg::to_units::pump_repaired_acknowledgement>(&m)) {
+                repair_acked = a->n == 0;
+            }
+        }
+        assert(repair_acked);
+    }
+
+    {
+        // The same with the simulator: the first pump is stuck closed, the
+        // others take over once the level drops and it's found out.
+        auto plant = boiler::simulator{ constants, 1 };
+        auto ctrl  = boiler::control_unit{ constants };
+        plant.inject(boiler::simulator::fault::pump, 0);
+        auto degraded_at = -1;
+        for (auto cycle = 0; cycle < 200; ++cycle) {
+            plant.process_messages(ctrl.process_messages(plant.get_messages()));
+            if (degraded_at < 0 && plant.controller_mode() == boiler::control_unit::mode::degraded) {
+                degraded_at = cycle;
+            }
+            if (degraded_at >= 0) {
+                assert(plant.controller_mode() == boiler::control_unit::mode::degraded);
+                assert(plant.level() >= constants.boiler.min_limit);
+                assert(plant.level() <= constants.boiler.max_limit);
+            }
+        }
+        assert(degraded_at >= 0);
+
+        plant.repair();
+        for (auto cycle = 0; cycle < 2; ++cycle) {
+            plant.process_messages(ctrl.process_messages(plant.get_messages()));
+        }
+        assert(plant.controller_mode() == boiler::control_unit::mode::normal);
+    }
+
+    std::cout << "pump_selection ok\n";
+}
@@ -0,0 +1,65 @@
+#include "boiler/realtime.hpp"
+
+#include <cassert>
+#include <cstring> // std::memset.
+#include <iostream>
+#include <memory>
+
+#include <sched.h> // sched_getcpu, sched_getaffinity.
+
+namespace rt = boiler::realtime;
+
+int main()
+{
+    {
+        // Nothing asked, nothing refused.
+        assert(rt::prepare({}).all_granted());
+    }
+
+    {
+        // The first core this process may run on can always be pinned to.
+        auto allowed = cpu_set_t{};
+        assert(::sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+        auto cpu = 0u;
+        while (!CPU_ISSET(cpu, &allowed)) { ++cpu; }
+
+        const auto result = rt::prepare({ .cpu = cpu });
+        assert(!result.pinning && result.all_granted());
+        assert(::sched_getcpu() == static_cast<int>(cpu));
+
+        // A core that can't exist is refused, not thrown about.
+        assert(rt::prepare({ .cpu = CPU_SETSIZE - 1 }).pinning);
+        // Nor one that doesn't fit in a cpu_set_t.
+        for (auto past : { rt::max_cpus, rt::max_cpus + 1000 }) {
+            assert(rt::prepare({ .cpu = past }).pinning == std::errc::invalid_argument);
+        }
+        assert(::sched_getcpu() == static_cast<int>(cpu));
+    }
+
+    {
+        // Without the privileges these are refused, with them granted; the
+        // thread keeps running either way.
+        const auto result = rt::prepare({ .lock_memory = true, .fifo_priority = 10 });
+        std::cout << "mlockall: " << (result.locking ? result.locking.message() : "granted")
+                  << ", SCHED_FIFO: "
+                  << (result.scheduling ? result.scheduling.message() : "granted") << '\n';
+        assert(!result.pinning);
+        assert(rt::prepare({ .fifo_priority = 1000 }).scheduling);
+    }
+
+    {
+        // Touching fresh memory shows up as page faults.
+        const auto before = rt::usage();
+        constexpr auto bytes = std::size_t{ 64 << 20 };
+        auto fresh = std::unique_ptr<char[]>{ new char[bytes] };
+        // Through a volatile, or the allocation and the writes can be
+        // optimized away (they are without exceptions).
+        char* volatile touched = fresh.get();
+        std::memset(touched, 1, bytes);
+        const auto delta = rt::usage() - before;
+        assert(delta.minor_faults + delta.major_faults > 0);
+        assert(delta.involuntary_switches >= 0 && delta.voluntary_switches >= 0);
+    }
+
+    std::cout << "realtime ok\n";
+}
@@ -0,0 +1,63 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/message_format.hpp"
+#include "boiler/message_ids.hpp"
+#include "boiler/safety_signals.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace msg = boiler::messages;
+
+namespace {
+    auto to_string(const std::vector<boiler::control_unit::msg_to_units>& messages)
+    {
+        auto text = std::string{};
+        for (const auto& m : messages) {
+            text += std::string{ msg::name_of_msg(m) } + ' ';
+            if (const auto* mode = std::get_if<msg::to_units::mode>(&m)) {
+                text += std::string{ msg::mode_names[static_cast<std::size_t>(mode->m)] } + ' ';
+            }
+        }
+        return text;
+    }
+}
+
+int main()
+{
+    {
+        auto signals    = boiler::safety::signal_counters{};
+        const auto stop = std::vector<msg::from_units::any>{ msg::to_program::stop{} };
+
+        // Two, a gap, then two more: never three in a row.
+        assert(!signals.observe(stop));
+        assert(!signals.observe(stop));
+        assert(!signals.observe({ msg::to_program::level{ 1 } }));
+        assert(signals.consecutive(0) == 0);
+        assert(!signals.observe(stop));
+        // Several in the same cycle count once.
+        assert(!signals.observe({ msg::to_program::stop{}, msg::to_program::stop{} }));
+        assert(signals.consecutive(0) == 2);
+        assert(signals.observe(stop));
+        // And it keeps tripping while they keep coming.
+        assert(signals.observe(stop));
+    }
+
+    {
+        // The stop wins over anything else that happens in the same cycle,
+        // and there's no way out of emergency_stop afterwards.
+        auto ctrl = boiler::control_unit{ boiler::constants{} };
+        ctrl.process_messages({ msg::to_program::stop{} });
+        ctrl.process_messages({ msg::to_program::stop{} });
+        const auto stopped = to_string(ctrl.process_messages(
+            { msg::to_program::stop{}, msg::to_program::steam_boiler_waiting{} }));
+        assert(stopped.find("emergency_stop") != std::string::npos);
+
+        const auto after = to_string(ctrl.process_messages({ msg::to_program::physical_units_ready{} }));
+        assert(after.find("emergency_stop") != std::string::npos);
+    }
+
+    std::cout << "safety signals ok\n";
+}
@@ -0,0 +1,102 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+
+#include <cassert>
+#include <cstring> // std::memcpy.
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility> // std::swap.
+
+namespace msg = boiler::messages;
+
+auto to_string(const std::vector<boiler::control_unit::msg_to_units>& messages)
+{
+    auto ss = std::stringstream{};
+    for (const auto& m : messages) {
+        std::visit([&](const auto& alt) { ss << alt << ' '; }, m);
+    }
+    return ss.str();
+}
+
+int main()
+{
+    auto constants = boiler::constants{};
+    auto primary   = boiler::control_unit{ constants };
+    auto standby   = boiler::control_unit{ constants };
+
+    // Primary goes through the start of the initialization handshake and is
+    // left waiting for physical_units_ready, with program_ready pending.
+    primary.process_messages({ msg::to_program::steam_boiler_waiting{} });
+    auto waiting = to_string(primary.process_messages({}));
+    assert(waiting.find("program_ready") != std::string::npos);
+
+    // A standby that never restored is still waiting for steam_boiler_waiting.
+    auto stale = to_string(standby.process_messages({}));
+    assert(stale.find("program_ready") == std::string::npos);
+
+    // Snapshots are plain bytes, with no addresses in them, and only the
+    // ones up to the last expectation matter.
+    auto image = primary.save();
+    assert(image.expectation_count > 4);
+    assert(image.used_bytes() < sizeof(image));
+    auto bytes = std::string(image.used_bytes(), '\0');
+    std::memcpy(bytes.data(), &image, bytes.size());
+    auto copy = boiler::control_unit::snapshot{};
+    std::memcpy(&copy, bytes.data(), bytes.size());
+    assert(boiler::control_unit::restorable(copy));
+    standby.restore(copy);
+
+    // Ids this build doesn't have, or that name a handler of another kind.
+    {
+        using handler_id = decltype(copy.expectations[0].on_present);
+        auto unknown     = copy;
+        unknown.expectations[0].on_present = static_cast<handler_id>(0x7f);
+        assert(!boiler::control_unit::restorable(unknown));
+
+        auto readings = 0;
+        for (auto i = std::size_t{ 0 }; i < copy.expectation_count; ++i) {
+            if (copy.expectations[i].on_present == handler_id{}) { continue; }
+            auto mixed = copy;
+            std::swap(mixed.expectations[i].on_present, mixed.expectations[i].on_receipt);
+            assert(!boiler::control_unit::restorable(mixed));
+            ++readings;
+        }
+        assert(readings == 4);
+    }
+
+    // From here on both behave the same.
+    assert(to_string(primary.process_messages({})) == to_string(standby.process_messages({})));
+
+    auto from_primary = to_string(primary.process_messages({ msg::to_program::physical_units_ready{} }));
+    auto from_standby = to_string(standby.process_messages({ msg::to_program::physical_units_ready{} }));
+    assert(from_primary == from_standby);
+    assert(from_standby.find("{m: normal}") != std::string::npos);
+
+    // A standby built from scratch takes over in the middle of operation
+    // and answers the next cycle as the primary does.
+    auto plant_constants          = boiler::constants{};
+    plant_constants.boiler        = { .capacity   = 1000,
+                                      .max_limit  = 900,
+                                      .max_normal = 650,
+                                      .min_normal = 350,
+                                      .min_limit  = 100 };
+    plant_constants.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+    plant_constants.pump_capacity = 6;
+    for (auto takeover = 1; takeover < 30; ++takeover) {
+        auto plant = boiler::simulator{ plant_constants, 2 };
+        auto first = boiler::control_unit{ plant_constants };
+        for (auto cycle = 0; cycle < takeover; ++cycle) {
+            plant.process_messages(first.process_messages(plant.get_messages()));
+        }
+        auto second = boiler::control_unit{ plant_constants };
+        second.restore(first.save());
+        const auto in = plant.get_messages();
+        assert(to_string(first.process_messages(in)) == to_string(second.process_messages(in)));
+    }
+
+    std::cout << "snapshot is " << sizeof(image) << " bytes, " << image.used_bytes() << " used\n";
+    std::cout << "primary: " << from_primary << '\n';
+    std::cout << "standby: " << from_standby << '\n';
+}
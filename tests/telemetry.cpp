@@ -0,0 +1,234 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+#include "boiler/telemetry.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h> // getpid.
+
+namespace tl = boiler::telemetry;
+
+namespace {
+    auto same(const tl::sample& a, const tl::sample& b) -> bool
+    {
+        // Bit for bit, NaNs included.
+        return a.time_ms == b.time_ms &&
+               std::bit_cast<ta::u32>(a.level_liters) == std::bit_cast<ta::u32>(b.level_liters) &&
+               std::bit_cast<ta::u32>(a.steam_liters_per_sec) ==
+                   std::bit_cast<ta::u32>(b.steam_liters_per_sec) &&
+               a.pumps_open == b.pumps_open && a.m == b.m;
+    }
+
+    auto same(const std::vector<tl::sample>& a, const std::vector<tl::sample>& b) -> bool
+    {
+        return a.size() == b.size() &&
+               std::equal(a.begin(), a.end(), b.begin(), [](const auto& x, const auto& y) {
+                   return same(x, y);
+               });
+    }
+
+    // A day of a simulated boiler, one sample per cycle.
+    auto simulated_day() -> std::vector<tl::sample>
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+
+        auto sim  = boiler::simulator{ c, 42 };
+        auto ctrl = boiler::control_unit{ c };
+
+        const auto cycle_ms = c.cycle_time.count();
+        const auto per_day  = 24 * 60 * 60 * 1000 / cycle_ms;
+
+        auto samples = std::vector<tl::sample>{};
+        for (auto i = 0; i < per_day; ++i) {
+            sim.process_messages(ctrl.process_messages(sim.get_messages()));
+            // A few ms of jitter now and then, like a real clock.
+            const auto jitter = i % 97 == 0 ? 3 : 0;
+            samples.push_back(tl::sample_of(ctrl.save(), 1'700'000'000'000 + i * cycle_ms + jitter));
+        }
+        return samples;
+    }
+
+    auto brute_force(
+        const std::vector<tl::sample>& samples,
+        ta::i64 from,
+        ta::i64 to,
+        ta::i64 window) -> std::vector<tl::window_summary>
+    {
+        auto result = std::vector<tl::window_summary>{};
+        for (auto start = from; start < to; start += window) {
+            auto in = std::vector<tl::sample>{};
+            for (const auto& s : samples) {
+                if (s.time_ms >= start && s.time_ms < std::min(to, start + window)) {
+                    in.push_back(s);
+                }
+            }
+            if (in.empty()) { continue; }
+            auto w     = tl::window_summary{};
+            w.start_ms = start;
+            w.count    = static_cast<ta::u32>(in.size());
+            auto level = std::vector<float>{};
+            auto steam = std::vector<float>{};
+            for (const auto& s : in) {
+                level.push_back(s.level_liters);
+                steam.push_back(s.steam_liters_per_sec);
+            }
+            const auto summarize = [](const std::vector<float>& v) {
+                auto sum = 0.0;
+                for (auto x : v) { sum += static_cast<double>(x); }
+                return tl::column_summary{ *std::min_element(v.begin(), v.end()),
+                                           *std::max_element(v.begin(), v.end()),
+                                           static_cast<float>(sum / static_cast<double>(v.size())) };
+            };
+            w.level_liters         = summarize(level);
+            w.steam_liters_per_sec = summarize(steam);
+            result.push_back(w);
+        }
+        return result;
+    }
+
+    auto close(float a, float b) -> bool
+    {
+        return std::abs(a - b) <= 1e-3f * std::max(1.f, std::abs(a));
+    }
+}
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path() /
+                     ("boiler_telemetry_test_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+
+    const auto day   = simulated_day();
+    const auto first = day.front().time_ms;
+    const auto last  = day.back().time_ms + 1;
+
+    {
+        // Small segments, so a day spans several of them.
+        auto store = tl::store{ dir, 64 << 10 };
+        for (const auto& s : day) { store.append(s); }
+        assert(store.size() == day.size());
+
+        // Older samples can't be appended.
+        auto threw = false;
+        try {
+            store.append(day.front());
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        // Everything, including the samples not sealed into a block yet.
+        auto all = std::vector<tl::sample>{};
+        store.scan(first, last, all);
+        assert(same(all, day));
+
+        // Ranges that cut blocks in the middle.
+        const auto from = day[1500].time_ms;
+        const auto to   = day[4321].time_ms;
+        auto part       = std::vector<tl::sample>{};
+        store.scan(from, to, part);
+        assert(same(part, std::vector<tl::sample>(day.begin() + 1500, day.begin() + 4321)));
+
+        auto none = std::vector<tl::sample>{};
+        store.scan(last, last + 1'000'000, none);
+        assert(none.empty());
+
+        // Hourly and odd sized windows, some aligned with blocks, some not.
+        for (auto window : { ta::i64{ 3'600'000 }, ta::i64{ 777'777 } }) {
+            const auto fast     = store.downsample(first + 12'345, last, window);
+            const auto expected = brute_force(day, first + 12'345, last, window);
+            assert(fast.size() == expected.size());
+            for (auto i = std::size_t{ 0 }; i < fast.size(); ++i) {
+                assert(fast[i].start_ms == expected[i].start_ms);
+                assert(fast[i].count == expected[i].count);
+                assert(fast[i].level_liters.min == expected[i].level_liters.min);
+                assert(fast[i].level_liters.max == expected[i].level_liters.max);
+                assert(close(fast[i].level_liters.avg, expected[i].level_liters.avg));
+                assert(fast[i].steam_liters_per_sec.min == expected[i].steam_liters_per_sec.min);
+                assert(fast[i].steam_liters_per_sec.max == expected[i].steam_liters_per_sec.max);
+                assert(close(fast[i].steam_liters_per_sec.avg,
+                             expected[i].steam_liters_per_sec.avg));
+            }
+        }
+
+        store.flush();
+        const auto bytes = store.bytes_used();
+        std::cout << day.size() << " samples in " << bytes << " bytes ("
+                  << static_cast<double>(bytes) / static_cast<double>(day.size())
+                  << " bytes/sample, " << static_cast<double>(bytes) * 365 / (1 << 20)
+                  << "MiB per boiler-year)\n";
+        // Raw samples take 24 bytes.
+        assert(bytes < day.size() * 8);
+    }
+
+    {
+        // Reopened, the history is all there and appends carry on in new
+        // segments.
+        auto store = tl::store{ dir, 64 << 10 };
+        assert(store.size() == day.size());
+
+        auto odd       = day.back();
+        odd.time_ms    = last + 5'000;
+        odd.level_liters = std::numeric_limits<float>::quiet_NaN();
+        odd.steam_liters_per_sec = -0.f;
+        odd.pumps_open = 0xffff;
+        store.append(odd);
+
+        auto all = std::vector<tl::sample>{};
+        store.scan(first, odd.time_ms + 1, all);
+        auto expected = day;
+        expected.push_back(odd);
+        assert(same(all, expected));
+    }
+    {
+        auto store = tl::store{ dir, 64 << 10 };
+        assert(store.size() == day.size() + 1);
+    }
+
+    {
+        // The oldest segment deleted to make room: what's left reopens, and
+        // new segments don't reuse the names of the ones still there.
+        auto segments = std::vector<std::filesystem::path>{};
+        for (const auto& entry : std::filesystem::directory_iterator{ dir }) {
+            segments.push_back(entry.path());
+        }
+        std::sort(segments.begin(), segments.end());
+        assert(segments.size() > 2);
+        std::filesystem::remove(segments.front());
+
+        auto kept = std::size_t{ 0 };
+        {
+            auto store = tl::store{ dir, 64 << 10 };
+            kept       = store.size();
+            assert(kept < day.size() + 1);
+            auto next    = day.back();
+            next.time_ms = last + 10'000;
+            store.append(next);
+            store.flush();
+        }
+        auto store = tl::store{ dir, 64 << 10 };
+        assert(store.size() == kept + 1);
+        auto all = std::vector<tl::sample>{};
+        store.scan(first, last + 10'001, all);
+        assert(all.size() == kept + 1 && all.back().time_ms == last + 10'000);
+    }
+
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,106 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+#include "boiler/trace.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace trace = boiler::trace;
+
+namespace {
+    auto make_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    auto dump() -> std::string
+    {
+        auto os = std::ostringstream{};
+        trace::write_chrome_json(os);
+        return os.str();
+    }
+
+    auto count(const std::string& text, const std::string& what) -> std::size_t
+    {
+        auto n = std::size_t{ 0 };
+        for (auto at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+            ++n;
+        }
+        return n;
+    }
+}
+
+int main()
+{
+    const auto constants = make_constants();
+
+    {
+        // Nothing is recorded until enabled.
+        auto sim  = boiler::simulator{ constants, 1 };
+        auto ctrl = boiler::control_unit{ constants };
+        sim.process_messages(ctrl.process_messages(sim.get_messages()));
+        assert(count(dump(), "\"ph\":\"B\"") == 0);
+    }
+
+    {
+        trace::enable();
+        auto sim  = boiler::simulator{ constants, 1 };
+        auto ctrl = boiler::control_unit{ constants };
+        for (auto cycle = 0; cycle < 20; ++cycle) {
+            sim.process_messages(ctrl.process_messages(sim.get_messages()));
+        }
+        trace::enable(false);
+
+        const auto json = dump();
+        assert(json.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+        assert(json.ends_with("]}\n"));
+        assert(count(json, "\"name\":\"process_messages\",\"cat\":\"control_unit\",\"ph\":\"B\"") == 20);
+        assert(count(json, "\"ph\":\"B\"") == count(json, "\"ph\":\"E\""));
+        assert(count(json, "\"args\":{\"message\":\"level\"}") >= 2 * 20);
+        assert(count(json, "\"name\":\"switch_mode\"") >= 2);
+        assert(count(json, "\"args\":{\"mode\":\"normal\"}") > 0);
+        assert(count(json, "\"name\":\"run_last_call\"") > 0);
+    }
+
+    {
+        // Other threads record while the trace is dumped, each into its
+        // own ring; overwritten begins don't leave dangling ends.
+        trace::clear();
+        assert(count(dump(), "\"ph\":\"B\"") == 0);
+
+        trace::enable();
+        auto workers = std::vector<std::thread>{};
+        for (auto t = 0; t < 3; ++t) {
+            workers.emplace_back([] {
+                for (auto i = std::size_t{ 0 }; i < 2 * trace::ring_capacity; ++i) {
+                    const auto s = trace::scope{ trace::point::schedule };
+                }
+            });
+        }
+        for (auto i = 0; i < 5; ++i) { dump(); }
+        for (auto& w : workers) { w.join(); }
+        trace::enable(false);
+
+        const auto json = dump();
+        assert(count(json, "\"name\":\"thread_name\"") >= 4);
+        const auto ends = count(json, "\"ph\":\"E\"");
+        assert(ends == count(json, "\"ph\":\"B\""));
+        assert(ends == 3 * trace::ring_capacity / 2);
+    }
+
+    std::cout << "trace ok\n";
+}
@@ -0,0 +1,272 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/udp_gateway.hpp"
+#include "boiler/watchdog.hpp"
+#include "boiler/wire.hpp"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <arpa/inet.h>  // inet_pton, htons.
+#include <netinet/in.h> // sockaddr_in.
+#include <sys/socket.h> // socket, sendto.
+#include <unistd.h>     // close.
+
+namespace msg = boiler::messages;
+namespace net = boiler::net;
+using namespace std::chrono_literals;
+
+namespace {
+    // Every message type survives the trip, in exactly size_of bytes.
+    template<typename Any, typename... Msgs>
+    auto round_trip(limbo::type_list<Msgs...>) -> void
+    {
+        (
+            [] {
+                auto sent = Any{ Msgs{} };
+                if constexpr (std::is_same_v<Msgs, msg::to_program::level>) {
+                    sent = msg::to_program::level{ 612.25f };
+                } else if constexpr (std::is_same_v<Msgs, msg::to_units::mode>) {
+                    sent = msg::to_units::mode{ msg::to_units::mode::possible_modes::rescue };
+                } else if constexpr (std::is_same_v<Msgs, msg::to_program::pump_state>) {
+                    sent = msg::to_program::pump_state{
+                        3, msg::to_program::pump_state::possible_states::open };
+                }
+
+                auto buffer    = std::array<std::byte, 16>{};
+                const auto end = boiler::wire::encode(buffer.data(), buffer.data() + buffer.size(), sent);
+                assert(end == buffer.data() + boiler::wire::size_of<Msgs>);
+                // Too small a buffer.
+                assert(boiler::wire::encode(buffer.data(), end - 1, sent) == nullptr);
+
+                auto received = Any{};
+                assert(boiler::wire::decode(buffer.data(), end, received) == end);
+                assert(received.index() == sent.index());
+                assert(boiler::wire::decode(buffer.data(), end - 1, received) == nullptr);
+            }(),
+            ...);
+    }
+
+    // Polls until `count` datagrams have arrived, or a second has passed.
+    template<typename Endpoint>
+    auto receive(Endpoint& e, std::size_t count) -> void
+    {
+        const auto deadline = std::chrono::steady_clock::now() + 1s;
+        auto received       = std::size_t{ 0 };
+        while (received < count && std::chrono::steady_clock::now() < deadline) {
+            received += e.poll(100ms);
+        }
+        assert(received == count);
+    }
+}
+
+int main()
+{
+    round_trip<msg::to_units::any>(msg::to_units::types{});
+    round_trip<msg::to_program::any>(msg::to_program::types{});
+
+    {
+        // Values are checked, not just sizes.
+        auto bad_mode  = std::array{ std::byte{ 0 }, std::byte{ 9 } };
+        auto bad_state = std::array{ std::byte{ 3 }, std::byte{ 0 }, std::byte{ 2 } };
+        auto bad_id    = std::array{ std::byte{ 200 } };
+        auto units     = msg::to_units::any{};
+        auto program   = msg::to_program::any{};
+        assert(!boiler::wire::decode(bad_mode.data(), bad_mode.data() + 2, units));
+        assert(!boiler::wire::decode(bad_state.data(), bad_state.data() + 3, program));
+        assert(!boiler::wire::decode(bad_id.data(), bad_id.data() + 1, program));
+
+        auto buffer   = std::array<std::byte, 64>{};
+        const auto in = std::vector<msg::to_program::any>{ msg::to_program::steam{ 4 },
+                                                           msg::to_program::stop{} };
+        const auto end = boiler::wire::encode_datagram(
+            buffer.data(), buffer.data() + buffer.size(), { 7, 42, 3, 0, boiler::wire::keyframe }, in);
+        assert(end == buffer.data() + boiler::wire::header_size + 5 + 1);
+
+        auto h   = boiler::wire::header{};
+        auto out = std::vector<msg::to_program::any>{ msg::to_program::stop{} };
+        assert(boiler::wire::decode_datagram(buffer.data(), end, h, out) == end);
+        assert(h.boiler == 7 && h.cycle == 42 && h.acked == 3 && h.count == 2);
+        assert(h.flags == boiler::wire::keyframe);
+        assert(out.size() == 3);
+        // A truncated datagram leaves `out` alone.
+        assert(!boiler::wire::decode_datagram(buffer.data(), end - 1, h, out));
+        assert(out.size() == 3);
+    }
+
+    {
+        // Three boilers behind a gateway, a plant standing in for them.
+        auto gateway = net::gateway{ "127.0.0.1", 0, 3, 2 };
+        auto plant   = net::loopback_plant{ "127.0.0.1", 0, 8 };
+        plant.connect("127.0.0.1", gateway.port());
+
+        // Nobody has been heard from, replies can't go anywhere.
+        assert(!gateway.send(1, { msg::to_units::valve{} }));
+
+        assert(plant.send(0, { msg::to_program::level{ 500 }, msg::to_program::steam{ 1 } }));
+        assert(plant.send(2, { msg::to_program::steam_boiler_waiting{} }));
+        assert(plant.send(7, { msg::to_program::stop{} }));
+        plant.flush();
+        receive(gateway, 3);
+        assert(gateway.stats().unknown_boiler == 1);
+
+        auto in = std::vector<msg::to_program::any>{};
+        gateway.take(0, in);
+        assert(in.size() == 2 && std::holds_alternative<msg::to_program::steam>(in[1]));
+        gateway.take(1, in);
+        assert(in.empty());
+        gateway.take(2, in);
+        assert(in.size() == 1 && gateway.last_cycle(2) == 1);
+
+        // More than a batch: flushed along the way.
+        assert(gateway.send(0, { msg::to_units::open_pump{ 1 } }));
+        assert(gateway.send(2, { msg::to_units::program_ready{} }));
+        assert(gateway.send(0, { msg::to_units::close_pump{ 1 } }));
+        gateway.flush();
+        receive(plant, 3);
+        assert(gateway.stats().datagrams_out == 3);
+
+        auto out = std::vector<msg::to_units::any>{};
+        plant.take(0, out);
+        assert(out.size() == 2 && std::holds_alternative<msg::to_units::close_pump>(out[1]));
+        assert(plant.last_cycle(0) == 2);
+        plant.take(2, out);
+        assert(out.size() == 1 && std::holds_alternative<msg::to_units::program_ready>(out[0]));
+    }
+
+    {
+        // A control unit runs a boiler through gateway_units.
+        auto gateway = net::gateway{ "127.0.0.1", 0, 1 };
+        auto plant   = net::loopback_plant{ "127.0.0.1", 0, 1 };
+        plant.connect("127.0.0.1", gateway.port());
+        auto units = net::gateway_units{ gateway, 0 };
+        auto ctrl  = boiler::control_unit{ boiler::constants{} };
+
+        plant.send(0, { msg::to_program::steam_boiler_waiting{} });
+        plant.flush();
+        receive(gateway, 1);
+        units.process_messages(ctrl.process_messages(units.get_messages()));
+
+        receive(plant, 1);
+        auto out = std::vector<msg::to_units::any>{};
+        plant.take(0, out);
+        assert(plant.last_cycle(0) == 1);
+        assert(!out.empty() && std::holds_alternative<msg::to_units::mode>(out.front()));
+    }
+
+    {
+        // Boilers that leave the flush to the caller go out together.
+        auto gateway = net::gateway{ "127.0.0.1", 0, 4 };
+        auto plant   = net::loopback_plant{ "127.0.0.1", 0, 4 };
+        plant.connect("127.0.0.1", gateway.port());
+        auto units = std::vector<net::gateway_units>{};
+        for (auto id = 0u; id < 4; ++id) {
+            units.emplace_back(gateway, id, net::flushing::by_caller);
+            plant.send(id, { msg::to_program::steam_boiler_waiting{} });
+        }
+        plant.flush();
+        receive(gateway, 4);
+
+        for (auto& u : units) {
+            auto ctrl = boiler::control_unit{ boiler::constants{} };
+            u.process_messages(ctrl.process_messages(u.get_messages()));
+        }
+        assert(gateway.stats().datagrams_out == 0);
+        gateway.flush();
+        assert(gateway.stats().datagrams_out == 4);
+        receive(plant, 4);
+    }
+
+    {
+        // A datagram with bytes past its messages is dropped whole, even
+        // the messages before them.
+        auto gateway  = net::gateway{ "127.0.0.1", 0, 1 };
+        auto to       = sockaddr_in{};
+        to.sin_family = AF_INET;
+        to.sin_port   = htons(gateway.port());
+        ::inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+        const auto fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        assert(fd >= 0);
+
+        const auto in = std::vector<msg::to_program::any>{ msg::to_program::steam{ 4 } };
+        auto buffer   = std::array<std::byte, 64>{};
+        const auto* end = boiler::wire::encode_datagram(
+            buffer.data(), buffer.data() + buffer.size(), { 0, 1, 0, 0, 0 }, in);
+        const auto size = static_cast<std::size_t>(end - buffer.data());
+        for (const auto bytes : { size, size + 3 }) {
+            ::sendto(fd, buffer.data(), bytes, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+        }
+        ::close(fd);
+        receive(gateway, 2);
+
+        auto out = std::vector<msg::to_program::any>{};
+        gateway.take(0, out);
+        assert(out.size() == 1 && gateway.stats().malformed == 1);
+    }
+
+    {
+        // The cycle thread is stuck in its control unit: the watchdog's stop
+        // goes out from the monitor's thread meanwhile.
+        struct stuck_unit : boiler::control_unit
+        {
+            explicit stuck_unit(boiler::constants c)
+                : control_unit{ c }
+            {
+                run_last(static_cast<deferred_fn>(&stuck_unit::hang));
+            }
+
+            std::atomic<bool> released = false;
+
+            auto hang() -> void
+            {
+                while (!released.load(std::memory_order_acquire)) {
+                    std::this_thread::sleep_for(1ms);
+                }
+            }
+        };
+
+        auto gateway = net::gateway{ "127.0.0.1", 0, 1 };
+        auto plant   = net::loopback_plant{ "127.0.0.1", 0, 1 };
+        plant.connect("127.0.0.1", gateway.port());
+        auto units = net::gateway_units{ gateway, 0 };
+        auto ctrl  = stuck_unit{ boiler::constants{} };
+        auto beat  = boiler::watchdog::heartbeat{};
+        ctrl.watch(&beat);
+
+        // Not heard from the boiler yet: nowhere to send to.
+        units.emergency_stop();
+        assert(plant.poll(50ms) == 0);
+
+        plant.send(0, { msg::to_program::steam_boiler_waiting{} });
+        plant.flush();
+        receive(gateway, 1);
+
+        const auto monitor = boiler::watchdog::monitor{
+            beat, 20ms, [&](const boiler::watchdog::stall&) { units.emergency_stop(); }
+        };
+        auto cycle = std::thread{ [&] {
+            units.process_messages(ctrl.process_messages(units.get_messages()));
+        } };
+
+        receive(plant, 1);
+        assert(!ctrl.released.load());
+        auto out = std::vector<msg::to_units::any>{};
+        plant.take(0, out);
+        assert(out.size() == 1);
+        const auto* mode = std::get_if<msg::to_units::mode>(&out.front());
+        assert(mode && mode->m == msg::to_units::mode::possible_modes::emergency_stop);
+        assert(plant.last_cycle(0) == 0);
+
+        ctrl.released.store(true, std::memory_order_release);
+        cycle.join();
+    }
+
+    std::cout << "udp gateway ok\n";
+}
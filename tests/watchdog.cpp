@@ -0,0 +1,128 @@
+#include "boiler/common.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/watchdog.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace msg      = boiler::messages;
+namespace watchdog = boiler::watchdog;
+using namespace std::chrono_literals;
+
+namespace {
+    // Its first cycle runs a function that doesn't return until released.
+    struct unit : boiler::control_unit
+    {
+        explicit unit(boiler::constants c)
+            : control_unit{ c }
+        {
+            run_last(static_cast<deferred_fn>(&unit::hang));
+        }
+
+        std::atomic<bool> released = false;
+
+        auto hang() -> void
+        {
+            while (!released.load(std::memory_order_acquire)) { std::this_thread::sleep_for(1ms); }
+        }
+    };
+
+    auto sent_mode(const std::vector<boiler::control_unit::msg_to_units>& out)
+    {
+        for (const auto& m : out) {
+            if (const auto* mode = std::get_if<msg::to_units::mode>(&m)) { return mode->m; }
+        }
+        assert(false);
+        return boiler::control_unit::mode::initialization;
+    }
+}
+
+int main()
+{
+    {
+        // Every entry changes the word, the same phase again too.
+        auto h = watchdog::heartbeat{};
+        h.enter(watchdog::phase::run_last);
+        const auto first = h.word();
+        assert(watchdog::heartbeat::phase_of(first) == watchdog::phase::run_last);
+        h.enter(watchdog::phase::run_last);
+        assert(h.word() != first);
+        assert(watchdog::heartbeat::phase_of(h.word()) == watchdog::phase::run_last);
+
+        auto ss = std::stringstream{};
+        ss << watchdog::phase::handle_expected << ' ' << watchdog::phase::plant_output;
+        assert(ss.str() == "handle_expected plant_output");
+    }
+
+    {
+        // Idle for long, or busy but moving: no stall.
+        auto h       = watchdog::heartbeat{};
+        auto stalled = std::atomic<int>{ 0 };
+        {
+            const auto m = watchdog::monitor{ h, 20ms, [&](const watchdog::stall&) { ++stalled; } };
+            std::this_thread::sleep_for(100ms);
+            for (auto i = 0; i < 20; ++i) {
+                h.enter(watchdog::phase::schedule);
+                std::this_thread::sleep_for(5ms);
+            }
+            h.enter(watchdog::phase::idle);
+            std::this_thread::sleep_for(100ms);
+            assert(m.stalls() == 0);
+        }
+        assert(stalled == 0);
+
+        // Stuck: reported once, with the phase, until it moves again.
+        auto stuck = std::vector<watchdog::stall>{};
+        {
+            const auto m = watchdog::monitor{ h, 20ms, [&](const watchdog::stall& s) {
+                                                 stuck.push_back(s);
+                                             } };
+            h.enter(watchdog::phase::plant_input);
+            std::this_thread::sleep_for(150ms);
+            assert(m.stalls() == 1);
+            h.enter(watchdog::phase::plant_input);
+            std::this_thread::sleep_for(150ms);
+            assert(m.stalls() == 2);
+        }
+        assert(stuck.size() == 2);
+        assert(stuck[0].stuck == watchdog::phase::plant_input);
+        assert(stuck[0].for_how_long > 20ms);
+    }
+
+    {
+        // A run_last function that never returns: the monitor says so while
+        // process_messages is stuck, and the stop it requests is what the
+        // unit sends once it's released.
+        auto constants       = boiler::constants{};
+        constants.cycle_time = 50ms;
+        auto ctrl            = unit{ constants };
+        auto h               = watchdog::heartbeat{};
+        ctrl.watch(&h);
+
+        auto stuck_in = std::atomic<watchdog::phase>{ watchdog::phase::idle };
+        const auto m  = watchdog::monitor{
+            h, constants.cycle_time, [&](const watchdog::stall& s) {
+                stuck_in.store(s.stuck);
+                ctrl.commands().request_emergency_stop();
+                ctrl.released.store(true, std::memory_order_release);
+            }
+        };
+
+        const auto began = std::chrono::steady_clock::now();
+        ctrl.process_messages({});
+        assert(std::chrono::steady_clock::now() - began > constants.cycle_time);
+        assert(stuck_in.load() == watchdog::phase::run_last);
+        assert(watchdog::heartbeat::phase_of(h.word()) == watchdog::phase::idle);
+
+        const auto out = ctrl.process_messages({});
+        assert(sent_mode(out) == boiler::control_unit::mode::emergency_stop);
+        assert(m.stalls() == 1);
+    }
+
+    std::cout << "watchdog ok\n";
+}
@@ -0,0 +1,372 @@
+#include "boiler/common.hpp"
+#include "boiler/config.hpp"
+#include "boiler/control_unit.hpp"
+#include "boiler/simulator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv> // std::from_chars.
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits> // std::remove_reference_t.
+#include <vector>
+
+// Tunes the normal band and the safety margins of boiler::constants (the
+// thresholds normal_routine decides on, see policy.hpp) against the
+// simulator.
+//
+// Every candidate runs control_unit in closed loop against simulated plants
+// for a long horizon, the same plants (initial level, steam demand) for
+// every candidate, and is scored on:
+//   - the runs that ended in an emergency stop, let the real level leave
+//     [min_limit, max_limit] or never got to normal mode, which outweigh
+//     everything else;
+//   - pump switches per 1000 cycles;
+//   - the standard deviation of the level in normal operation, per 1000
+//     liters of [min_limit, max_limit].
+// Lower is better. The first stage samples the whole space (a Latin
+// hypercube), each refinement samples around the best candidates so far
+// with half the spread. Candidates are handed to the threads in batches.
+//
+// The other constants come from --config (and --unit), the ones the tests
+// use otherwise. The best candidate is printed as config keys.
+//
+// Usage: sweep [--points N] [--cycles N] [--seeds N] [--refine N]
+//              [--threads N] [--batch N] [--top N]
+//              [--config FILE [--unit NAME]]
+
+namespace {
+    using clock = std::chrono::steady_clock;
+    using mode  = boiler::simulator::mode;
+
+    auto usage() -> int
+    {
+        std::cerr << "usage: sweep [--points N] [--cycles N] [--seeds N] [--refine N]\n"
+                     "             [--threads N] [--batch N] [--top N]\n"
+                     "             [--config FILE [--unit NAME]]\n";
+        return 2;
+    }
+
+    template<typename T>
+    auto number(std::string_view text) -> std::optional<T>
+    {
+        auto value     = T{};
+        const auto end = text.data() + text.size();
+        const auto [at, error] = std::from_chars(text.data(), end, value);
+        if (error != std::errc{} || at != end) { return std::nullopt; }
+        return value;
+    }
+
+    auto splitmix64(ta::u64& state) -> ta::u64
+    {
+        auto z = (state += 0x9e3779b97f4a7c15);
+        z      = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z      = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // In [0, 1).
+    auto random_unit(ta::u64& state) -> float
+    {
+        return static_cast<float>(splitmix64(state) >> 40) / static_cast<float>(1 << 24);
+    }
+
+    auto default_constants() -> boiler::constants
+    {
+        auto c          = boiler::constants{};
+        c.boiler        = { .capacity   = 1000,
+                            .max_limit  = 900,
+                            .max_normal = 650,
+                            .min_normal = 350,
+                            .min_limit  = 100 };
+        c.steam         = { .max_throughput = 8, .max_gradient = 0.5, .min_gradient = 0.5 };
+        c.pump_capacity = 6;
+        c.pump_count    = 4;
+        return c;
+    }
+
+    // A point of the search space, every coordinate in [0, 1]. Any point
+    // maps to valid constants: min_normal and max_normal anywhere in
+    // [min_limit, max_limit] (in order), the margins anywhere between the
+    // limits and the normal band.
+    using point = std::array<float, 4>;
+
+    auto constants_at(const boiler::constants& base, const point& p) -> boiler::constants
+    {
+        auto c              = base;
+        const auto lo       = base.boiler.min_limit;
+        const auto hi       = base.boiler.max_limit;
+        const auto a        = lo + (hi - lo) * p[0];
+        const auto b        = lo + (hi - lo) * p[1];
+        c.boiler.min_normal = std::min(a, b);
+        c.boiler.max_normal = std::max(a, b);
+
+        const auto max_low      = lo > 0 ? c.boiler.min_normal / lo : 1.0f;
+        const auto min_high     = hi > 0 ? c.boiler.max_normal / hi : 1.0f;
+        c.margins.critical_low  = 1 + (max_low - 1) * p[2];
+        c.margins.critical_high = min_high + (1 - min_high) * p[3];
+        return c;
+    }
+
+    struct plant
+    {
+        ta::u64 seed;
+        boiler::simulator::initial_state initial;
+    };
+
+    // The same for every candidate, drawn from the base constants.
+    auto make_plants(const boiler::constants& base, ta::u64 count) -> std::vector<plant>
+    {
+        auto state           = ta::u64{ 0x5eed };
+        auto plants          = std::vector<plant>{};
+        const auto& b        = base.boiler;
+        const auto max_steam = std::min(base.steam.max_throughput, base.pump_capacity);
+        for (auto i = ta::u64{ 0 }; i < count; ++i) {
+            const auto level = b.min_normal + (b.max_normal - b.min_normal) * random_unit(state);
+            const auto steam = max_steam * (0.2f + 0.7f * random_unit(state));
+            plants.push_back({ splitmix64(state), { level, steam } });
+        }
+        return plants;
+    }
+
+    struct score
+    {
+        ta::u64 failed_runs = 0;
+        double switches_per_kcycle = 0;
+        double level_stddev        = 0;
+
+        auto total(const boiler::constants& base) const -> double
+        {
+            const auto range = static_cast<double>(base.boiler.max_limit - base.boiler.min_limit);
+            return 1e6 * static_cast<double>(failed_runs) + switches_per_kcycle +
+                   1000 * level_stddev / range;
+        }
+    };
+
+    auto evaluate(
+        const boiler::constants& c,
+        const std::vector<plant>& plants,
+        ta::u64 cycles) -> score
+    {
+        auto s        = score{};
+        auto switches = ta::u64{ 0 };
+        auto ran      = ta::u64{ 0 };
+        auto sum      = 0.0;
+        auto sum_sq   = 0.0;
+        for (const auto& p : plants) {
+            auto sim       = boiler::simulator{ c, p.seed, p.initial };
+            auto ctrl      = boiler::control_unit{ c };
+            auto operating = false;
+            auto failed    = false;
+            for (auto cycle = ta::u64{ 0 }; cycle < cycles && !failed; ++cycle) {
+                sim.process_messages(ctrl.process_messages(sim.get_messages()));
+                const auto current = sim.controller_mode();
+                const auto level   = sim.level();
+                failed = current == mode::emergency_stop || level < c.boiler.min_limit ||
+                         level > c.boiler.max_limit;
+                // Start up is the same for everyone, only normal operation
+                // is scored.
+                operating = operating || current == mode::normal;
+                if (!operating || failed) { continue; }
+                sum += static_cast<double>(level);
+                sum_sq += static_cast<double>(level) * static_cast<double>(level);
+                ++ran;
+            }
+            // Never getting through start up is failing too.
+            if (failed || !operating) { ++s.failed_runs; }
+            switches += sim.pump_switches();
+        }
+        if (ran > 0) {
+            const auto n          = static_cast<double>(ran);
+            const auto mean       = sum / n;
+            s.level_stddev        = std::sqrt(std::max(0.0, sum_sq / n - mean * mean));
+            s.switches_per_kcycle = 1000.0 * static_cast<double>(switches) / n;
+        }
+        return s;
+    }
+
+    struct candidate
+    {
+        point at;
+        score result;
+        double total;
+    };
+
+    // Evaluates `candidates` on `threads` threads, `batch` at a time.
+    auto evaluate_all(
+        std::vector<candidate>& candidates,
+        const boiler::constants& base,
+        const std::vector<plant>& plants,
+        ta::u64 cycles,
+        unsigned threads,
+        std::size_t batch) -> void
+    {
+        auto next    = std::atomic<std::size_t>{ 0 };
+        auto workers = std::vector<std::thread>{};
+        for (auto t = 0u; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (auto first = next.fetch_add(batch); first < candidates.size();
+                     first      = next.fetch_add(batch)) {
+                    const auto last = std::min(first + batch, candidates.size());
+                    for (auto i = first; i < last; ++i) {
+                        auto& cand  = candidates[i];
+                        cand.result = evaluate(constants_at(base, cand.at), plants, cycles);
+                        cand.total  = cand.result.total(base);
+                    }
+                }
+            });
+        }
+        for (auto& w : workers) { w.join(); }
+    }
+
+    // Stratified in every coordinate.
+    auto latin_hypercube(std::size_t n, ta::u64& state) -> std::vector<candidate>
+    {
+        auto out = std::vector<candidate>(n);
+        for (auto d = std::size_t{ 0 }; d < std::tuple_size_v<point>; ++d) {
+            auto strata = std::vector<std::size_t>(n);
+            for (auto i = std::size_t{ 0 }; i < n; ++i) { strata[i] = i; }
+            for (auto i = n; i > 1; --i) {
+                std::swap(strata[i - 1], strata[splitmix64(state) % i]);
+            }
+            for (auto i = std::size_t{ 0 }; i < n; ++i) {
+                out[i].at[d] = (static_cast<float>(strata[i]) + random_unit(state)) /
+                               static_cast<float>(n);
+            }
+        }
+        return out;
+    }
+
+    auto around(
+        const std::vector<candidate>& best,
+        std::size_t n,
+        float spread,
+        ta::u64& state) -> std::vector<candidate>
+    {
+        auto out = std::vector<candidate>(n);
+        for (auto i = std::size_t{ 0 }; i < n; ++i) {
+            const auto& from = best[i % best.size()].at;
+            for (auto d = std::size_t{ 0 }; d < std::tuple_size_v<point>; ++d) {
+                const auto offset = (2 * random_unit(state) - 1) * spread;
+                out[i].at[d]      = std::clamp(from[d] + offset, 0.0f, 1.0f);
+            }
+        }
+        return out;
+    }
+
+    auto print(const candidate& cand, const boiler::constants& base) -> void
+    {
+        const auto c = constants_at(base, cand.at);
+        std::cout << "  normal [" << c.boiler.min_normal << ", " << c.boiler.max_normal
+                  << "], margins " << c.margins.critical_low << " / "
+                  << c.margins.critical_high << ": score " << cand.total << " ("
+                  << cand.result.failed_runs << " failed runs, "
+                  << cand.result.switches_per_kcycle << " switches/kcycle, level stddev "
+                  << cand.result.level_stddev << ")\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto points      = std::size_t{ 10'000 };
+    auto cycles      = ta::u64{ 2'000 };
+    auto seeds       = ta::u64{ 4 };
+    auto refinements = 2u;
+    auto threads     = std::max(1u, std::thread::hardware_concurrency());
+    auto batch       = std::size_t{ 16 };
+    auto top         = std::size_t{ 10 };
+    auto config_path = std::string_view{};
+    auto unit_name   = std::string_view{};
+    for (auto i = 1; i < argc; ++i) {
+        const auto arg       = std::string_view{ argv[i] };
+        const auto has_value = i + 1 < argc;
+        if (!has_value) { return usage(); }
+        const auto value = std::string_view{ argv[++i] };
+        auto ok          = true;
+        const auto set   = [&](auto& to) {
+            const auto n = number<std::remove_reference_t<decltype(to)>>(value);
+            ok           = n && *n > 0;
+            if (ok) { to = *n; }
+        };
+        if (arg == "--points") {
+            set(points);
+        } else if (arg == "--cycles") {
+            set(cycles);
+        } else if (arg == "--seeds") {
+            set(seeds);
+        } else if (arg == "--refine") {
+            const auto n = number<unsigned>(value);
+            ok           = n.has_value();
+            if (ok) { refinements = *n; }
+        } else if (arg == "--threads") {
+            set(threads);
+        } else if (arg == "--batch") {
+            set(batch);
+        } else if (arg == "--top") {
+            set(top);
+        } else if (arg == "--config") {
+            config_path = value;
+        } else if (arg == "--unit") {
+            unit_name = value;
+        } else {
+            ok = false;
+        }
+        if (!ok) { return usage(); }
+    }
+
+    auto base = default_constants();
+    if (!config_path.empty()) {
+        try {
+            base = boiler::config::load(config_path, unit_name);
+        } catch (const std::exception& e) {
+            std::cerr << "sweep: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    const auto plants = make_plants(base, seeds);
+    auto state        = ta::u64{ 1 };
+    const auto per_stage = std::max<std::size_t>(top, points / (refinements + 1));
+
+    auto best   = std::vector<candidate>{};
+    auto spread = 0.25f;
+    const auto start = clock::now();
+    for (auto stage = 0u; stage <= refinements; ++stage) {
+        auto candidates = stage == 0 ? latin_hypercube(per_stage, state)
+                                     : around(best, per_stage, spread, state);
+        if (stage > 0) { spread /= 2; }
+
+        const auto stage_start = clock::now();
+        evaluate_all(candidates, base, plants, cycles, threads, batch);
+        const auto took = std::chrono::duration<double>(clock::now() - stage_start).count();
+
+        candidates.insert(candidates.end(), best.begin(), best.end());
+        std::sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) {
+            return a.total < b.total;
+        });
+        candidates.resize(std::min(top, candidates.size()));
+        best = std::move(candidates);
+
+        std::cout << "stage " << stage << ": " << per_stage << " candidates in " << took
+                  << "s (" << static_cast<double>(per_stage) / took << "/s), best score "
+                  << best.front().total << '\n';
+    }
+    const auto took = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::cout << per_stage * (refinements + 1) << " candidates x " << seeds << " plants x "
+              << cycles << " cycles on " << threads << " threads in " << took << "s\n"
+              << "best:\n";
+    for (const auto& cand : best) { print(cand, base); }
+
+    const auto c = constants_at(base, best.front().at);
+    std::cout << "\nboiler.min_normal = " << c.boiler.min_normal
+              << "\nboiler.max_normal = " << c.boiler.max_normal
+              << "\nmargins.critical_low = " << c.margins.critical_low
+              << "\nmargins.critical_high = " << c.margins.critical_high << '\n';
+}